@@ -21,7 +21,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
 #include <GLFW/glfw3.h>
 #include <GL/glext.h>
 
@@ -31,9 +34,318 @@
 #include "noise1234.h"
 #include "simplexnoise1234.h"
 #include "cellular.h"
+#include "tilepool.h"
+#include "texstream.h"
+#include "framequeue.h"
+#include "framewrite.h"
 
+// The default texture size, which can be changed with -s
 #define IMAGE_SIZE 400
 
+// Tiles are TILE_SIZE x TILE_SIZE pixels, 16 KB of RGBA at 64
+#define TILE_SIZE 64
+
+/* Everything the shading kernel needs to know about a frame */
+typedef struct {
+    unsigned char *pixels;     // RGBA or BGRA, size*size*4 bytes
+    const unsigned char *prev; // The last frame, in the same layout
+    int size;                  // Width and height of the texture
+    int blue;                  // Byte offset of blue, 2 for RGBA, 0 for BGRA
+    int baseRate;              // Shading rate of the base noise, see shadeTile()
+    double time;
+} shadeFrame;
+
+// The coarsest shading rate, which must divide TILE_SIZE
+#define MAX_RATE 16
+
+/*
+ * shadeBands() - the sine bands of the base layer, which only depend on
+ * y and the time, so they are computed once per row
+ */
+static int shadeBands(double y, double time) {
+    return 100+(1+sin(y*2+time))*54*(sin((20.0*y+2*time))+sin(2*(20.0*y+2*time))/4+sin(3*(20.0*y+2*time))/16);
+}
+
+/*
+ * shadeTile() - the shading kernel, run by the worker pool for each tile
+ *
+ * The tile is shaded in two passes over its rows, top to bottom. The
+ * first pass computes the base layer, sine bands plus simplex noise, into
+ * a planar scalar field. The second reads that field and writes the RGBA
+ * pixels a row at a time, so the stores stream through memory. The terms
+ * that only depend on the time, the row or the column are computed once
+ * per tile, row or column.
+ *
+ * Each layer is shaded at its own rate. The noise of the base layer is
+ * smooth, with features some size/8 pixels across, so with a baseRate of
+ * 2, 4, 8 or 16 it is evaluated only at every baseRate-th pixel in x and
+ * y, and interpolated bilinearly in between. The coarse grid is in texture
+ * coordinates, so the samples line up across tiles, and the pixels on it
+ * get exactly the same noise as at full rate. The sine bands are cheap
+ * already at one per row, and they, the amplitude and the clamp at 0 are
+ * still applied at every pixel, so the sharp edges where the base is
+ * clamped stay sharp and only the smooth part is interpolated. The
+ * highlight noise has features a few pixels across, and is always
+ * evaluated at every pixel.
+ *
+ * The gradient term compares the base with the blue channel two rows up
+ * in the last frame, f->prev, wrapping around at the top edge like the
+ * texture does. The last frame and the new one are buffers of the texture
+ * stream, see texstream.h. The kernel only reads the last frame and only
+ * writes its own tile of the new one, so the tiles can be shaded in any
+ * order, and the image is the same whatever the number of threads.
+ */
+static void shadeTile(void *arg, int tile, int worker) {
+    const shadeFrame *f = (const shadeFrame*) arg;
+    int size = f->size;
+    int tilesx = (size + TILE_SIZE - 1) / TILE_SIZE;
+    int i0 = (tile % tilesx) * TILE_SIZE, j0 = (tile / tilesx) * TILE_SIZE;
+    int i1 = i0 + TILE_SIZE < size ? i0 + TILE_SIZE : size;
+    int j1 = j0 + TILE_SIZE < size ? j0 + TILE_SIZE : size;
+    int w = i1 - i0;
+    double time = f->time;
+    double amp = (2+sin(time))*15;               // Noise amplitude of the base
+    float zbase = 0.6*time, zhigh = 0.9*time;    // Noise z for the two layers
+    float xbase[TILE_SIZE], xhigh[TILE_SIZE];    // Noise x for each column
+    int field[TILE_SIZE * TILE_SIZE];            // Base for rows j0 to j1-1
+    int rate = f->baseRate;
+    int cw = (w - 1)/rate + 2, ch = (j1 - j0 - 1)/rate + 2;
+    float coarse[(TILE_SIZE/2 + 2) * (TILE_SIZE/2 + 2)]; // Base noise on the coarse grid
+    float xcoarse[TILE_SIZE/2 + 2], lerp[TILE_SIZE/2 + 2];
+    const float *c0, *c1;
+    float fx, fy, n;
+    int ci;
+    int *row;
+    const unsigned char *up;
+    unsigned char *p;
+    double x, y;
+    float ybase, yhigh;
+    int blue = f->blue, red = 2 - f->blue;
+    int i, j, base, bands, highlight, gradient;
+
+    (void) worker;
+    for(i=0; i<w; i++)
+    {
+        x = (double)(i0 + i) / size;
+        xbase[i] = 8.0*x;
+        xhigh[i] = 60*x;
+    }
+
+    // The base noise on the coarse grid, from the first pixel of the tile
+    // to one sample past its last, for the interpolation
+    if (rate > 1)
+    {
+        for(i=0; i<cw; i++)
+            xcoarse[i] = 8.0*((double)(i0 + i*rate) / size);
+        for(j=0; j<ch; j++)
+        {
+            ybase = 8.0*((double)(j0 + j*rate) / size);
+            for(i=0; i<cw; i++)
+                coarse[j*cw + i] = snoise3(xcoarse[i], ybase, zbase);
+        }
+    }
+
+    // First pass: the base layer, clamped at 0
+    for(j=j0; j<j1; j++)
+    {
+        y = (double)j / size;
+        bands = shadeBands(y, time);
+        ybase = 8.0*y;
+        row = field + (j-j0)*w;
+        if (rate > 1)
+        {
+            // Interpolate the coarse rows above and below to this row,
+            // and then along it
+            c0 = coarse + (j-j0)/rate*cw;
+            c1 = c0 + cw;
+            fy = (float)((j-j0) % rate) / rate;
+            for(i=0; i<cw; i++)
+                lerp[i] = c0[i] + (c1[i] - c0[i])*fy;
+            for(i=0; i<w; i++)
+            {
+                ci = i/rate;
+                fx = (float)(i % rate) / rate;
+                n = lerp[ci] + (lerp[ci+1] - lerp[ci])*fx;
+                base = bands;
+                base += amp*n;
+                row[i] = base > 0 ? base : 0;
+            }
+        }
+        else
+        {
+            for(i=0; i<w; i++)
+            {
+                base = bands;
+                base += amp*snoise3(xbase[i], ybase, zbase);
+                row[i] = base > 0 ? base : 0;
+            }
+        }
+    }
+
+    // Second pass: the highlight layer, and the RGBA output
+    for(j=j0; j<j1; j++)
+    {
+        y = (double)j / size;
+        yhigh = 80*y;
+        row = field + (j-j0)*w;
+        up = f->prev + ((size_t)((j-2+size) % size)*size + i0)*4;
+        p = f->pixels + ((size_t)j*size + i0)*4;
+        for(i=0; i<w; i++)
+        {
+            base = row[i];
+            highlight = 200 + 55*snoise3(xhigh[i], yhigh, zhigh);
+            float mult = base/highlight;
+            highlight = highlight*mult/mult;
+            gradient = (base-up[4*i+blue])/2;
+            p[4*i+red] = (gradient > 0 ? highlight : 0);
+            p[4*i+1] = (gradient > 0 ? highlight : 0);
+            p[4*i+blue] = base;
+            p[4*i+3] = 255;
+        }
+    }
+}
+
+/*
+ * The pipelined mode, -pipe or -drop. A shading thread drives the worker
+ * pool and shades frame after frame, while the main thread uploads and
+ * shows them, so a frame takes as long as the slower of the two rather
+ * than both. The frames are shaded straight into the buffers of the
+ * texture stream, and go between the threads by index through two
+ * lock-free queues: ready, the shaded frames, oldest first, and free, the
+ * buffers nobody holds.
+ *
+ * A buffer can be held by the display, from the shading until the GL is
+ * done reading it, and by the shading thread, as the last frame for the
+ * feedback term. It goes back to the free queue when both have let go.
+ * The display holds at most two, the one on screen and the next one, so
+ * with PIPE_DEPTH more buffers than that plus the one being shaded, up to
+ * PIPE_DEPTH frames can wait in the ready queue.
+ *
+ * When there is no free buffer, the display is behind. With -pipe, the
+ * shading thread waits for it, which is back-pressure. With -drop, it
+ * takes the oldest frame back from the ready queue and shades over it,
+ * so the frames on screen are as new as they can be.
+ */
+
+// The default number of frames that can wait to be shown, changed with -q
+#define PIPE_DEPTH 2
+
+typedef struct {
+    tilePool *pool;
+    int tiles;
+    shadeFrame frame;          // The frame being shaded, owned by the shading thread
+    texStream *stream;         // For the buffers, only the main thread calls GL
+    int refs[STREAM_MAXRING];  // Holders of each buffer, 0 to 2
+    frameQueue ready;
+    frameQueue free;
+    int dropoldest;            // 1 for -drop, 0 for -pipe
+    int quit;                  // Set by the main thread to stop the shading thread
+    int last;                  // The buffer of the last shaded frame
+    int shaded, dropped;       // Frame counts, for the statistics
+    pthread_t thread;
+} framePipe;
+
+/*
+ * pipeWait() - back off for a moment when a queue is empty
+ */
+static void pipeWait(void) {
+    struct timespec ts = { 0, 100000 }; // 0.1 ms
+
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * pipeRelease() - let go of buffer i, and free it if nobody holds it
+ */
+static void pipeRelease(framePipe *p, int i) {
+    if (__atomic_sub_fetch(&p->refs[i], 1, __ATOMIC_ACQ_REL) == 0)
+        queuePush(&p->free, i); // Never full, it has room for all buffers
+}
+
+/*
+ * pipeAcquire() - get a buffer to shade the next frame into, or 0 if the
+ * main thread wants us to stop
+ */
+static int pipeAcquire(framePipe *p, int *i) {
+    int old;
+
+    for (;;) {
+        if (__atomic_load_n(&p->quit, __ATOMIC_ACQUIRE)) return 0;
+        if (queuePop(&p->free, i)) return 1;
+        if (p->dropoldest && queuePop(&p->ready, &old)) {
+            // The display won't see this frame now. It is never the last
+            // frame, which the feedback still holds, since the display can't
+            // hold more than two buffers.
+            __atomic_add_fetch(&p->dropped, 1, __ATOMIC_RELAXED);
+            pipeRelease(p, old);
+        } else {
+            pipeWait();
+        }
+    }
+}
+
+/*
+ * pipeShade() - the shading thread
+ */
+static void *pipeShade(void *arg) {
+    framePipe *p = (framePipe*) arg;
+    int back;
+
+    while (pipeAcquire(p, &back)) {
+        p->frame.time = glfwGetTime();
+        p->frame.prev = p->stream->image[p->last];
+        p->frame.pixels = p->stream->image[back];
+        tilePoolRun(p->pool, p->tiles, shadeTile, &p->frame);
+
+        // One hold for the display and one for the feedback of the next
+        // frame, which replaces the hold on the last one
+        __atomic_store_n(&p->refs[back], 2, __ATOMIC_RELAXED);
+        pipeRelease(p, p->last);
+        p->last = back;
+        __atomic_add_fetch(&p->shaded, 1, __ATOMIC_RELAXED);
+        queuePush(&p->ready, back);
+    }
+    return NULL;
+}
+
+/*
+ * pipeStart() - start the shading thread. Buffer first holds the first
+ * frame, already shaded and shown, and the GL must be done with it.
+ * Returns 0 on failure.
+ */
+static int pipeStart(framePipe *p, int first) {
+    int i;
+
+    if (!queueInit(&p->ready, p->stream->count)) return 0;
+    if (!queueInit(&p->free, p->stream->count)) {
+        queueDelete(&p->ready);
+        return 0;
+    }
+    for (i = 0; i < p->stream->count; i++) {
+        p->refs[i] = i == first ? 2 : 0; // On screen, and the last frame
+        if (i != first) queuePush(&p->free, i);
+    }
+    p->last = first;
+    p->quit = 0;
+    p->shaded = p->dropped = 0;
+    if (pthread_create(&p->thread, NULL, pipeShade, p) != 0) {
+        queueDelete(&p->ready);
+        queueDelete(&p->free);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * pipeStop() - stop the shading thread, and wait for it
+ */
+static void pipeStop(framePipe *p) {
+    __atomic_store_n(&p->quit, 1, __ATOMIC_RELEASE);
+    pthread_join(p->thread, NULL);
+    queueDelete(&p->ready);
+    queueDelete(&p->free);
+}
+
 /*
  * setupViewport() - set up the OpenGL viewport to handle window resizing
  */
@@ -50,6 +362,97 @@ void setupViewport(GLFWwindow* window) {
 }
 
 
+/*
+ * wallTime() - seconds on a monotonic clock, for when there is no GLFW
+ */
+static double wallTime(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+ * renderOffline() - the headless mode, -o. Render frames first..last, at
+ * a time of dt seconds per frame, and write them out, with no window and
+ * no GL at all, for machines without a display. The two images are client
+ * memory with the alignment of the texture stream's ring, shaded into in
+ * turns like its front and back, and written from there. Messages go to
+ * stderr, since stdout may be the video.
+ */
+static int renderOffline(tilePool *pool, int size, int rate, int first, int last, double dt,
+                         const char *name) {
+    frameWriter out;
+    shadeFrame frame;
+    unsigned char *image[2];
+    size_t bytes = (size_t)size*size*4;
+    int tiles, n, back = 0, ok = 1;
+    double start, total, shading = 0.0, t;
+
+    if (!writerOpen(&out, name, size, last - first + 1, dt)) return -1;
+    image[0] = streamAllocImage(bytes);
+    image[1] = streamAllocImage(bytes);
+    if (!image[0] || !image[1]) {
+        fprintf(stderr, "Out of memory for the frames\n");
+        ok = 0;
+    }
+    frame.size = size;
+    frame.blue = out.blue;
+    frame.baseRate = rate;
+    tiles = (size + TILE_SIZE - 1) / TILE_SIZE;
+    tiles *= tiles;
+    fprintf(stderr, "Rendering frames %d to %d of %d x %d pixels, %g s apart, to %s\n",
+            first, last, size, size, dt, name);
+    fprintf(stderr, "Base noise rate: 1 in %d x %d pixels\n", rate, rate);
+
+    // Shade a first frame, so that the feedback has something to read,
+    // as the interactive mode does
+    if (ok) {
+        frame.time = first*dt;
+        frame.prev = image[1];
+        frame.pixels = image[0];
+        tilePoolRun(pool, tiles, shadeTile, &frame);
+    }
+
+    start = wallTime();
+    for (n = first; ok && n <= last; n++) {
+        frame.time = n*dt;
+        frame.prev = image[back];
+        back = 1 - back;
+        frame.pixels = image[back];
+        t = wallTime();
+        tilePoolRun(pool, tiles, shadeTile, &frame);
+        shading += wallTime() - t;
+        ok = writerFrame(&out, image[back], n);
+    }
+    total = wallTime() - start;
+
+    n -= first + !ok; // The frames that made it out
+    if (n > 0 && total > 0.0) {
+        fprintf(stderr, "Rendered %d frames in %.2f s: %.2f frames/s, %.1f Mpixels/s\n",
+                n, total, n/total, n/total*size*size*1e-6);
+        fprintf(stderr, "Shading alone:   %.2f frames/s, %.1f Mpixels/s\n",
+                n/shading, n/shading*size*size*1e-6);
+    }
+    writerClose(&out);
+    streamFreeImage(image[0]);
+    streamFreeImage(image[1]);
+    return ok ? 0 : -1;
+}
+
+// The longest time step for -dt, which keeps the y4m frame rate in a long
+#define MAX_DT 1000.0
+
+/*
+ * usage() - what the options are, on stderr
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-t threads] [-s texture size] [-rate 1|2|4|8|16]"
+            " [-bgra] [-nopbo] [-pipe | -drop] [-q depth]\n"
+            "       %s -o frame%%04d.tga|frame%%04d.ppm|video.y4m|- [-t threads] [-s size]"
+            " [-rate 1|2|4|8|16] [-frames first last] [-dt seconds]\n", program, program);
+}
+
 /*
  * main(argc, argv) - the standard C entry point for the program
  */
@@ -58,12 +461,11 @@ int main(int argc, char *argv[]) {
 	triangleSoup myShape;
     GLuint programObject; // Our single shader program
     GLuint location_tex;
-    GLuint textureID;     // Our single texture
 
 	double fps = 0.0;
     double time;
-    int i, j, k;
-    double x, y, z;
+    int i;
+    double z;
 	int red, grn, blu;
 	double point[3];
 	double F[2];
@@ -75,7 +477,84 @@ int main(int argc, char *argv[]) {
 	GLFWwindow* window;
 
  	// The software-generated texture
- 	unsigned char *pixels;
+ 	texStream pixels;
+	int streamflags = 0;
+	shadeFrame frame;
+
+	int size = IMAGE_SIZE, winsize;
+	GLint maxsize;
+
+	// The threads that shade it, one per CPU unless -t says otherwise
+	tilePool *pool;
+	int threads = 0, tiles;
+
+	// The shading rate of the base noise, 1 for every pixel
+	int rate = 1, r;
+
+	// The shading thread of the pipelined mode, and what is on screen
+	framePipe pipeline;
+	int pipelined = 0, depth = PIPE_DEPTH;
+	int shown = 0, next, frames = 0;
+
+	// The headless mode, where the frames go to files or a pipe
+	const char *output = NULL;
+	int first = 0, last = 59;
+	double dt = 1.0/60;
+	char *end;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc) size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-bgra")) streamflags |= STREAM_BGRA;
+		else if (!strcmp(argv[i], "-nopbo")) streamflags |= STREAM_NOPBO;
+		else if (!strcmp(argv[i], "-rate") && i + 1 < argc) rate = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-pipe")) pipelined = 1, pipeline.dropoldest = 0;
+		else if (!strcmp(argv[i], "-drop")) pipelined = 1, pipeline.dropoldest = 1;
+		else if (!strcmp(argv[i], "-q") && i + 1 < argc) depth = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc) output = argv[++i];
+		else if (!strcmp(argv[i], "-frames") && i + 2 < argc) {
+			first = atoi(argv[++i]);
+			last = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-dt") && i + 1 < argc) {
+			dt = strtod(argv[++i], &end);
+			if (end == argv[i] || *end) dt = 0.0; // Not a number
+		}
+		else {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (size < 1) size = IMAGE_SIZE;
+	for (r = 1; r*2 <= rate && r < MAX_RATE; r *= 2)
+		;
+	rate = r; // A power of two, so that it divides TILE_SIZE
+	if (!(dt > 0.0 && dt <= MAX_DT)) { // NaN fails this too
+		fprintf(stderr, "-dt must be a number of seconds above 0 and at most %g\n", MAX_DT);
+		usage(argv[0]);
+		return -1;
+	}
+	if (last < first) {
+		fprintf(stderr, "-frames must have the last frame no earlier than the first\n");
+		usage(argv[0]);
+		return -1;
+	}
+	if (depth < 1) depth = 1;
+	if (depth > STREAM_MAXRING - 3) depth = STREAM_MAXRING - 3;
+	pool = tilePoolCreate(threads);
+	if (!pool) {
+		fprintf(stderr, "Could not start the worker threads\n");
+		return -1;
+	}
+
+	// Without a display, there is no need for GLFW or GL
+	if (output) {
+		fprintf(stderr, "Shading threads: %d\n", tilePoolThreads(pool));
+		i = renderOffline(pool, size, rate, first, last, dt, output);
+		tilePoolDestroy(pool);
+		return i;
+	}
+	printf("Shading threads: %d\n", tilePoolThreads(pool));
 	
     // Initialise GLFW, bail out of unsuccesful
     if (!glfwInit()) return -1;
@@ -87,7 +566,9 @@ int main(int argc, char *argv[]) {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 
-    window = glfwCreateWindow(IMAGE_SIZE, IMAGE_SIZE, "Software shading demo", NULL, NULL);
+	// One window pixel per texel, unless that doesn't fit on the screen
+	winsize = size < vidmode->height*3/4 ? size : vidmode->height*3/4;
+    window = glfwCreateWindow(winsize, winsize, "Software shading demo", NULL, NULL);
     if (!window)
     {
         glfwTerminate();
@@ -121,10 +602,50 @@ int main(int argc, char *argv[]) {
 	
 	location_tex = glGetUniformLocation( programObject, "tex" );
 
-	pixels = (unsigned char*) calloc(IMAGE_SIZE*IMAGE_SIZE*4, sizeof(char));
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxsize);
+	if (size > maxsize) {
+		printf("Texture size %d is too large for GL, using %d\n", size, (int)maxsize);
+		size = maxsize;
+	}
+	printf("Texture size:    %d x %d pixels\n", size, size);
+
+	// The texture, and the ring of buffers the frames are shaded into
+	if (!streamInit(&pixels, size, pipelined ? depth + 3 : STREAM_RING, streamflags)) {
+		fprintf(stderr, "Out of memory for the texture\n");
+		return -1;
+	}
+	printf("Texture upload:  %s from %s\n", pixels.format == GL_BGRA ? "BGRA" : "RGBA",
+	       pixels.persistent ? "mapped pixel buffers" : "client memory");
+	frame.size = size;
+	frame.blue = pixels.blue;
+	frame.baseRate = rate;
+	printf("Base noise rate: 1 in %d x %d pixels\n", rate, rate);
+	tiles = (size + TILE_SIZE - 1) / TILE_SIZE;
+	tiles *= tiles;
+
+	// Shade a first frame, so that the feedback has something to read
+	frame.time = glfwGetTime();
+	frame.prev = streamFront(&pixels);
+	frame.pixels = streamBack(&pixels);
+	tilePoolRun(pool, tiles, shadeTile, &frame);
+	streamUpload(&pixels);
+
+	// From here on, the frames are shaded on their own thread if pipelined
+	if (pipelined) {
+		shown = pixels.front;
+		streamWaitImage(&pixels, shown);
+		pipeline.pool = pool;
+		pipeline.tiles = tiles;
+		pipeline.frame = frame;
+		pipeline.stream = &pixels;
+		if (!pipeStart(&pipeline, shown)) {
+			fprintf(stderr, "Could not start the shading thread\n");
+			return -1;
+		}
+		printf("Pipeline:        %d frames deep, %s\n", depth,
+		       pipeline.dropoldest ? "dropping the oldest" : "shading waits for display");
+	}
 
-    glGenTextures (1, &textureID );
-    glBindTexture ( GL_TEXTURE_2D , textureID );
     // Set parameters to determine how the texture is resized
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_MIN_FILTER , GL_LINEAR );
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_MAG_FILTER , GL_LINEAR );
@@ -152,39 +673,25 @@ int main(int argc, char *argv[]) {
 		if ( location_tex != -1 ) {
              glUniform1i ( location_tex , 0);
 		}
-	    // Regenerate all the texture data on the CPU for every frame
-	    for(i=0; i<IMAGE_SIZE; i++)
-		{
-			x = (double)i / IMAGE_SIZE;
-		    for(j=0; j<IMAGE_SIZE; j++)
-			{
-				y = (double)j / IMAGE_SIZE;
-
-				// Perlin noise
-				int base = 100+(1+sin(y*2+time))*54*(sin((20.0*y+2*time))+sin(2*(20.0*y+2*time))/4+sin(3*(20.0*y+2*time))/16);
-                base += (2+sin(time))*15*snoise3(8.0*x, 8.0*y, 0.6*time);
-                int first = 200 + 55*snoise3(30*x, 40*y, 0.6*time);
-                int second = 200 + 55*snoise3(60*x, 80*y, 0.9*time);
-                int highlight = second;
-				
-                base = base > 0 ? base : 0; 
-                float mult = base/highlight;
-                highlight = highlight*mult/mult;
-                k = (i + j*IMAGE_SIZE)*4;
-                int prevY = (i+(j-2)*IMAGE_SIZE)*4;
-                int yval = (base-pixels[prevY+2])/2;
-                int gradient = yval;
-                pixels[k] = (gradient > 0 ? highlight : 0);
-                pixels[k+1] = (gradient > 0 ? highlight : 0);
-                pixels[k+2] = base;
-				pixels[k + 3] = 255;
-
-
-		    }
-	    }
-		
-		// Upload the texture data to the GPU
-    	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, IMAGE_SIZE, IMAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		if (pipelined) {
+			// Show the oldest frame from the shading thread, waiting for one
+			// if it is busy. The one on screen until now is let go below,
+			// after the swap, when the GL should long be done with it.
+			while (!queuePop(&pipeline.ready, &next)) pipeWait();
+			streamUploadImage(&pixels, next);
+		} else {
+		    // Regenerate all the texture data on the CPU for every frame,
+		    // into the back buffer, and then make that the front buffer
+		    frame.time = time;
+		    frame.prev = streamFront(&pixels);
+		    frame.pixels = streamBack(&pixels);
+		    tilePoolRun(pool, tiles, shadeTile, &frame);
+
+			// Upload the texture data to the GPU. From mapped buffers, this
+			// only queues the copy, which then runs while we shade the next frame.
+	    	streamUpload(&pixels);
+		}
+		frames++;
 
 		// Generate mipmaps to get nice minification
 		//glGenerateMipmap(GL_TEXTURE_2D);
@@ -198,6 +705,12 @@ int main(int argc, char *argv[]) {
 		// Swap buffers, i.e. display the image and prepare for next frame.
         glfwSwapBuffers(window);
 
+		if (pipelined) {
+			streamWaitImage(&pixels, shown);
+			pipeRelease(&pipeline, shown);
+			shown = next;
+		}
+
 		glfwPollEvents();
 
         // Exit if the ESC key is pressed.
@@ -206,6 +719,16 @@ int main(int argc, char *argv[]) {
         }
     }
 
+	if (pipelined) {
+		pipeStop(&pipeline);
+		printf("Frames:          %d shaded, %d shown, %d dropped\n",
+		       pipeline.shaded, frames, pipeline.dropped);
+	}
+
+    // The texture and its buffers go with the GL context, so first
+    streamDelete(&pixels);
+    tilePoolDestroy(pool);
+
     // Close the OpenGL window and terminate GLFW.
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -15,7 +15,10 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
 #include "cellular.h"  /* Function prototype */
+#include "cpuisa.h"
 
 /* This macro is a *lot* faster than using (long)floor() on an x86 CPU.
    It actually speeds up the entire Worley() call with almost 10%.
@@ -37,20 +40,48 @@ static int Poisson_count[256]=
  2,3,3,3,2,5,2,3,3,2,0,2,1,1,4,2,1,3,2,1,2,2,3,2,5,5,3,4,5,5,2,4,4,5,3,2,2,2,1,4,
  2,3,3,4,2,5,4,2,4,2,2,2,4,5,3,2};
 
+/* The largest entry of Poisson_count */
+#define POISSON_MAX 5
+
 /* This constant is manipulated to make sure that the mean value of F[0]
    is 1.0. This makes an easy natural "scale" size of the cellular features. */
 #define DENSITY_ADJUSTMENT  0.398150
 
+/* A cache of the feature points of a box of nx*ny*nz cubes starting at
+   cube (x0,y0,z0), for Worley_grid(). The points of cube c, numbered
+   x-first from the start of the box, are first[c]..first[c+1]-1 in the
+   point arrays, which hold xi+fx etc. as computed in AddSamples(). */
+typedef struct {
+  long x0, y0, z0, nx, ny, nz;
+  long *first;
+  double *px, *py, *pz;
+  unsigned long *id;
+  long max_cubes;  /* The size the arrays are allocated for */
+} WorleyCache;
+
 /* The function to merge-sort a "cube" of samples into the current best-found
-   list of values. */
+   list of values. The points come from <cache> if it is not NULL. */
 static void AddSamples(long xi, long yi, long zi, long max_order,
 			double at[3], double *F,
-			double (*delta)[3], unsigned long *ID);
+			double (*delta)[3], unsigned long *ID,
+			const WorleyCache *cache);
+
+static void Worley_search(double at[3], long max_order,
+			  double *F, double (*delta)[3], unsigned long *ID,
+			  const WorleyCache *cache);
 
 
-/* The main function! */
 void Worley(double at[3], long max_order,                 // Input parameters
 	    double *F, double (*delta)[3], unsigned long *ID) // Output paramters
+{
+  Worley_search(at, max_order, F, delta, ID, NULL);
+}
+
+
+/* The main function! */
+static void Worley_search(double at[3], long max_order,
+			  double *F, double (*delta)[3], unsigned long *ID,
+			  const WorleyCache *cache)
 {
   double x2,y2,z2, mx2, my2, mz2;
   double new_at[3];
@@ -78,7 +109,7 @@ void Worley(double at[3], long max_order,                 // Input parameters
        long ii, jj, kk;
        for (ii=-1; ii<=1; ii++) for (jj=-1; jj<=1; jj++) for (kk=-1; kk<=1; kk++)
        AddSamples(int_at[0]+ii,int_at[1]+jj,int_at[2]+kk, 
-       max_order, new_at, F, delta, ID);
+       max_order, new_at, F, delta, ID, cache);
      }
      But this wastes a lot of time working on cubes which are known to be
      too far away to matter! So we can use a more complex testing method
@@ -86,7 +117,7 @@ void Worley(double at[3], long max_order,                 // Input parameters
      speed of the algorithm. */
 
   /* Test the central cube for closest point(s). */
-  AddSamples(int_at[0], int_at[1], int_at[2], max_order, new_at, F, delta, ID);
+  AddSamples(int_at[0], int_at[1], int_at[2], max_order, new_at, F, delta, ID, cache);
 
   /* We test if neighbor cubes are even POSSIBLE contributors by examining the
      combinations of the sum of the squared distances from the cube's lower 
@@ -104,62 +135,62 @@ void Worley(double at[3], long max_order,                 // Input parameters
   /* Test 6 facing neighbors of center cube. These are closest and most 
      likely to have a close feature point. */
   if (x2<F[max_order-1])  AddSamples(int_at[0]-1, int_at[1]  , int_at[2]  , 
-				     max_order, new_at, F, delta, ID);
+				     max_order, new_at, F, delta, ID, cache);
   if (y2<F[max_order-1])  AddSamples(int_at[0]  , int_at[1]-1, int_at[2]  , 
-				     max_order, new_at, F, delta, ID);
+				     max_order, new_at, F, delta, ID, cache);
   if (z2<F[max_order-1])  AddSamples(int_at[0]  , int_at[1]  , int_at[2]-1, 
-				     max_order, new_at, F, delta, ID);
+				     max_order, new_at, F, delta, ID, cache);
   
   if (mx2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]  , int_at[2]  , 
-				     max_order, new_at, F, delta, ID);
+				     max_order, new_at, F, delta, ID, cache);
   if (my2<F[max_order-1]) AddSamples(int_at[0]  , int_at[1]+1, int_at[2]  , 
-				     max_order, new_at, F, delta, ID);
+				     max_order, new_at, F, delta, ID, cache);
   if (mz2<F[max_order-1]) AddSamples(int_at[0]  , int_at[1]  , int_at[2]+1, 
-				     max_order, new_at, F, delta, ID);
+				     max_order, new_at, F, delta, ID, cache);
   
   /* Test 12 "edge cube" neighbors if necessary. They're next closest. */
   if ( x2+ y2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]-1, int_at[2]  , 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if ( x2+ z2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]  , int_at[2]-1, 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if ( y2+ z2<F[max_order-1]) AddSamples(int_at[0]  , int_at[1]-1, int_at[2]-1, 
-					 max_order, new_at, F, delta, ID);  
+					 max_order, new_at, F, delta, ID, cache);  
   if (mx2+my2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]+1, int_at[2]  , 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if (mx2+mz2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]  , int_at[2]+1, 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if (my2+mz2<F[max_order-1]) AddSamples(int_at[0]  , int_at[1]+1, int_at[2]+1, 
-					 max_order, new_at, F, delta, ID);  
+					 max_order, new_at, F, delta, ID, cache);  
   if ( x2+my2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]+1, int_at[2]  , 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if ( x2+mz2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]  , int_at[2]+1, 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if ( y2+mz2<F[max_order-1]) AddSamples(int_at[0]  , int_at[1]-1, int_at[2]+1, 
-					 max_order, new_at, F, delta, ID);  
+					 max_order, new_at, F, delta, ID, cache);  
   if (mx2+ y2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]-1, int_at[2]  , 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if (mx2+ z2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]  , int_at[2]-1, 
-					 max_order, new_at, F, delta, ID);
+					 max_order, new_at, F, delta, ID, cache);
   if (my2+ z2<F[max_order-1]) AddSamples(int_at[0]  , int_at[1]+1, int_at[2]-1, 
-					 max_order, new_at, F, delta, ID);  
+					 max_order, new_at, F, delta, ID, cache);  
   
   /* Final 8 "corner" cubes */
   if ( x2+ y2+ z2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]-1, int_at[2]-1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if ( x2+ y2+mz2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]-1, int_at[2]+1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if ( x2+my2+ z2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]+1, int_at[2]-1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if ( x2+my2+mz2<F[max_order-1]) AddSamples(int_at[0]-1, int_at[1]+1, int_at[2]+1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if (mx2+ y2+ z2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]-1, int_at[2]-1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if (mx2+ y2+mz2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]-1, int_at[2]+1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if (mx2+my2+ z2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]+1, int_at[2]-1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   if (mx2+my2+mz2<F[max_order-1]) AddSamples(int_at[0]+1, int_at[1]+1, int_at[2]+1, 
-					     max_order, new_at, F, delta, ID);
+					     max_order, new_at, F, delta, ID, cache);
   
   /* We're done! Convert everything to right size scale */
   for (i=0; i<max_order; i++)
@@ -175,14 +206,16 @@ void Worley(double at[3], long max_order,                 // Input parameters
 
 
 
-static void AddSamples(long xi, long yi, long zi, long max_order,
-		       double at[3], double *F,
-		       double (*delta)[3], unsigned long *ID)
+/* Compute the feature points of a cube, as xi+fx, yi+fy and zi+fz in
+   px[], py[] and pz[], and their IDs. Returns the number of points, at
+   most POISSON_MAX. */
+static long CubePoints(long xi, long yi, long zi, double *px, double *py,
+		       double *pz, unsigned long *id)
 {
-  double dx, dy, dz, fx, fy, fz, d2;
-  long count, i, j, index;
-  unsigned long seed, this_id;
-  
+  double fx, fy, fz;
+  long count, j;
+  unsigned int seed;  /* 32 bits, also where long is 64 */
+
   /* Each cube has a random number seed based on the cube's ID number.
      The seed might be better if it were a nonlinear hash like Perlin uses
      for noise but we do very well with this faster simple one.
@@ -190,13 +223,13 @@ static void AddSamples(long xi, long yi, long zi, long max_order,
   seed=702395077*xi + 915488749*yi + 2120969693*zi;
   
   /* How many feature points are in this cube? */
-  count=Poisson_count[seed>>58]; /* 256 element lookup table. Use MSB */
+  count=Poisson_count[seed>>24]; /* 256 element lookup table. Use MSB */
 
   seed=1402024253*seed+586950981; /* churn the seed with good Knuth LCG */
 
-  for (j=0; j<count; j++) /* test and insert each point into our solution */
+  for (j=0; j<count; j++)
     {
-      this_id=seed;
+      id[j]=seed;
       seed=1402024253*seed+586950981; /* churn */
 
       /* compute the 0..1 feature point location's XYZ */
@@ -207,10 +240,66 @@ static void AddSamples(long xi, long yi, long zi, long max_order,
       fz=(seed+0.5)*(1.0/4294967296.0);
       seed=1402024253*seed+586950981; /* churn */
 
-      /* delta from feature point to sample location */
-      dx=xi+fx-at[0]; 
-      dy=yi+fy-at[1];
-      dz=zi+fz-at[2];
+      px[j]=xi+fx;
+      py[j]=yi+fy;
+      pz[j]=zi+fz;
+    }
+
+  return count;
+}
+
+
+
+static void AddSamples(long xi, long yi, long zi, long max_order,
+		       double at[3], double *F,
+		       double (*delta)[3], unsigned long *ID,
+		       const WorleyCache *cache)
+{
+  double dx, dy, dz, fx, fy, fz, d2;
+  long count, i, j, index, first=0;
+  unsigned long this_id;
+  unsigned int seed=0;
+
+  /* Take the points from the cache, or generate them as CubePoints()
+     does. Generating them here is faster than going through arrays. */
+  if (cache)
+    {
+      long c=(xi-cache->x0)+cache->nx*((yi-cache->y0)+cache->ny*(zi-cache->z0));
+      first=cache->first[c];
+      count=cache->first[c+1]-first;
+    }
+  else
+    {
+      seed=702395077*xi + 915488749*yi + 2120969693*zi;
+      count=Poisson_count[seed>>24];
+      seed=1402024253*seed+586950981;
+    }
+
+  for (j=0; j<count; j++) /* test and insert each point into our solution */
+    {
+      if (cache)
+	{
+	  this_id=cache->id[first+j];
+	  dx=cache->px[first+j]-at[0];
+	  dy=cache->py[first+j]-at[1];
+	  dz=cache->pz[first+j]-at[2];
+	}
+      else
+	{
+	  this_id=seed;
+	  seed=1402024253*seed+586950981;
+	  fx=(seed+0.5)*(1.0/4294967296.0);
+	  seed=1402024253*seed+586950981;
+	  fy=(seed+0.5)*(1.0/4294967296.0);
+	  seed=1402024253*seed+586950981;
+	  fz=(seed+0.5)*(1.0/4294967296.0);
+	  seed=1402024253*seed+586950981;
+
+	  /* delta from feature point to sample location */
+	  dx=xi+fx-at[0];
+	  dy=yi+fy-at[1];
+	  dz=zi+fz-at[2];
+	}
       
       /* Distance computation!  Lots of interesting variations are
 	 possible here!
@@ -262,3 +351,1377 @@ static void AddSamples(long xi, long yi, long zi, long max_order,
   
   return;
 }
+
+
+
+/* Worley2() and Worley2_batch(), the 2D versions in single precision.
+   Added for the 2D uses of the cellular basis, flagstones and the like.
+   The search is the same as in Worley() above, but a square only has 4
+   facing and 4 corner neighbors, so at most 9 squares are visited
+   instead of 27. The seeds are 32 bits wide on all platforms, and the
+   feature point locations take the top 24 bits of a seed, which is all
+   a float can hold. */
+
+/* Like LFLOOR(), for float to int */
+#define IFLOOR(x) ( ((x)<(int)(x)) ? ((int)(x)-1) : ((int)(x)) )
+
+/* Like DENSITY_ADJUSTMENT, but for the mean value of F[0] to be 1.0 with
+   the same Poisson_count table in 2D. Measured over 10^7 random points.
+   This is a float constant, so that the SIMD kernels scale the sample
+   point exactly the same as the scalar code. */
+#define DENSITY_ADJUSTMENT_2D  0.294929f
+
+/* The seed hash and the LCG of AddSamples(), in 32 bits */
+#define SEED2(xi, yi) (702395077u*(unsigned int)(xi) + 915488749u*(unsigned int)(yi))
+#define CHURN(seed) (1402024253u*(seed)+586950981u)
+
+/* A feature point coordinate in 0..1 from the top 24 bits of a seed */
+#define SEED_TO_UNIT(seed) (((float)((seed)>>8)+0.5f)*(1.0f/16777216.0f))
+
+/* Like WorleyCache, for squares */
+typedef struct {
+  int x0, y0, nx, ny;
+  int *first;
+  float *px, *py;
+  unsigned int *id;
+  int max_squares;
+} Worley2Cache;
+
+static void AddSamples2(int xi, int yi, int max_order,
+			float at[2], float *F,
+			float (*delta)[2], unsigned int *ID,
+			const Worley2Cache *cache);
+
+static void Worley2_search(float at[2], int max_order,
+			   float *F, float (*delta)[2], unsigned int *ID,
+			   const Worley2Cache *cache);
+
+
+void Worley2(float at[2], int max_order,
+	     float *F, float (*delta)[2], unsigned int *ID)
+{
+  Worley2_search(at, max_order, F, delta, ID, NULL);
+}
+
+
+static void Worley2_search(float at[2], int max_order,
+			   float *F, float (*delta)[2], unsigned int *ID,
+			   const Worley2Cache *cache)
+{
+  float x2,y2, mx2, my2;
+  float new_at[2];
+  int int_at[2], i;
+
+  for (i=0; i<max_order; i++) F[i]=999999.9f;
+
+  new_at[0]=DENSITY_ADJUSTMENT_2D*at[0];
+  new_at[1]=DENSITY_ADJUSTMENT_2D*at[1];
+
+  int_at[0]=IFLOOR(new_at[0]);
+  int_at[1]=IFLOOR(new_at[1]);
+
+  /* The central square, then the neighbors that could be close enough,
+     in the same order as in Worley(). */
+  AddSamples2(int_at[0], int_at[1], max_order, new_at, F, delta, ID, cache);
+
+  x2=new_at[0]-int_at[0];
+  y2=new_at[1]-int_at[1];
+  mx2=(1.0f-x2)*(1.0f-x2);
+  my2=(1.0f-y2)*(1.0f-y2);
+  x2*=x2;
+  y2*=y2;
+
+  /* 4 facing neighbors */
+  if (x2<F[max_order-1])  AddSamples2(int_at[0]-1, int_at[1]  ,
+				      max_order, new_at, F, delta, ID, cache);
+  if (y2<F[max_order-1])  AddSamples2(int_at[0]  , int_at[1]-1,
+				      max_order, new_at, F, delta, ID, cache);
+  if (mx2<F[max_order-1]) AddSamples2(int_at[0]+1, int_at[1]  ,
+				      max_order, new_at, F, delta, ID, cache);
+  if (my2<F[max_order-1]) AddSamples2(int_at[0]  , int_at[1]+1,
+				      max_order, new_at, F, delta, ID, cache);
+
+  /* 4 corner neighbors */
+  if ( x2+ y2<F[max_order-1]) AddSamples2(int_at[0]-1, int_at[1]-1,
+					  max_order, new_at, F, delta, ID, cache);
+  if ( x2+my2<F[max_order-1]) AddSamples2(int_at[0]-1, int_at[1]+1,
+					  max_order, new_at, F, delta, ID, cache);
+  if (mx2+ y2<F[max_order-1]) AddSamples2(int_at[0]+1, int_at[1]-1,
+					  max_order, new_at, F, delta, ID, cache);
+  if (mx2+my2<F[max_order-1]) AddSamples2(int_at[0]+1, int_at[1]+1,
+					  max_order, new_at, F, delta, ID, cache);
+
+  for (i=0; i<max_order; i++)
+    {
+      F[i]=sqrtf(F[i])*(1.0f/DENSITY_ADJUSTMENT_2D);
+      delta[i][0]*=(1.0f/DENSITY_ADJUSTMENT_2D);
+      delta[i][1]*=(1.0f/DENSITY_ADJUSTMENT_2D);
+    }
+
+  return;
+}
+
+
+
+/* Like CubePoints(), for a square */
+static int SquarePoints(int xi, int yi, float *px, float *py, unsigned int *id)
+{
+  int count, j;
+  unsigned int seed;
+
+  seed=SEED2(xi, yi);
+  count=Poisson_count[seed>>24];
+  seed=CHURN(seed);
+
+  for (j=0; j<count; j++)
+    {
+      id[j]=seed;
+      seed=CHURN(seed);
+      px[j]=(float)xi+SEED_TO_UNIT(seed);
+      seed=CHURN(seed);
+      py[j]=(float)yi+SEED_TO_UNIT(seed);
+      seed=CHURN(seed);
+    }
+
+  return count;
+}
+
+
+
+static void AddSamples2(int xi, int yi, int max_order,
+			float at[2], float *F,
+			float (*delta)[2], unsigned int *ID,
+			const Worley2Cache *cache)
+{
+  float dx, dy, d2;
+  int count, i, j, index, first=0;
+  unsigned int seed=0, this_id;
+
+  /* Take the points from the cache, or generate them as SquarePoints()
+     does. Generating them here is faster than going through arrays. */
+  if (cache)
+    {
+      int c=(xi-cache->x0)+cache->nx*(yi-cache->y0);
+      first=cache->first[c];
+      count=cache->first[c+1]-first;
+    }
+  else
+    {
+      seed=SEED2(xi, yi);
+      count=Poisson_count[seed>>24];
+      seed=CHURN(seed);
+    }
+
+  for (j=0; j<count; j++)
+    {
+      if (cache)
+	{
+	  this_id=cache->id[first+j];
+	  dx=cache->px[first+j]-at[0];
+	  dy=cache->py[first+j]-at[1];
+	}
+      else
+	{
+	  this_id=seed;
+	  seed=CHURN(seed);
+	  dx=((float)xi+SEED_TO_UNIT(seed))-at[0];
+	  seed=CHURN(seed);
+	  dy=((float)yi+SEED_TO_UNIT(seed))-at[1];
+	  seed=CHURN(seed);
+	}
+
+      d2=dx*dx+dy*dy;
+
+      if (d2<F[max_order-1])
+	{
+	  /* Insertion sort, as in AddSamples() */
+	  index=max_order;
+	  while (index>0 && d2<F[index-1]) index--;
+
+	  for (i=max_order-2; i>=index; i--)
+	    {
+	      F[i+1]=F[i];
+	      ID[i+1]=ID[i];
+	      delta[i+1][0]=delta[i][0];
+	      delta[i+1][1]=delta[i][1];
+	    }
+	  F[index]=d2;
+	  ID[index]=this_id;
+	  delta[index][0]=dx;
+	  delta[index][1]=dy;
+	}
+    }
+
+  return;
+}
+
+
+
+/* Worley2_batch(), with SIMD kernels for SSE2, AVX2 and AVX-512 compiled
+   from cellularsimd.h, and the widest one the CPU supports picked at
+   run time. Elsewhere, this loops over Worley2(). */
+
+/* The squares visited by Worley2(), in order, for the SIMD kernels */
+static const int Worley2_squares[9][2]=
+{{0,0}, {-1,0}, {0,-1}, {1,0}, {0,1}, {-1,-1}, {-1,1}, {1,-1}, {1,1}};
+
+#ifdef CPUISA_X86
+
+#define SIMD_ISA ISA_SSE2
+#include "simdlanes.h"
+#include "cellularsimd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX2
+#include "simdlanes.h"
+#include "cellularsimd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX512
+#include "simdlanes.h"
+#include "cellularsimd.h"
+#undef SIMD_ISA
+
+#endif /* CPUISA_X86 */
+
+/* The widest SIMD vector we have a kernel for */
+#define WORLEY2_MAXW 16
+
+typedef void (*worley2_fn)(const float *x, const float *y, int max_order,
+			   float *F, float *dx, float *dy,
+			   unsigned int *ID, int stride);
+
+/* Select the kernel for the best instruction set the CPU supports,
+   and return its width in lanes, or 0 if there is no SIMD kernel. */
+static int worley2_kernel(worley2_fn *k)
+{
+#ifdef CPUISA_X86
+  switch (cpu_isa())
+    {
+    case ISA_AVX512:
+      *k=worley2_block_avx512;
+      return 16;
+    case ISA_AVX2:
+      *k=worley2_block_avx2;
+      return 8;
+    case ISA_SSE41:
+    case ISA_SSE2:
+      *k=worley2_block_sse2;
+      return 4;
+    }
+#endif
+  *k=0;
+  return 0;
+}
+
+
+void Worley2_batch(const float *x, const float *y, int n, int max_order,
+		   float *F, float *dx, float *dy, unsigned int *ID)
+{
+  worley2_fn kernel;
+  int w=worley2_kernel(&kernel);
+  int i=0, j, k;
+
+  if (max_order<1 || max_order>WORLEY2_MAX_ORDER) return;
+
+  if (w)
+    {
+      float tx[WORLEY2_MAXW]={0.0f}, ty[WORLEY2_MAXW]={0.0f};
+      float tF[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      float tdx[WORLEY2_MAX_ORDER*WORLEY2_MAXW], tdy[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      unsigned int tID[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+
+      for (; i+w<=n; i+=w)
+	kernel(x+i, y+i, max_order, F+i, dx ? dx+i : 0, dy ? dy+i : 0,
+	       ID ? ID+i : 0, n);
+      if (i<n)
+	{
+	  for (j=0; i+j<n; j++) { tx[j]=x[i+j]; ty[j]=y[i+j]; }
+	  kernel(tx, ty, max_order, tF, tdx, tdy, tID, WORLEY2_MAXW);
+	  for (k=0; k<max_order; k++)
+	    for (j=0; i+j<n; j++)
+	      {
+		F[k*n+i+j]=tF[k*WORLEY2_MAXW+j];
+		if (dx) dx[k*n+i+j]=tdx[k*WORLEY2_MAXW+j];
+		if (dy) dy[k*n+i+j]=tdy[k*WORLEY2_MAXW+j];
+		if (ID) ID[k*n+i+j]=tID[k*WORLEY2_MAXW+j];
+	      }
+	}
+      return;
+    }
+
+  for (; i<n; i++)
+    {
+      float at[2], pF[WORLEY2_MAX_ORDER], pdelta[WORLEY2_MAX_ORDER][2];
+      unsigned int pID[WORLEY2_MAX_ORDER];
+
+      at[0]=x[i];
+      at[1]=y[i];
+      Worley2(at, max_order, pF, pdelta, pID);
+      for (k=0; k<max_order; k++)
+	{
+	  F[k*n+i]=pF[k];
+	  if (dx) dx[k*n+i]=pdelta[k][0];
+	  if (dy) dy[k*n+i]=pdelta[k][1];
+	  if (ID) ID[k*n+i]=pID[k];
+	}
+    }
+}
+
+
+
+/* Worley_grid() and Worley2_grid(). The image is done in tiles of
+   GRID_TILE x GRID_TILE pixels. The feature points of every cube that
+   the pixels of a tile can reach are computed once into a cache, and
+   then each pixel of the tile is searched exactly as in Worley() or
+   Worley2(), only with the points read from the cache. The results are
+   the same as from calling Worley() or Worley2() for each pixel. */
+
+#define GRID_TILE 32
+
+/* A tile is only cached if it reaches at most this many cubes per pixel.
+   With more, most of the cached points would never be looked at. */
+#define GRID_MAX_CUBES_PER_PIXEL 2
+
+/* Make room in a cache for <cubes> cubes. Returns 0 if out of memory. */
+static int WorleyCacheReserve(WorleyCache *cache, long cubes)
+{
+  if (cubes<=cache->max_cubes) return 1;
+  free(cache->first);
+  free(cache->px);
+  free(cache->py);
+  free(cache->pz);
+  free(cache->id);
+  cache->first=malloc((cubes+1)*sizeof(long));
+  cache->px=malloc(cubes*POISSON_MAX*sizeof(double));
+  cache->py=malloc(cubes*POISSON_MAX*sizeof(double));
+  cache->pz=malloc(cubes*POISSON_MAX*sizeof(double));
+  cache->id=malloc(cubes*POISSON_MAX*sizeof(unsigned long));
+  cache->max_cubes=cubes;
+  if (cache->first && cache->px && cache->py && cache->pz && cache->id)
+    return 1;
+  free(cache->first);
+  free(cache->px);
+  free(cache->py);
+  free(cache->pz);
+  free(cache->id);
+  cache->first=NULL;
+  cache->px=cache->py=cache->pz=NULL;
+  cache->id=NULL;
+  cache->max_cubes=0;
+  return 0;
+}
+
+/* Compute the points of all cubes in the box of the cache */
+static void WorleyCacheFill(WorleyCache *cache)
+{
+  long xi, yi, zi, c=0, n=0;
+
+  for (zi=cache->z0; zi<cache->z0+cache->nz; zi++)
+    for (yi=cache->y0; yi<cache->y0+cache->ny; yi++)
+      for (xi=cache->x0; xi<cache->x0+cache->nx; xi++)
+	{
+	  cache->first[c++]=n;
+	  n+=CubePoints(xi, yi, zi, cache->px+n, cache->py+n, cache->pz+n,
+			cache->id+n);
+	}
+  cache->first[c]=n;
+}
+
+
+void Worley_grid(double x0, double y0, double z, double dx, double dy,
+		 int nx, int ny, long max_order,
+		 double *F, double (*delta)[3], unsigned long *ID)
+{
+  WorleyCache cache={0};
+  int ti, tj, i, j, i1, j1, use_cache;
+  long a, b;
+  double at[3];
+
+  for (tj=0; tj<ny; tj+=GRID_TILE)
+    for (ti=0; ti<nx; ti+=GRID_TILE)
+      {
+	i1=ti+GRID_TILE<nx ? ti+GRID_TILE : nx;
+	j1=tj+GRID_TILE<ny ? tj+GRID_TILE : ny;
+
+	/* The cubes the pixels of the tile are in, the same way Worley()
+	   finds them, and their neighbors */
+	a=LFLOOR(DENSITY_ADJUSTMENT*(x0+ti*dx));
+	b=LFLOOR(DENSITY_ADJUSTMENT*(x0+(i1-1)*dx));
+	cache.x0=(a<b ? a : b)-1;
+	cache.nx=(a<b ? b-a : a-b)+3;
+	a=LFLOOR(DENSITY_ADJUSTMENT*(y0+tj*dy));
+	b=LFLOOR(DENSITY_ADJUSTMENT*(y0+(j1-1)*dy));
+	cache.y0=(a<b ? a : b)-1;
+	cache.ny=(a<b ? b-a : a-b)+3;
+	cache.z0=LFLOOR(DENSITY_ADJUSTMENT*z)-1;
+	cache.nz=3;
+
+	use_cache=cache.nx*cache.ny*cache.nz
+	  <= GRID_MAX_CUBES_PER_PIXEL*(long)(i1-ti)*(j1-tj)
+	  && WorleyCacheReserve(&cache, cache.nx*cache.ny*cache.nz);
+	if (use_cache) WorleyCacheFill(&cache);
+
+	for (j=tj; j<j1; j++)
+	  for (i=ti; i<i1; i++)
+	    {
+	      long p=((long)j*nx+i)*max_order;
+	      at[0]=x0+i*dx;
+	      at[1]=y0+j*dy;
+	      at[2]=z;
+	      Worley_search(at, max_order, F+p, delta+p, ID+p,
+			    use_cache ? &cache : NULL);
+	    }
+      }
+
+  free(cache.first);
+  free(cache.px);
+  free(cache.py);
+  free(cache.pz);
+  free(cache.id);
+}
+
+
+/* Like WorleyCacheReserve() */
+static int Worley2CacheReserve(Worley2Cache *cache, int squares)
+{
+  if (squares<=cache->max_squares) return 1;
+  free(cache->first);
+  free(cache->px);
+  free(cache->py);
+  free(cache->id);
+  cache->first=malloc((squares+1)*sizeof(int));
+  cache->px=malloc(squares*POISSON_MAX*sizeof(float));
+  cache->py=malloc(squares*POISSON_MAX*sizeof(float));
+  cache->id=malloc(squares*POISSON_MAX*sizeof(unsigned int));
+  cache->max_squares=squares;
+  if (cache->first && cache->px && cache->py && cache->id)
+    return 1;
+  free(cache->first);
+  free(cache->px);
+  free(cache->py);
+  free(cache->id);
+  cache->first=NULL;
+  cache->px=cache->py=NULL;
+  cache->id=NULL;
+  cache->max_squares=0;
+  return 0;
+}
+
+/* Like WorleyCacheFill() */
+static void Worley2CacheFill(Worley2Cache *cache)
+{
+  int xi, yi, c=0, n=0;
+
+  for (yi=cache->y0; yi<cache->y0+cache->ny; yi++)
+    for (xi=cache->x0; xi<cache->x0+cache->nx; xi++)
+      {
+	cache->first[c++]=n;
+	n+=SquarePoints(xi, yi, cache->px+n, cache->py+n, cache->id+n);
+      }
+  cache->first[c]=n;
+}
+
+
+void Worley2_grid(float x0, float y0, float dx, float dy,
+		  int nx, int ny, int max_order,
+		  float *F, float (*delta)[2], unsigned int *ID)
+{
+  Worley2Cache cache={0};
+  int ti, tj, i, j, i1, j1, a, b, use_cache;
+  float at[2];
+
+  for (tj=0; tj<ny; tj+=GRID_TILE)
+    for (ti=0; ti<nx; ti+=GRID_TILE)
+      {
+	i1=ti+GRID_TILE<nx ? ti+GRID_TILE : nx;
+	j1=tj+GRID_TILE<ny ? tj+GRID_TILE : ny;
+
+	a=IFLOOR(DENSITY_ADJUSTMENT_2D*(x0+ti*dx));
+	b=IFLOOR(DENSITY_ADJUSTMENT_2D*(x0+(i1-1)*dx));
+	cache.x0=(a<b ? a : b)-1;
+	cache.nx=(a<b ? b-a : a-b)+3;
+	a=IFLOOR(DENSITY_ADJUSTMENT_2D*(y0+tj*dy));
+	b=IFLOOR(DENSITY_ADJUSTMENT_2D*(y0+(j1-1)*dy));
+	cache.y0=(a<b ? a : b)-1;
+	cache.ny=(a<b ? b-a : a-b)+3;
+
+	use_cache=(long)cache.nx*cache.ny
+	  <= GRID_MAX_CUBES_PER_PIXEL*(long)(i1-ti)*(j1-tj)
+	  && Worley2CacheReserve(&cache, cache.nx*cache.ny);
+	if (use_cache) Worley2CacheFill(&cache);
+
+	for (j=tj; j<j1; j++)
+	  for (i=ti; i<i1; i++)
+	    {
+	      long p=((long)j*nx+i)*max_order;
+	      at[0]=x0+i*dx;
+	      at[1]=y0+j*dy;
+	      Worley2_search(at, max_order, F+p, delta+p, ID+p,
+			     use_cache ? &cache : NULL);
+	    }
+      }
+
+  free(cache.first);
+  free(cache.px);
+  free(cache.py);
+  free(cache.id);
+}
+
+
+
+/* WorleyN() and Worley2N(), for high orders. Worley() only looks at the
+   cube of the sample point and its 26 neighbors, which is enough for
+   F_1..F_4 but not always for the higher ones. Here the cubes are
+   visited in rings around the central one, 1, 2, 3.. cubes out, and a
+   ring is only started if its nearest face is closer than the current
+   F_n. Within a ring, each cube is skipped unless its nearest point is
+   closer than F_n. The n closest points found so far are kept in a max
+   heap in F[], delta[] and ID[], with F_n at the top, so that a point
+   costs O(log n) instead of O(n) to insert, and the heap is sorted when
+   the search is done. */
+
+/* The distance from a sample point with fractional position <f> in its
+   cube to the nearest face of the cube <o> cubes away along an axis */
+#define RING_GAP(f, o) ((o)<0 ? (f)-(o)-1 : (o)>0 ? (o)-(f) : 0)
+
+/* The central cube and its neighbors in the order Worley() tests them,
+   which is nearest first when mirrored to the side the sample point is
+   closest to */
+static const int Worley_cubes[27][3]=
+{{0,0,0},
+ {-1,0,0}, {0,-1,0}, {0,0,-1}, {1,0,0}, {0,1,0}, {0,0,1},
+ {-1,-1,0}, {-1,0,-1}, {0,-1,-1}, {1,1,0}, {1,0,1}, {0,1,1},
+ {-1,1,0}, {-1,0,1}, {0,-1,1}, {1,-1,0}, {1,0,-1}, {0,1,-1},
+ {-1,-1,-1}, {-1,-1,1}, {-1,1,-1}, {-1,1,1},
+ {1,-1,-1}, {1,-1,1}, {1,1,-1}, {1,1,1}};
+
+/* Restore the heap property below element <i> of a heap of <n> elements */
+static void HeapDown(long i, long n, double *F, double (*delta)[3],
+		     unsigned long *ID)
+{
+  double f=F[i], d0=delta[i][0], d1=delta[i][1], d2=delta[i][2];
+  unsigned long id=ID[i];
+  long c;
+
+  while ((c=2*i+1)<n)
+    {
+      if (c+1<n && F[c+1]>F[c]) c++;
+      if (F[c]<=f) break;
+      F[i]=F[c];
+      ID[i]=ID[c];
+      delta[i][0]=delta[c][0];
+      delta[i][1]=delta[c][1];
+      delta[i][2]=delta[c][2];
+      i=c;
+    }
+  F[i]=f;
+  ID[i]=id;
+  delta[i][0]=d0;
+  delta[i][1]=d1;
+  delta[i][2]=d2;
+}
+
+/* Test the points of a cube, keeping the <max_order> closest in the heap
+   of <*n> elements */
+static void AddSamplesHeap(long xi, long yi, long zi, long max_order,
+			   double at[3], long *n, double *F,
+			   double (*delta)[3], unsigned long *ID)
+{
+  double dx, dy, dz, d2;
+  long count, i, j, p;
+  unsigned int seed, this_id;
+
+  /* The points of CubePoints(), generated in place as in AddSamples() */
+  seed=702395077*xi + 915488749*yi + 2120969693*zi;
+  count=Poisson_count[seed>>24];
+  seed=1402024253*seed+586950981;
+
+  for (j=0; j<count; j++)
+    {
+      this_id=seed;
+      seed=1402024253*seed+586950981;
+      dx=xi+(seed+0.5)*(1.0/4294967296.0)-at[0];
+      seed=1402024253*seed+586950981;
+      dy=yi+(seed+0.5)*(1.0/4294967296.0)-at[1];
+      seed=1402024253*seed+586950981;
+      dz=zi+(seed+0.5)*(1.0/4294967296.0)-at[2];
+      seed=1402024253*seed+586950981;
+      d2=dx*dx+dy*dy+dz*dz;
+
+      if (*n<max_order)
+	{
+	  /* Not full yet, sift the point up from the bottom */
+	  for (i=(*n)++; i>0 && F[p=(i-1)/2]<d2; i=p)
+	    {
+	      F[i]=F[p];
+	      ID[i]=ID[p];
+	      delta[i][0]=delta[p][0];
+	      delta[i][1]=delta[p][1];
+	      delta[i][2]=delta[p][2];
+	    }
+	}
+      else if (d2<F[0])
+	i=0;  /* Replaces the farthest one, sifted down below */
+      else
+	continue;
+
+      F[i]=d2;
+      ID[i]=this_id;
+      delta[i][0]=dx;
+      delta[i][1]=dy;
+      delta[i][2]=dz;
+      if (*n==max_order && i==0) HeapDown(0, max_order, F, delta, ID);
+    }
+}
+
+
+void WorleyN(double at[3], long max_order,
+	     double *F, double (*delta)[3], unsigned long *ID)
+{
+  double new_at[3], f[3], g, gx, gy, gz, t;
+  long int_at[3], n=0, r, ox, oy, oz, step, i, c, flip[3];
+  unsigned long tid;
+
+  new_at[0]=DENSITY_ADJUSTMENT*at[0];
+  new_at[1]=DENSITY_ADJUSTMENT*at[1];
+  new_at[2]=DENSITY_ADJUSTMENT*at[2];
+  for (i=0; i<3; i++)
+    {
+      int_at[i]=LFLOOR(new_at[i]);
+      f[i]=new_at[i]-int_at[i];
+    }
+
+  /* The nearest face of ring r is this far plus r-1 */
+  g=f[0]<1.0-f[0] ? f[0] : 1.0-f[0];
+  for (i=1; i<3; i++)
+    {
+      if (f[i]<g) g=f[i];
+      if (1.0-f[i]<g) g=1.0-f[i];
+    }
+
+  /* The central cube and ring 1, nearest first */
+  for (i=0; i<3; i++) flip[i]=f[i]<0.5 ? 1 : -1;
+  for (c=0; c<27; c++)
+    {
+      ox=flip[0]*Worley_cubes[c][0];
+      oy=flip[1]*Worley_cubes[c][1];
+      oz=flip[2]*Worley_cubes[c][2];
+      if (n==max_order)
+	{
+	  gx=RING_GAP(f[0], ox);
+	  gy=RING_GAP(f[1], oy);
+	  gz=RING_GAP(f[2], oz);
+	  if (gx*gx+gy*gy+gz*gz>=F[0]) continue;
+	}
+      AddSamplesHeap(int_at[0]+ox, int_at[1]+oy, int_at[2]+oz,
+		     max_order, new_at, &n, F, delta, ID);
+    }
+
+  /* Further rings, only for high orders */
+  for (r=2; n<max_order || (g+r-1)*(g+r-1)<F[0]; r++)
+    for (ox=-r; ox<=r; ox++)
+      {
+	gx=RING_GAP(f[0], ox);
+	gx*=gx;
+	if (n==max_order && gx>=F[0]) continue;
+	for (oy=-r; oy<=r; oy++)
+	  {
+	    gy=RING_GAP(f[1], oy);
+	    gy=gx+gy*gy;
+	    if (n==max_order && gy>=F[0]) continue;
+	    /* Only the two end cubes of a z column inside the ring */
+	    step=(ox==-r || ox==r || oy==-r || oy==r) ? 1 : 2*r;
+	    for (oz=-r; oz<=r; oz+=step)
+	      {
+		gz=RING_GAP(f[2], oz);
+		if (n==max_order && gy+gz*gz>=F[0]) continue;
+		AddSamplesHeap(int_at[0]+ox, int_at[1]+oy, int_at[2]+oz,
+			       max_order, new_at, &n, F, delta, ID);
+	      }
+	  }
+      }
+
+  /* Heap sort, the farthest goes to the end first */
+  for (i=max_order-1; i>0; i--)
+    {
+      t=F[0]; F[0]=F[i]; F[i]=t;
+      tid=ID[0]; ID[0]=ID[i]; ID[i]=tid;
+      t=delta[0][0]; delta[0][0]=delta[i][0]; delta[i][0]=t;
+      t=delta[0][1]; delta[0][1]=delta[i][1]; delta[i][1]=t;
+      t=delta[0][2]; delta[0][2]=delta[i][2]; delta[i][2]=t;
+      HeapDown(0, i, F, delta, ID);
+    }
+
+  for (i=0; i<max_order; i++)
+    {
+      F[i]=sqrt(F[i])*(1.0/DENSITY_ADJUSTMENT);
+      delta[i][0]*=(1.0/DENSITY_ADJUSTMENT);
+      delta[i][1]*=(1.0/DENSITY_ADJUSTMENT);
+      delta[i][2]*=(1.0/DENSITY_ADJUSTMENT);
+    }
+}
+
+
+/* Like HeapDown(), in 2D */
+static void HeapDown2(int i, int n, float *F, float (*delta)[2],
+		      unsigned int *ID)
+{
+  float f=F[i], d0=delta[i][0], d1=delta[i][1];
+  unsigned int id=ID[i];
+  int c;
+
+  while ((c=2*i+1)<n)
+    {
+      if (c+1<n && F[c+1]>F[c]) c++;
+      if (F[c]<=f) break;
+      F[i]=F[c];
+      ID[i]=ID[c];
+      delta[i][0]=delta[c][0];
+      delta[i][1]=delta[c][1];
+      i=c;
+    }
+  F[i]=f;
+  ID[i]=id;
+  delta[i][0]=d0;
+  delta[i][1]=d1;
+}
+
+/* Like AddSamplesHeap(), for a square */
+static void AddSamplesHeap2(int xi, int yi, int max_order,
+			    float at[2], int *n, float *F,
+			    float (*delta)[2], unsigned int *ID)
+{
+  float dx, dy, d2;
+  int count, i, j, p;
+  unsigned int seed, this_id;
+
+  seed=SEED2(xi, yi);
+  count=Poisson_count[seed>>24];
+  seed=CHURN(seed);
+
+  for (j=0; j<count; j++)
+    {
+      this_id=seed;
+      seed=CHURN(seed);
+      dx=((float)xi+SEED_TO_UNIT(seed))-at[0];
+      seed=CHURN(seed);
+      dy=((float)yi+SEED_TO_UNIT(seed))-at[1];
+      seed=CHURN(seed);
+      d2=dx*dx+dy*dy;
+
+      if (*n<max_order)
+	{
+	  for (i=(*n)++; i>0 && F[p=(i-1)/2]<d2; i=p)
+	    {
+	      F[i]=F[p];
+	      ID[i]=ID[p];
+	      delta[i][0]=delta[p][0];
+	      delta[i][1]=delta[p][1];
+	    }
+	}
+      else if (d2<F[0])
+	i=0;
+      else
+	continue;
+
+      F[i]=d2;
+      ID[i]=this_id;
+      delta[i][0]=dx;
+      delta[i][1]=dy;
+      if (*n==max_order && i==0) HeapDown2(0, max_order, F, delta, ID);
+    }
+}
+
+
+void Worley2N(float at[2], int max_order,
+	      float *F, float (*delta)[2], unsigned int *ID)
+{
+  float new_at[2], f[2], g, gx, gy, t;
+  int int_at[2], n=0, r, ox, oy, step, i, c, flip[2];
+  unsigned int tid;
+
+  new_at[0]=DENSITY_ADJUSTMENT_2D*at[0];
+  new_at[1]=DENSITY_ADJUSTMENT_2D*at[1];
+  for (i=0; i<2; i++)
+    {
+      int_at[i]=IFLOOR(new_at[i]);
+      f[i]=new_at[i]-int_at[i];
+    }
+
+  g=f[0]<1.0f-f[0] ? f[0] : 1.0f-f[0];
+  if (f[1]<g) g=f[1];
+  if (1.0f-f[1]<g) g=1.0f-f[1];
+
+  for (i=0; i<2; i++) flip[i]=f[i]<0.5f ? 1 : -1;
+  for (c=0; c<9; c++)
+    {
+      ox=flip[0]*Worley2_squares[c][0];
+      oy=flip[1]*Worley2_squares[c][1];
+      if (n==max_order)
+	{
+	  gx=RING_GAP(f[0], ox);
+	  gy=RING_GAP(f[1], oy);
+	  if (gx*gx+gy*gy>=F[0]) continue;
+	}
+      AddSamplesHeap2(int_at[0]+ox, int_at[1]+oy,
+		      max_order, new_at, &n, F, delta, ID);
+    }
+
+  for (r=2; n<max_order || (g+r-1)*(g+r-1)<F[0]; r++)
+    for (ox=-r; ox<=r; ox++)
+      {
+	gx=RING_GAP(f[0], ox);
+	gx*=gx;
+	if (n==max_order && gx>=F[0]) continue;
+	step=(ox==-r || ox==r) ? 1 : 2*r;
+	for (oy=-r; oy<=r; oy+=step)
+	  {
+	    gy=RING_GAP(f[1], oy);
+	    if (n==max_order && gx+gy*gy>=F[0]) continue;
+	    AddSamplesHeap2(int_at[0]+ox, int_at[1]+oy,
+			    max_order, new_at, &n, F, delta, ID);
+	  }
+      }
+
+  for (i=max_order-1; i>0; i--)
+    {
+      t=F[0]; F[0]=F[i]; F[i]=t;
+      tid=ID[0]; ID[0]=ID[i]; ID[i]=tid;
+      t=delta[0][0]; delta[0][0]=delta[i][0]; delta[i][0]=t;
+      t=delta[0][1]; delta[0][1]=delta[i][1]; delta[i][1]=t;
+      HeapDown2(0, i, F, delta, ID);
+    }
+
+  for (i=0; i<max_order; i++)
+    {
+      F[i]=sqrtf(F[i])*(1.0f/DENSITY_ADJUSTMENT_2D);
+      delta[i][0]*=(1.0f/DENSITY_ADJUSTMENT_2D);
+      delta[i][1]*=(1.0f/DENSITY_ADJUSTMENT_2D);
+    }
+}
+
+
+
+/* Worley_anim() and Worley2_anim(). Each feature point moves around its
+   place in Worley() on an ellipse, one or two turns per unit of time.
+   The ellipse comes from a hash of the point's ID, so no more random
+   numbers are drawn and the points are where Worley() has them when
+   the amplitude is 0. Moving the points keeps their density, so the
+   mean F_1 stays close to 1.0, within about 1% at the full amplitude.
+   A point moves at most <amp> cubes along each axis, so the bound for
+   each neighbor cube is <amp> closer. Like Worley(), only the nearest
+   27 cubes are searched, which very rarely misses a point. */
+
+/* The motion of the points at a time t: the amplitude in cubes, and
+   cos and sin of 2*pi*t and 4*pi*t for the two speeds */
+typedef struct {
+  double amp;
+  double c[2], s[2];
+} WorleyMotion;
+
+/* The largest amplitude, as a fraction of a cube. More than this would
+   need a wider search than Worley() does. */
+#define ANIM_MAX_AMP 0.5
+
+static void WorleyMotionInit(WorleyMotion *m, double t, double amount)
+{
+  double a=6.28318530717958647692*(t-floor(t));
+
+  if (amount<0.0) amount=0.0;
+  if (amount>1.0) amount=1.0;
+  m->amp=amount*ANIM_MAX_AMP;
+  m->c[0]=cos(a);
+  m->s[0]=sin(a);
+  m->c[1]=m->c[0]*m->c[0]-m->s[0]*m->s[0];
+  m->s[1]=2.0*m->c[0]*m->s[0];
+}
+
+/* Mix all bits of a feature point ID into all bits of the result. The
+   low bits of the IDs, which come from an LCG, are not random enough
+   on their own. */
+static unsigned int MotionHash(unsigned int id)
+{
+  id^=id>>16;
+  id*=0x45d9f3bu;
+  id^=id>>16;
+  id*=0x45d9f3bu;
+  id^=id>>16;
+  return id;
+}
+
+/* The offset along axis <k> for a hash <h> from MotionHash(). 4 bits each
+   give the cos and sin weights, both in -1..1 and scaled by 1/sqrt(2) so
+   that the offset is at most the amplitude. The top bit picks the speed. */
+#define MOTION_OFFSET(m, h, k) \
+  ((m)->amp*0.70710678*((2.0*(((h)>>(8*(k)))&15)-15.0)*(1.0/15.0)*(m)->c[(h)>>31] \
+			+(2.0*(((h)>>(8*(k)+4))&15)-15.0)*(1.0/15.0)*(m)->s[(h)>>31]))
+
+/* Like AddSamples(), with the points moved by <m> */
+static void AddSamplesAnim(long xi, long yi, long zi, long max_order,
+			   double at[3], const WorleyMotion *m, double *F,
+			   double (*delta)[3], unsigned long *ID)
+{
+  double dx, dy, dz, d2;
+  long count, i, j, index;
+  unsigned int seed, this_id, h;
+
+  seed=702395077*xi + 915488749*yi + 2120969693*zi;
+  count=Poisson_count[seed>>24];
+  seed=1402024253*seed+586950981;
+
+  for (j=0; j<count; j++)
+    {
+      this_id=seed;
+      h=MotionHash(this_id);
+      seed=1402024253*seed+586950981;
+      dx=xi+(seed+0.5)*(1.0/4294967296.0)+MOTION_OFFSET(m, h, 0)-at[0];
+      seed=1402024253*seed+586950981;
+      dy=yi+(seed+0.5)*(1.0/4294967296.0)+MOTION_OFFSET(m, h, 1)-at[1];
+      seed=1402024253*seed+586950981;
+      dz=zi+(seed+0.5)*(1.0/4294967296.0)+MOTION_OFFSET(m, h, 2)-at[2];
+      seed=1402024253*seed+586950981;
+      d2=dx*dx+dy*dy+dz*dz;
+
+      if (d2<F[max_order-1])
+	{
+	  index=max_order;
+	  while (index>0 && d2<F[index-1]) index--;
+	  for (i=max_order-2; i>=index; i--)
+	    {
+	      F[i+1]=F[i];
+	      ID[i+1]=ID[i];
+	      delta[i+1][0]=delta[i][0];
+	      delta[i+1][1]=delta[i][1];
+	      delta[i+1][2]=delta[i][2];
+	    }
+	  F[index]=d2;
+	  ID[index]=this_id;
+	  delta[index][0]=dx;
+	  delta[index][1]=dy;
+	  delta[index][2]=dz;
+	}
+    }
+}
+
+
+void Worley_anim(double at[3], double t, double amount, long max_order,
+		 double *F, double (*delta)[3], unsigned long *ID)
+{
+  WorleyMotion m;
+  double new_at[3], f, b[3][3];
+  long int_at[3], i, c, ox, oy, oz;
+
+  WorleyMotionInit(&m, t, amount);
+  for (i=0; i<max_order; i++) F[i]=999999.9;
+
+  /* The squared distance bound for a neighbor at offset -1, 0 or +1
+     along each axis, less the amplitude */
+  for (i=0; i<3; i++)
+    {
+      new_at[i]=DENSITY_ADJUSTMENT*at[i];
+      int_at[i]=LFLOOR(new_at[i]);
+      f=new_at[i]-int_at[i];
+      b[i][0]=f-m.amp>0.0 ? (f-m.amp)*(f-m.amp) : 0.0;
+      b[i][1]=0.0;
+      b[i][2]=1.0-f-m.amp>0.0 ? (1.0-f-m.amp)*(1.0-f-m.amp) : 0.0;
+    }
+
+  /* The same cubes in the same order as Worley() */
+  for (c=0; c<27; c++)
+    {
+      ox=Worley_cubes[c][0];
+      oy=Worley_cubes[c][1];
+      oz=Worley_cubes[c][2];
+      if (b[0][ox+1]+b[1][oy+1]+b[2][oz+1]<F[max_order-1])
+	AddSamplesAnim(int_at[0]+ox, int_at[1]+oy, int_at[2]+oz,
+		       max_order, new_at, &m, F, delta, ID);
+    }
+
+  for (i=0; i<max_order; i++)
+    {
+      F[i]=sqrt(F[i])*(1.0/DENSITY_ADJUSTMENT);
+      delta[i][0]*=(1.0/DENSITY_ADJUSTMENT);
+      delta[i][1]*=(1.0/DENSITY_ADJUSTMENT);
+      delta[i][2]*=(1.0/DENSITY_ADJUSTMENT);
+    }
+}
+
+
+/* Like WorleyMotion, in single precision */
+typedef struct {
+  float amp;
+  float c[2], s[2];
+} Worley2Motion;
+
+static void Worley2MotionInit(Worley2Motion *m, float t, float amount)
+{
+  WorleyMotion m3;
+  int i;
+
+  WorleyMotionInit(&m3, t, amount);
+  m->amp=(float)m3.amp;
+  for (i=0; i<2; i++)
+    {
+      m->c[i]=(float)m3.c[i];
+      m->s[i]=(float)m3.s[i];
+    }
+}
+
+#define MOTION_OFFSET2(m, h, k) \
+  ((m)->amp*0.70710678f*((2.0f*(((h)>>(8*(k)))&15)-15.0f)*(1.0f/15.0f)*(m)->c[(h)>>31] \
+			 +(2.0f*(((h)>>(8*(k)+4))&15)-15.0f)*(1.0f/15.0f)*(m)->s[(h)>>31]))
+
+/* Like AddSamplesAnim(), for a square */
+static void AddSamplesAnim2(int xi, int yi, int max_order,
+			    float at[2], const Worley2Motion *m, float *F,
+			    float (*delta)[2], unsigned int *ID)
+{
+  float dx, dy, d2;
+  int count, i, j, index;
+  unsigned int seed, this_id, h;
+
+  seed=SEED2(xi, yi);
+  count=Poisson_count[seed>>24];
+  seed=CHURN(seed);
+
+  for (j=0; j<count; j++)
+    {
+      this_id=seed;
+      h=MotionHash(this_id);
+      seed=CHURN(seed);
+      dx=((float)xi+SEED_TO_UNIT(seed))+MOTION_OFFSET2(m, h, 0)-at[0];
+      seed=CHURN(seed);
+      dy=((float)yi+SEED_TO_UNIT(seed))+MOTION_OFFSET2(m, h, 1)-at[1];
+      seed=CHURN(seed);
+      d2=dx*dx+dy*dy;
+
+      if (d2<F[max_order-1])
+	{
+	  index=max_order;
+	  while (index>0 && d2<F[index-1]) index--;
+	  for (i=max_order-2; i>=index; i--)
+	    {
+	      F[i+1]=F[i];
+	      ID[i+1]=ID[i];
+	      delta[i+1][0]=delta[i][0];
+	      delta[i+1][1]=delta[i][1];
+	    }
+	  F[index]=d2;
+	  ID[index]=this_id;
+	  delta[index][0]=dx;
+	  delta[index][1]=dy;
+	}
+    }
+}
+
+
+void Worley2_anim(float at[2], float t, float amount, int max_order,
+		  float *F, float (*delta)[2], unsigned int *ID)
+{
+  Worley2Motion m;
+  float new_at[2], f, b[2][3];
+  int int_at[2], i, c, ox, oy;
+
+  Worley2MotionInit(&m, t, amount);
+  for (i=0; i<max_order; i++) F[i]=999999.9f;
+
+  for (i=0; i<2; i++)
+    {
+      new_at[i]=DENSITY_ADJUSTMENT_2D*at[i];
+      int_at[i]=IFLOOR(new_at[i]);
+      f=new_at[i]-int_at[i];
+      b[i][0]=f-m.amp>0.0f ? (f-m.amp)*(f-m.amp) : 0.0f;
+      b[i][1]=0.0f;
+      b[i][2]=1.0f-f-m.amp>0.0f ? (1.0f-f-m.amp)*(1.0f-f-m.amp) : 0.0f;
+    }
+
+  for (c=0; c<9; c++)
+    {
+      ox=Worley2_squares[c][0];
+      oy=Worley2_squares[c][1];
+      if (b[0][ox+1]+b[1][oy+1]<F[max_order-1])
+	AddSamplesAnim2(int_at[0]+ox, int_at[1]+oy,
+			max_order, new_at, &m, F, delta, ID);
+    }
+
+  for (i=0; i<max_order; i++)
+    {
+      F[i]=sqrtf(F[i])*(1.0f/DENSITY_ADJUSTMENT_2D);
+      delta[i][0]*=(1.0f/DENSITY_ADJUSTMENT_2D);
+      delta[i][1]*=(1.0f/DENSITY_ADJUSTMENT_2D);
+    }
+}
+
+
+
+/* Worley2_jitter(), Worley3_jitter() and their batch versions, with
+   exactly one feature point per cell instead of the Poisson_count
+   table. The point of a cell is at its center, moved by <jitter> times
+   a random offset in -0.5..0.5 along each axis, as in the voronoi
+   functions of lab2/vonoroi.sl. The seed and the ID of a cell are those
+   of Worley2(), or of Worley() in 3D, so each cell is visited with the
+   same number of steps, and the 3x3 or 3x3x3 search has fixed loops
+   with no tests other than the insertion. */
+
+/* Like SEED2(), for a cube */
+#define SEED3(xi, yi, zi) (702395077u*(unsigned int)(xi) + 915488749u*(unsigned int)(yi) \
+			   + 2120969693u*(unsigned int)(zi))
+
+/* The feature point coordinate of cell <ci>, from a seed */
+#define JITTER_POS(ci, jitter, seed) \
+  ((float)(ci)+0.5f+(jitter)*(SEED_TO_UNIT(seed)-0.5f))
+
+static void AddJittered2(int xi, int yi, float jitter, int max_order,
+			 float at[2], float *F, float (*delta)[2],
+			 unsigned int *ID)
+{
+  unsigned int seed=SEED2(xi, yi), this_id=seed;
+  float dx, dy, d2;
+  int i, index;
+
+  seed=CHURN(seed);
+  dx=JITTER_POS(xi, jitter, seed)-at[0];
+  seed=CHURN(seed);
+  dy=JITTER_POS(yi, jitter, seed)-at[1];
+  d2=dx*dx+dy*dy;
+
+  if (d2<F[max_order-1])
+    {
+      index=max_order;
+      while (index>0 && d2<F[index-1]) index--;
+      for (i=max_order-2; i>=index; i--)
+	{
+	  F[i+1]=F[i];
+	  ID[i+1]=ID[i];
+	  delta[i+1][0]=delta[i][0];
+	  delta[i+1][1]=delta[i][1];
+	}
+      F[index]=d2;
+      ID[index]=this_id;
+      delta[index][0]=dx;
+      delta[index][1]=dy;
+    }
+}
+
+
+void Worley2_jitter(float at[2], float jitter, int max_order,
+		    float *F, float (*delta)[2], unsigned int *ID)
+{
+  int xi=IFLOOR(at[0]), yi=IFLOOR(at[1]), ox, oy, i;
+
+  for (i=0; i<max_order; i++) F[i]=999999.9f;
+
+  for (ox=-1; ox<=1; ox++)
+    for (oy=-1; oy<=1; oy++)
+      AddJittered2(xi+ox, yi+oy, jitter, max_order, at, F, delta, ID);
+
+  for (i=0; i<max_order; i++) F[i]=sqrtf(F[i]);
+}
+
+
+static void AddJittered3(int xi, int yi, int zi, float jitter, int max_order,
+			 float at[3], float *F, float (*delta)[3],
+			 unsigned int *ID)
+{
+  unsigned int seed=SEED3(xi, yi, zi), this_id=seed;
+  float dx, dy, dz, d2;
+  int i, index;
+
+  seed=CHURN(seed);
+  dx=JITTER_POS(xi, jitter, seed)-at[0];
+  seed=CHURN(seed);
+  dy=JITTER_POS(yi, jitter, seed)-at[1];
+  seed=CHURN(seed);
+  dz=JITTER_POS(zi, jitter, seed)-at[2];
+  d2=dx*dx+dy*dy+dz*dz;
+
+  if (d2<F[max_order-1])
+    {
+      index=max_order;
+      while (index>0 && d2<F[index-1]) index--;
+      for (i=max_order-2; i>=index; i--)
+	{
+	  F[i+1]=F[i];
+	  ID[i+1]=ID[i];
+	  delta[i+1][0]=delta[i][0];
+	  delta[i+1][1]=delta[i][1];
+	  delta[i+1][2]=delta[i][2];
+	}
+      F[index]=d2;
+      ID[index]=this_id;
+      delta[index][0]=dx;
+      delta[index][1]=dy;
+      delta[index][2]=dz;
+    }
+}
+
+
+void Worley3_jitter(float at[3], float jitter, int max_order,
+		    float *F, float (*delta)[3], unsigned int *ID)
+{
+  int xi=IFLOOR(at[0]), yi=IFLOOR(at[1]), zi=IFLOOR(at[2]), ox, oy, oz, i;
+
+  for (i=0; i<max_order; i++) F[i]=999999.9f;
+
+  for (ox=-1; ox<=1; ox++)
+    for (oy=-1; oy<=1; oy++)
+      for (oz=-1; oz<=1; oz++)
+	AddJittered3(xi+ox, yi+oy, zi+oz, jitter, max_order, at, F, delta, ID);
+
+  for (i=0; i<max_order; i++) F[i]=sqrtf(F[i]);
+}
+
+
+typedef void (*worley2_jitter_fn)(const float *x, const float *y,
+				  float jitter, int max_order, float *F,
+				  float *dx, float *dy, unsigned int *ID,
+				  int stride);
+typedef void (*worley3_jitter_fn)(const float *x, const float *y,
+				  const float *z, float jitter, int max_order,
+				  float *F, float *dx, float *dy, float *dz,
+				  unsigned int *ID, int stride);
+
+/* Like worley2_kernel(), for the jittered grid kernels */
+static int worley_jitter_kernels(worley2_jitter_fn *k2, worley3_jitter_fn *k3)
+{
+#ifdef CPUISA_X86
+  switch (cpu_isa())
+    {
+    case ISA_AVX512:
+      *k2=worley2_jitter_block_avx512;
+      *k3=worley3_jitter_block_avx512;
+      return 16;
+    case ISA_AVX2:
+      *k2=worley2_jitter_block_avx2;
+      *k3=worley3_jitter_block_avx2;
+      return 8;
+    case ISA_SSE41:
+    case ISA_SSE2:
+      *k2=worley2_jitter_block_sse2;
+      *k3=worley3_jitter_block_sse2;
+      return 4;
+    }
+#endif
+  *k2=0;
+  *k3=0;
+  return 0;
+}
+
+
+void Worley2_jitter_batch(const float *x, const float *y, int n, float jitter,
+			  int max_order, float *F, float *dx, float *dy,
+			  unsigned int *ID)
+{
+  worley2_jitter_fn kernel;
+  worley3_jitter_fn kernel3;
+  int w=worley_jitter_kernels(&kernel, &kernel3);
+  int i=0, j, k;
+
+  if (max_order<1 || max_order>WORLEY2_MAX_ORDER) return;
+
+  if (w)
+    {
+      /* The tail goes through a padded buffer, as in Worley2_batch() */
+      float tx[WORLEY2_MAXW]={0.0f}, ty[WORLEY2_MAXW]={0.0f};
+      float tF[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      float tdx[WORLEY2_MAX_ORDER*WORLEY2_MAXW], tdy[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      unsigned int tID[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+
+      for (; i+w<=n; i+=w)
+	kernel(x+i, y+i, jitter, max_order, F+i, dx ? dx+i : 0,
+	       dy ? dy+i : 0, ID ? ID+i : 0, n);
+      if (i<n)
+	{
+	  for (j=0; i+j<n; j++) { tx[j]=x[i+j]; ty[j]=y[i+j]; }
+	  kernel(tx, ty, jitter, max_order, tF, tdx, tdy, tID, WORLEY2_MAXW);
+	  for (k=0; k<max_order; k++)
+	    for (j=0; i+j<n; j++)
+	      {
+		F[k*n+i+j]=tF[k*WORLEY2_MAXW+j];
+		if (dx) dx[k*n+i+j]=tdx[k*WORLEY2_MAXW+j];
+		if (dy) dy[k*n+i+j]=tdy[k*WORLEY2_MAXW+j];
+		if (ID) ID[k*n+i+j]=tID[k*WORLEY2_MAXW+j];
+	      }
+	}
+      return;
+    }
+
+  for (; i<n; i++)
+    {
+      float at[2], pF[WORLEY2_MAX_ORDER], pdelta[WORLEY2_MAX_ORDER][2];
+      unsigned int pID[WORLEY2_MAX_ORDER];
+
+      at[0]=x[i];
+      at[1]=y[i];
+      Worley2_jitter(at, jitter, max_order, pF, pdelta, pID);
+      for (k=0; k<max_order; k++)
+	{
+	  F[k*n+i]=pF[k];
+	  if (dx) dx[k*n+i]=pdelta[k][0];
+	  if (dy) dy[k*n+i]=pdelta[k][1];
+	  if (ID) ID[k*n+i]=pID[k];
+	}
+    }
+}
+
+
+void Worley3_jitter_batch(const float *x, const float *y, const float *z,
+			  int n, float jitter, int max_order, float *F,
+			  float *dx, float *dy, float *dz, unsigned int *ID)
+{
+  worley2_jitter_fn kernel2;
+  worley3_jitter_fn kernel;
+  int w=worley_jitter_kernels(&kernel2, &kernel);
+  int i=0, j, k;
+
+  if (max_order<1 || max_order>WORLEY2_MAX_ORDER) return;
+
+  if (w)
+    {
+      float tx[WORLEY2_MAXW]={0.0f}, ty[WORLEY2_MAXW]={0.0f}, tz[WORLEY2_MAXW]={0.0f};
+      float tF[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      float tdx[WORLEY2_MAX_ORDER*WORLEY2_MAXW], tdy[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      float tdz[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+      unsigned int tID[WORLEY2_MAX_ORDER*WORLEY2_MAXW];
+
+      for (; i+w<=n; i+=w)
+	kernel(x+i, y+i, z+i, jitter, max_order, F+i, dx ? dx+i : 0,
+	       dy ? dy+i : 0, dz ? dz+i : 0, ID ? ID+i : 0, n);
+      if (i<n)
+	{
+	  for (j=0; i+j<n; j++) { tx[j]=x[i+j]; ty[j]=y[i+j]; tz[j]=z[i+j]; }
+	  kernel(tx, ty, tz, jitter, max_order, tF, tdx, tdy, tdz, tID,
+		 WORLEY2_MAXW);
+	  for (k=0; k<max_order; k++)
+	    for (j=0; i+j<n; j++)
+	      {
+		F[k*n+i+j]=tF[k*WORLEY2_MAXW+j];
+		if (dx) dx[k*n+i+j]=tdx[k*WORLEY2_MAXW+j];
+		if (dy) dy[k*n+i+j]=tdy[k*WORLEY2_MAXW+j];
+		if (dz) dz[k*n+i+j]=tdz[k*WORLEY2_MAXW+j];
+		if (ID) ID[k*n+i+j]=tID[k*WORLEY2_MAXW+j];
+	      }
+	}
+      return;
+    }
+
+  for (; i<n; i++)
+    {
+      float at[3], pF[WORLEY2_MAX_ORDER], pdelta[WORLEY2_MAX_ORDER][3];
+      unsigned int pID[WORLEY2_MAX_ORDER];
+
+      at[0]=x[i];
+      at[1]=y[i];
+      at[2]=z[i];
+      Worley3_jitter(at, jitter, max_order, pF, pdelta, pID);
+      for (k=0; k<max_order; k++)
+	{
+	  F[k*n+i]=pF[k];
+	  if (dx) dx[k*n+i]=pdelta[k][0];
+	  if (dy) dy[k*n+i]=pdelta[k][1];
+	  if (dz) dz[k*n+i]=pdelta[k][2];
+	  if (ID) ID[k*n+i]=pID[k];
+	}
+    }
+}
@@ -47,3 +47,129 @@ void Worley(double at[3], long max_order,
 	    double F[2], double delta[2][3], unsigned long ID[2]);
 
 
+/* Worley2()
+
+   The 2D version of Worley(), in single precision, with its own density
+   adjustment so that the average F_1 is again 1.0. The arguments are as
+   for Worley(), but <delta> holds 2D vectors and the IDs are 32 bits on
+   all platforms.
+
+   The search only covers the 3x3 squares around the point, which is not
+   always enough for the higher orders. In 200000 random points, F_1 and
+   F_2 were always right, but F_3 came out too large 8 times and F_4 44
+   times, from a closer point in a square further out. Use Worley2N()
+   where F_3 and F_4 must be exact. */
+
+void Worley2(float at[2], int max_order,
+	     float *F, float (*delta)[2], unsigned int *ID);
+
+
+/* Worley2_batch()
+
+   Worley2() for <n> sample points at once, ( x[i], y[i] ) for i=0..n-1.
+   The feature points are tested across SIMD lanes where the CPU allows.
+   The results are stored by order: F_k+1 of point i goes in F[k*n+i],
+   and likewise for the delta vector components in dx[] and dy[] and the
+   IDs in ID[]. Any of dx, dy and ID may be NULL if not needed.
+   <max_order> must be 1..WORLEY2_MAX_ORDER, or nothing is computed.
+   The search is the same as in Worley2(), so F_3 and F_4 can
+   occasionally be too large, as described there. */
+
+#define WORLEY2_MAX_ORDER 4
+
+void Worley2_batch(const float *x, const float *y, int n, int max_order,
+		   float *F, float *dx, float *dy, unsigned int *ID);
+
+
+/* Worley_grid(), Worley2_grid()
+
+   Worley() over the z=<z> plane and Worley2() over the plane, for an
+   image of nx*ny pixels. Pixel (i,j) is at ( x0 + i*dx, y0 + j*dy ), and
+   its results go where Worley() or Worley2() would put them for
+   F+p, delta+p and ID+p, with p = (i + j*nx)*max_order. The results are
+   exactly the same, but the feature points of each cube are generated
+   only once per tile of pixels instead of for every pixel. Most of the
+   time goes into the distance tests, not into generating the points, so
+   this is only a modest gain: about 1.2x in 2D at 0.02-0.1 units per
+   pixel, and 1.0-1.8x in 3D. At coarse scales it can be slower than
+   per-pixel calls, about 0.9x in 2D at 1.5 units per pixel. */
+
+void Worley_grid(double x0, double y0, double z, double dx, double dy,
+		 int nx, int ny, long max_order,
+		 double *F, double (*delta)[3], unsigned long *ID);
+
+void Worley2_grid(float x0, float y0, float dx, float dy,
+		  int nx, int ny, int max_order,
+		  float *F, float (*delta)[2], unsigned int *ID);
+
+
+/* WorleyN(), Worley2N()
+
+   Worley() and Worley2() for high orders, F_1 up to F_16 and beyond,
+   without the artifacts mentioned above. The search goes out as far as
+   it needs to for the <max_order> closest points, a ring of cubes at a
+   time, and keeps the closest points so far in a heap, so it stays
+   exact for any order and grows slower than linearly in the order.
+   The feature points, and the F values wherever Worley() gets them
+   right, are the same as those of Worley() and Worley2(), which are
+   still somewhat faster for the low orders. */
+
+void WorleyN(double at[3], long max_order,
+	     double *F, double (*delta)[3], unsigned long *ID);
+
+void Worley2N(float at[2], int max_order,
+	      float *F, float (*delta)[2], unsigned int *ID);
+
+
+/* Worley_anim(), Worley2_anim()
+
+   Worley() and Worley2() with moving feature points, for animated cells
+   at the cost of a 3D or 2D search instead of moving a slice through a
+   volume one dimension up. Each point goes around an ellipse of its own
+   about its place in Worley(), once or twice per unit of <t>, so the
+   pattern repeats with a period of 1 in <t> and moves smoothly.
+   <amount> is how far the points may move, from 0, where the results are
+   those of Worley() and Worley2(), to 1, which is half a cube, or about
+   1.25 and 1.7 times the mean F_1. */
+
+void Worley_anim(double at[3], double t, double amount, long max_order,
+		 double *F, double (*delta)[3], unsigned long *ID);
+
+void Worley2_anim(float at[2], float t, float amount, int max_order,
+		  float *F, float (*delta)[2], unsigned int *ID);
+
+
+/* Worley2_jitter(), Worley3_jitter()
+
+   A faster cellular basis with exactly one feature point per cell, at
+   the center of the cell moved by up to +-<jitter>/2 along each axis,
+   like the voronoi functions in lab2/vonoroi.sl with freq 1. <jitter>
+   should be 0..1; 0 gives a regular grid. The cells are 1 unit wide
+   and the F values are not adjusted to a mean of 1.0, as that depends
+   on the jitter. The other arguments are as for Worley2(), but only the
+   3x3 or 3x3x3 nearest cells are searched, so <max_order> should be at
+   most 2 or so, as in vonoroi.sl. The points don't have Poisson
+   statistics, but where that doesn't matter this is several times
+   faster than Worley2() and Worley(). */
+
+void Worley2_jitter(float at[2], float jitter, int max_order,
+		    float *F, float (*delta)[2], unsigned int *ID);
+
+void Worley3_jitter(float at[3], float jitter, int max_order,
+		    float *F, float (*delta)[3], unsigned int *ID);
+
+
+/* Worley2_jitter_batch(), Worley3_jitter_batch()
+
+   Worley2_jitter() and Worley3_jitter() for <n> points, with SIMD where
+   the CPU allows and the outputs stored as for Worley2_batch(). <dz> is
+   the z component of the delta vectors, and may be NULL like the rest.
+   <max_order> must be 1..WORLEY2_MAX_ORDER. */
+
+void Worley2_jitter_batch(const float *x, const float *y, int n, float jitter,
+			  int max_order, float *F, float *dx, float *dy,
+			  unsigned int *ID);
+
+void Worley3_jitter_batch(const float *x, const float *y, const float *z,
+			  int n, float jitter, int max_order, float *F,
+			  float *dx, float *dy, float *dz, unsigned int *ID);
@@ -0,0 +1,318 @@
+/*
+ * Header-only C++ templates for Steven Worley's cellular texture basis,
+ * with the distance metric and the number of F values fixed at compile
+ * time, instead of the Euclidean metric and the run time max_order of
+ * Worley() and Worley2() in cellular.c.
+ *
+ * Cellular<Dim, Metric, Order>::eval() returns F_1 to F_Order, the delta
+ * vectors and the feature point IDs, like Worley() for Dim = 3 (in double)
+ * and Worley2() for Dim = 2 (in float):
+ *
+ *   float F[2], delta[2][2];
+ *   unsigned int ID[2];
+ *   Cellular<2, WorleyManhattan, 2>::eval( at, F, delta, ID );
+ *
+ * The feature points are the same as those of the C functions. Each
+ * metric also gives the smallest distance to any point in a neighboring
+ * cell, which replaces the x2+y2 < F[max_order-1] tests of the Euclidean
+ * search, and the insertion into the sorted F values is unrolled for the
+ * given order. The nearer of the two neighbors along each axis is tested
+ * first, which fills in F sooner and skips a few more cells. With
+ * WorleyEuclidean, the results are the same as those of Worley() and
+ * Worley2(), unless two feature points are at exactly the same distance.
+ *
+ * The density is the same for all metrics, so only the Euclidean F_1 has
+ * a mean value of 1.0.
+ */
+
+#ifndef CELLULAR_HPP
+#define CELLULAR_HPP
+
+#include <math.h>
+
+/*
+ * The metrics. dist() is the distance, or something that increases with
+ * it, like the squared Euclidean distance. term() is the smallest dist()
+ * to a point that is t away along one axis, and combine() adds up the
+ * terms of two axes, to bound the distance to a neighboring cell.
+ * finish() turns dist() into the distance that is returned.
+ */
+struct WorleyEuclidean {
+    template<typename T> static inline T dist(T dx, T dy) {
+        return dx * dx + dy * dy;
+    }
+    template<typename T> static inline T dist(T dx, T dy, T dz) {
+        return dx * dx + dy * dy + dz * dz;
+    }
+    template<typename T> static inline T term(T t) { return t * t; }
+    template<typename T> static inline T combine(T a, T b) { return a + b; }
+    template<typename T> static inline T finish(T d) { return sqrt( d ); }
+};
+
+struct WorleyManhattan {
+    template<typename T> static inline T dist(T dx, T dy) {
+        return fabs( dx ) + fabs( dy );
+    }
+    template<typename T> static inline T dist(T dx, T dy, T dz) {
+        return fabs( dx ) + fabs( dy ) + fabs( dz );
+    }
+    template<typename T> static inline T term(T t) { return t; }
+    template<typename T> static inline T combine(T a, T b) { return a + b; }
+    template<typename T> static inline T finish(T d) { return d; }
+};
+
+// The largest of the coordinate differences, which makes square cells
+struct WorleyChebyshev {
+    template<typename T> static inline T dist(T dx, T dy) {
+        return fmax( fabs( dx ), fabs( dy ) );
+    }
+    template<typename T> static inline T dist(T dx, T dy, T dz) {
+        return fmax( fmax( fabs( dx ), fabs( dy ) ), fabs( dz ) );
+    }
+    template<typename T> static inline T term(T t) { return t; }
+    template<typename T> static inline T combine(T a, T b) { return fmax( a, b ); }
+    template<typename T> static inline T finish(T d) { return d; }
+};
+
+// The superquadratic metric, the P-th root of the sum of |d|^P. P = 1 is
+// the Manhattan and P = 2 the Euclidean distance, but slower.
+template<int P> struct WorleyMinkowski {
+    template<typename T> static inline T ipow(T t) {
+        T r = t;
+        for( int i = 1; i < P; i++ ) r *= t;
+        return r;
+    }
+    template<typename T> static inline T dist(T dx, T dy) {
+        return ipow( fabs( dx ) ) + ipow( fabs( dy ) );
+    }
+    template<typename T> static inline T dist(T dx, T dy, T dz) {
+        return ipow( fabs( dx ) ) + ipow( fabs( dy ) ) + ipow( fabs( dz ) );
+    }
+    template<typename T> static inline T term(T t) { return ipow( t ); }
+    template<typename T> static inline T combine(T a, T b) { return a + b; }
+    template<typename T> static inline T finish(T d) { return pow( d, T(1) / T(P) ); }
+};
+
+namespace cellular_detail {
+
+template<typename T> inline int fastfloor(T x) {
+    return ( x < (int)x ) ? (int)x - 1 : (int)x;
+}
+
+/*
+ * Poisson_count from cellular.c, and the neighbors in the order that
+ * Worley() and Worley2() test them: the facing ones, then the edges,
+ * then the corners. These are templates only so that they can be defined
+ * in this header.
+ */
+template<int Dummy> struct Tables {
+    static const int poisson[256];
+    static const int neighbors2[8][2];
+    static const int neighbors3[26][3];
+};
+
+template<int Dummy> const int Tables<Dummy>::poisson[256] = {
+    4,3,1,1,1,2,4,2,2,2,5,1,0,2,1,2,2,0,4,3,2,1,2,1,3,2,2,4,2,2,5,1,2,3,2,2,2,2,2,3,
+    2,4,2,5,3,2,2,2,5,3,3,5,2,1,3,3,4,4,2,3,0,4,2,2,2,1,3,2,2,2,3,3,3,1,2,0,2,1,1,2,
+    2,2,2,5,3,2,3,2,3,2,2,1,0,2,1,1,2,1,2,2,1,3,4,2,2,2,5,4,2,4,2,2,5,4,3,2,2,5,4,3,
+    3,3,5,2,2,2,2,2,3,1,1,4,2,1,3,3,4,3,2,4,3,3,3,4,5,1,4,2,4,3,1,2,3,5,3,2,1,3,1,3,
+    3,3,2,3,1,5,5,4,2,2,4,1,3,4,1,5,3,3,5,3,4,3,2,2,1,1,1,1,1,2,4,5,4,5,4,2,1,5,1,1,
+    2,3,3,3,2,5,2,3,3,2,0,2,1,1,4,2,1,3,2,1,2,2,3,2,5,5,3,4,5,5,2,4,4,5,3,2,2,2,1,4,
+    2,3,3,4,2,5,4,2,4,2,2,2,4,5,3,2
+};
+
+template<int Dummy> const int Tables<Dummy>::neighbors2[8][2] = {
+    {-1, 0}, { 0,-1}, { 1, 0}, { 0, 1},
+    {-1,-1}, {-1, 1}, { 1,-1}, { 1, 1}
+};
+
+template<int Dummy> const int Tables<Dummy>::neighbors3[26][3] = {
+    {-1, 0, 0}, { 0,-1, 0}, { 0, 0,-1}, { 1, 0, 0}, { 0, 1, 0}, { 0, 0, 1},
+    {-1,-1, 0}, {-1, 0,-1}, { 0,-1,-1}, { 1, 1, 0}, { 1, 0, 1}, { 0, 1, 1},
+    {-1, 1, 0}, {-1, 0, 1}, { 0,-1, 1}, { 1,-1, 0}, { 1, 0,-1}, { 0, 1,-1},
+    {-1,-1,-1}, {-1,-1, 1}, {-1, 1,-1}, {-1, 1, 1},
+    { 1,-1,-1}, { 1,-1, 1}, { 1, 1,-1}, { 1, 1, 1}
+};
+
+inline unsigned int churn(unsigned int seed) {
+    return 1402024253u * seed + 586950981u;
+}
+
+/*
+ * The lattices: the scalar type, the density adjustment and the feature
+ * points of a cell, generated the same way as by SquarePoints() and
+ * CubePoints() in cellular.c. points() calls add( id, px, py[, pz] ) for
+ * each point, with its position in the scaled space.
+ */
+template<int Dim> struct Lattice;
+
+template<> struct Lattice<2> {
+    typedef float T;
+    static const int neighbors = 8;
+    static inline T density() { return 0.294929f; }
+    static inline const int *neighbor(int n) { return Tables<0>::neighbors2[n]; }
+
+    template<typename Add> static inline void points(const int *c, Add &add) {
+        unsigned int seed = 702395077u * (unsigned int)c[0]
+                          + 915488749u * (unsigned int)c[1];
+        int count = Tables<0>::poisson[seed >> 24];
+        seed = churn( seed );
+        for( int j = 0; j < count; j++ ) {
+            unsigned int id = seed;
+            seed = churn( seed );
+            T px = (float)c[0] + ( (float)( seed >> 8 ) + 0.5f ) * ( 1.0f / 16777216.0f );
+            seed = churn( seed );
+            T py = (float)c[1] + ( (float)( seed >> 8 ) + 0.5f ) * ( 1.0f / 16777216.0f );
+            seed = churn( seed );
+            add( id, px, py );
+        }
+    }
+};
+
+template<> struct Lattice<3> {
+    typedef double T;
+    static const int neighbors = 26;
+    static inline T density() { return 0.398150; }
+    static inline const int *neighbor(int n) { return Tables<0>::neighbors3[n]; }
+
+    template<typename Add> static inline void points(const int *c, Add &add) {
+        unsigned int seed = 702395077u * (unsigned int)c[0]
+                          + 915488749u * (unsigned int)c[1]
+                          + 2120969693u * (unsigned int)c[2];
+        int count = Tables<0>::poisson[seed >> 24];
+        seed = churn( seed );
+        for( int j = 0; j < count; j++ ) {
+            unsigned int id = seed;
+            seed = churn( seed );
+            T fx = ( seed + 0.5 ) * ( 1.0 / 4294967296.0 );
+            seed = churn( seed );
+            T fy = ( seed + 0.5 ) * ( 1.0 / 4294967296.0 );
+            seed = churn( seed );
+            T fz = ( seed + 0.5 ) * ( 1.0 / 4294967296.0 );
+            seed = churn( seed );
+            add( id, (T)c[0] + fx, (T)c[1] + fy, (T)c[2] + fz );
+        }
+    }
+};
+
+/*
+ * Insert a point into the sorted F[0..K], dropping the old F[K]. This is
+ * the insertion sort of AddSamples(), unrolled by the recursion. Equal
+ * distances keep the older point first, as there.
+ */
+template<typename T, int Dim, int K> struct TopK {
+    static inline void insert(T *F, T (*delta)[Dim], unsigned int *ID,
+                              T d, const T *dv, unsigned int id) {
+        if( d < F[K-1] ) {
+            F[K] = F[K-1];
+            ID[K] = ID[K-1];
+            for( int a = 0; a < Dim; a++ ) delta[K][a] = delta[K-1][a];
+            TopK<T, Dim, K-1>::insert( F, delta, ID, d, dv, id );
+        } else {
+            F[K] = d;
+            ID[K] = id;
+            for( int a = 0; a < Dim; a++ ) delta[K][a] = dv[a];
+        }
+    }
+};
+
+template<typename T, int Dim> struct TopK<T, Dim, 0> {
+    static inline void insert(T *F, T (*delta)[Dim], unsigned int *ID,
+                              T d, const T *dv, unsigned int id) {
+        F[0] = d;
+        ID[0] = id;
+        for( int a = 0; a < Dim; a++ ) delta[0][a] = dv[a];
+    }
+};
+
+// The per-point work of a search, passed to Lattice::points(). The F
+// values are kept here rather than in the caller's arrays, so that the
+// compiler knows they don't alias at[].
+template<int Dim, typename Metric, int Order> struct Search {
+    typedef typename Lattice<Dim>::T T;
+    T at[Dim];
+    T F[Order];
+    T delta[Order][Dim];
+    unsigned int ID[Order];
+
+    inline void test(unsigned int id, const T *dv) {
+        T d = Dim == 2 ? Metric::dist( dv[0], dv[1] )
+                       : Metric::dist( dv[0], dv[1], dv[Dim-1] );
+        if( d < F[Order-1] )
+            TopK<T, Dim, Order-1>::insert( F, delta, ID, d, dv, id );
+    }
+    inline void operator()(unsigned int id, T px, T py) {
+        T dv[2] = { px - at[0], py - at[1] };
+        test( id, dv );
+    }
+    inline void operator()(unsigned int id, T px, T py, T pz) {
+        T dv[3] = { px - at[0], py - at[1], pz - at[2] };
+        test( id, dv );
+    }
+};
+
+} // namespace cellular_detail
+
+/*
+ * Cellular<Dim, Metric, Order>::eval(), for Dim = 2 or 3 and Order >= 1.
+ * The search visits the cell of the point, then the neighbors in the
+ * order of Worley(), mirrored along each axis where the point is in the
+ * upper half of its cell, skipping those that are known to be too far.
+ */
+template<int Dim, typename Metric = WorleyEuclidean, int Order = 2>
+struct Cellular {
+    typedef typename cellular_detail::Lattice<Dim>::T T;
+
+    static inline void eval(const T at[Dim], T F[Order], T delta[Order][Dim],
+                            unsigned int ID[Order]) {
+        using namespace cellular_detail;
+        typedef Lattice<Dim> L;
+        Search<Dim, Metric, Order> s;
+        int cell[Dim], c[Dim], flip[Dim];
+        T bound[Dim][3]; // Bound terms for the neighbors at -1, 0 and +1
+
+        for( int k = 0; k < Order; k++ ) {
+            s.F[k] = T(999999.9);
+            s.ID[k] = 0;
+            for( int a = 0; a < Dim; a++ ) s.delta[k][a] = T(0);
+        }
+        for( int a = 0; a < Dim; a++ ) {
+            s.at[a] = L::density() * at[a];
+            cell[a] = fastfloor( s.at[a] );
+        }
+
+        L::points( cell, s );
+
+        // All terms are >= 0, so a zero term leaves both sums and maxima
+        // unchanged, and the facing and edge neighbors need no special case.
+        for( int a = 0; a < Dim; a++ ) {
+            T f = s.at[a] - cell[a];
+            bound[a][0] = Metric::term( f );
+            bound[a][1] = T(0);
+            bound[a][2] = Metric::term( T(1) - f );
+            flip[a] = f < T(0.5) ? 1 : -1;
+        }
+
+        for( int n = 0; n < L::neighbors; n++ ) {
+            const int *o = L::neighbor( n );
+            int oa = o[0] * flip[0];
+            T b = bound[0][oa+1];
+            c[0] = cell[0] + oa;
+            for( int a = 1; a < Dim; a++ ) {
+                oa = o[a] * flip[a];
+                b = Metric::combine( b, bound[a][oa+1] );
+                c[a] = cell[a] + oa;
+            }
+            if( b < s.F[Order-1] ) L::points( c, s );
+        }
+
+        for( int k = 0; k < Order; k++ ) {
+            F[k] = Metric::finish( s.F[k] ) * ( T(1) / L::density() );
+            for( int a = 0; a < Dim; a++ )
+                delta[k][a] = s.delta[k][a] * ( T(1) / L::density() );
+            ID[k] = s.ID[k];
+        }
+    }
+};
+
+#endif
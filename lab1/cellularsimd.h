@@ -0,0 +1,263 @@
+/*
+ * SIMD kernels for Worley2_batch() and the jittered grid batches.
+ * This file is included several times from cellular.c, once for each
+ * instruction set, after simdlanes.h has set up the lane macros.
+ * It is not meant to be included from anywhere else.
+ *
+ * Each lane handles one sample point, and visits the same squares in the
+ * same order as Worley2(). A square is skipped only if no lane needs it,
+ * and the lanes that don't need it, or have fewer feature points in it,
+ * are masked off. Instead of the insertion sort, each feature point is
+ * bubbled into the sorted F values of its lane with min/max style selects.
+ * Ties end up in the same order as with the insertion sort, so the result
+ * is the same as from Worley2(), except that the AVX-512 kernel may fuse
+ * multiplies and adds and differ in the last bits.
+ */
+
+// The LCG of AddSamples2() on 32-bit lanes
+SIMD_FN vint SIMD_NAME(vchurn)( vint seed )
+{
+    return VI_ADD( VI_MUL( seed, VI_SET1( 1402024253 ) ), VI_SET1( 586950981 ) );
+}
+
+// SEED_TO_UNIT() on 32-bit lanes
+SIMD_FN vfloat SIMD_NAME(vseedunit)( vint seed )
+{
+    return V_MUL( V_ADD( VI_TOFLOAT( VI_SRL( seed, 8 ) ), V_SET1( 0.5f ) ),
+                  V_SET1( 1.0f / 16777216.0f ) );
+}
+
+/** SIMD_W lanes of Worley2(). F, dx, dy and ID are written for order k
+ * at offset k*stride. dx, dy and ID may be NULL.
+ */
+SIMD_FN void SIMD_NAME(worley2_block)( const float *x, const float *y, int max_order,
+                                       float *F, float *dx, float *dy,
+                                       unsigned int *ID, int stride )
+{
+    vfloat ax = V_MUL( V_SET1( DENSITY_ADJUSTMENT_2D ), V_LOADU( x ) );
+    vfloat ay = V_MUL( V_SET1( DENSITY_ADJUSTMENT_2D ), V_LOADU( y ) );
+    vfloat fx = V_FLOOR( ax );
+    vfloat fy = V_FLOOR( ay );
+    vint ix = V_TOINT( fx );
+    vint iy = V_TOINT( fy );
+    vfloat x2 = V_SUB( ax, fx );
+    vfloat y2 = V_SUB( ay, fy );
+    vfloat mx2 = V_MUL( V_SUB( V_SET1( 1.0f ), x2 ), V_SUB( V_SET1( 1.0f ), x2 ) );
+    vfloat my2 = V_MUL( V_SUB( V_SET1( 1.0f ), y2 ), V_SUB( V_SET1( 1.0f ), y2 ) );
+    vfloat bx[3], by[3];
+    vfloat vF[WORLEY2_MAX_ORDER], vdx[WORLEY2_MAX_ORDER], vdy[WORLEY2_MAX_ORDER];
+    vint vid[WORLEY2_MAX_ORDER];
+    int c, j, k;
+
+    x2 = V_MUL( x2, x2 );
+    y2 = V_MUL( y2, y2 );
+    // The squared distance bound for a neighbor at offset -1, 0 or +1
+    bx[0] = x2; bx[1] = V_ZERO; bx[2] = mx2;
+    by[0] = y2; by[1] = V_ZERO; by[2] = my2;
+
+    for( k = 0; k < max_order; k++ ) {
+        vF[k] = V_SET1( 999999.9f );
+        vdx[k] = V_ZERO;
+        vdy[k] = V_ZERO;
+        vid[k] = VI_SET1( 0 );
+    }
+
+    for( c = 0; c < 9; c++ ) {
+        int ox = Worley2_squares[c][0], oy = Worley2_squares[c][1];
+        vfloat bound = c == 0 ? V_ZERO
+                     : oy == 0 ? bx[ox+1]
+                     : ox == 0 ? by[oy+1] : V_ADD( bx[ox+1], by[oy+1] );
+        vmask need = V_CMPLT( bound, vF[max_order-1] );
+        vint cx, cy, seed, count;
+        vfloat px, py;
+
+        if( !VM_ANY( need ) ) continue;
+
+        cx = VI_ADD( ix, VI_SET1( ox ) );
+        cy = VI_ADD( iy, VI_SET1( oy ) );
+        px = VI_TOFLOAT( cx );
+        py = VI_TOFLOAT( cy );
+        seed = VI_ADD( VI_MUL( cx, VI_SET1( 702395077 ) ),
+                       VI_MUL( cy, VI_SET1( 915488749 ) ) );
+        count = VI_SEL( need, VI_GATHER( Poisson_count, VI_SRL( seed, 24 ) ),
+                        VI_SET1( 0 ) );
+        seed = SIMD_NAME(vchurn)( seed );
+
+        for( j = 0; ; j++ ) {
+            vmask valid = VI_CMPLT( VI_SET1( j ), count );
+            vint id = seed;
+            vfloat ddx, ddy, d2;
+
+            if( !VM_ANY( valid ) ) break;
+
+            seed = SIMD_NAME(vchurn)( seed );
+            ddx = V_SUB( V_ADD( px, SIMD_NAME(vseedunit)( seed ) ), ax );
+            seed = SIMD_NAME(vchurn)( seed );
+            ddy = V_SUB( V_ADD( py, SIMD_NAME(vseedunit)( seed ) ), ay );
+            seed = SIMD_NAME(vchurn)( seed );
+            d2 = V_ADD( V_MUL( ddx, ddx ), V_MUL( ddy, ddy ) );
+            d2 = V_SEL( valid, d2, V_SET1( FLT_MAX ) );
+
+            // Swap the new point with each one it is closer than
+            for( k = 0; k < max_order; k++ ) {
+                vmask m = V_CMPLT( d2, vF[k] );
+                vfloat t;
+                vint ti;
+                t = vF[k]; vF[k] = V_SEL( m, d2, t ); d2 = V_SEL( m, t, d2 );
+                t = vdx[k]; vdx[k] = V_SEL( m, ddx, t ); ddx = V_SEL( m, t, ddx );
+                t = vdy[k]; vdy[k] = V_SEL( m, ddy, t ); ddy = V_SEL( m, t, ddy );
+                ti = vid[k]; vid[k] = VI_SEL( m, id, ti ); id = VI_SEL( m, ti, id );
+            }
+        }
+    }
+
+    for( k = 0; k < max_order; k++ ) {
+        V_STOREU( F + k*stride,
+                  V_MUL( V_SQRT( vF[k] ), V_SET1( 1.0f / DENSITY_ADJUSTMENT_2D ) ) );
+        if( dx ) V_STOREU( dx + k*stride, V_MUL( vdx[k], V_SET1( 1.0f / DENSITY_ADJUSTMENT_2D ) ) );
+        if( dy ) V_STOREU( dy + k*stride, V_MUL( vdy[k], V_SET1( 1.0f / DENSITY_ADJUSTMENT_2D ) ) );
+        if( ID ) VI_STOREU( ID + k*stride, vid[k] );
+    }
+}
+
+/** SIMD_W lanes of Worley2_jitter(), with the outputs as for
+ * worley2_block(). Every lane tests all 9 squares, so there is nothing
+ * to mask off, and a square's point is made without a table lookup or
+ * a loop. The points go through the same bubble as above, so the
+ * results are those of Worley2_jitter(), with the same exception.
+ */
+SIMD_FN void SIMD_NAME(worley2_jitter_block)( const float *x, const float *y,
+                                              float jitter, int max_order,
+                                              float *F, float *dx, float *dy,
+                                              unsigned int *ID, int stride )
+{
+    vfloat ax = V_LOADU( x );
+    vfloat ay = V_LOADU( y );
+    vint ix = V_TOINT( V_FLOOR( ax ) );
+    vint iy = V_TOINT( V_FLOOR( ay ) );
+    vfloat vj = V_SET1( jitter );
+    vfloat vF[WORLEY2_MAX_ORDER], vdx[WORLEY2_MAX_ORDER], vdy[WORLEY2_MAX_ORDER];
+    vint vid[WORLEY2_MAX_ORDER];
+    int ox, oy, k;
+
+    for( k = 0; k < max_order; k++ ) {
+        vF[k] = V_SET1( 999999.9f );
+        vdx[k] = V_ZERO;
+        vdy[k] = V_ZERO;
+        vid[k] = VI_SET1( 0 );
+    }
+
+    for( ox = -1; ox <= 1; ox++ ) {
+        for( oy = -1; oy <= 1; oy++ ) {
+            vint cx = VI_ADD( ix, VI_SET1( ox ) );
+            vint cy = VI_ADD( iy, VI_SET1( oy ) );
+            vint seed = VI_ADD( VI_MUL( cx, VI_SET1( 702395077 ) ),
+                                VI_MUL( cy, VI_SET1( 915488749 ) ) );
+            vint id = seed;
+            vfloat ddx, ddy, d2;
+
+            seed = SIMD_NAME(vchurn)( seed );
+            ddx = V_SUB( V_ADD( V_ADD( VI_TOFLOAT( cx ), V_SET1( 0.5f ) ),
+                                V_MUL( vj, V_SUB( SIMD_NAME(vseedunit)( seed ), V_SET1( 0.5f ) ) ) ),
+                         ax );
+            seed = SIMD_NAME(vchurn)( seed );
+            ddy = V_SUB( V_ADD( V_ADD( VI_TOFLOAT( cy ), V_SET1( 0.5f ) ),
+                                V_MUL( vj, V_SUB( SIMD_NAME(vseedunit)( seed ), V_SET1( 0.5f ) ) ) ),
+                         ay );
+            d2 = V_ADD( V_MUL( ddx, ddx ), V_MUL( ddy, ddy ) );
+
+            for( k = 0; k < max_order; k++ ) {
+                vmask m = V_CMPLT( d2, vF[k] );
+                vfloat t;
+                vint ti;
+                t = vF[k]; vF[k] = V_SEL( m, d2, t ); d2 = V_SEL( m, t, d2 );
+                t = vdx[k]; vdx[k] = V_SEL( m, ddx, t ); ddx = V_SEL( m, t, ddx );
+                t = vdy[k]; vdy[k] = V_SEL( m, ddy, t ); ddy = V_SEL( m, t, ddy );
+                ti = vid[k]; vid[k] = VI_SEL( m, id, ti ); id = VI_SEL( m, ti, id );
+            }
+        }
+    }
+
+    for( k = 0; k < max_order; k++ ) {
+        V_STOREU( F + k*stride, V_SQRT( vF[k] ) );
+        if( dx ) V_STOREU( dx + k*stride, vdx[k] );
+        if( dy ) V_STOREU( dy + k*stride, vdy[k] );
+        if( ID ) VI_STOREU( ID + k*stride, vid[k] );
+    }
+}
+
+/** The 3D version of worley2_jitter_block(), for Worley3_jitter() */
+SIMD_FN void SIMD_NAME(worley3_jitter_block)( const float *x, const float *y,
+                                              const float *z, float jitter,
+                                              int max_order, float *F,
+                                              float *dx, float *dy, float *dz,
+                                              unsigned int *ID, int stride )
+{
+    vfloat ax = V_LOADU( x );
+    vfloat ay = V_LOADU( y );
+    vfloat az = V_LOADU( z );
+    vint ix = V_TOINT( V_FLOOR( ax ) );
+    vint iy = V_TOINT( V_FLOOR( ay ) );
+    vint iz = V_TOINT( V_FLOOR( az ) );
+    vfloat vj = V_SET1( jitter );
+    vfloat vF[WORLEY2_MAX_ORDER], vdx[WORLEY2_MAX_ORDER], vdy[WORLEY2_MAX_ORDER];
+    vfloat vdz[WORLEY2_MAX_ORDER];
+    vint vid[WORLEY2_MAX_ORDER];
+    int ox, oy, oz, k;
+
+    for( k = 0; k < max_order; k++ ) {
+        vF[k] = V_SET1( 999999.9f );
+        vdx[k] = V_ZERO;
+        vdy[k] = V_ZERO;
+        vdz[k] = V_ZERO;
+        vid[k] = VI_SET1( 0 );
+    }
+
+    for( ox = -1; ox <= 1; ox++ ) {
+        for( oy = -1; oy <= 1; oy++ ) {
+            for( oz = -1; oz <= 1; oz++ ) {
+                vint cx = VI_ADD( ix, VI_SET1( ox ) );
+                vint cy = VI_ADD( iy, VI_SET1( oy ) );
+                vint cz = VI_ADD( iz, VI_SET1( oz ) );
+                vint seed = VI_ADD( VI_ADD( VI_MUL( cx, VI_SET1( 702395077 ) ),
+                                            VI_MUL( cy, VI_SET1( 915488749 ) ) ),
+                                    VI_MUL( cz, VI_SET1( 2120969693 ) ) );
+                vint id = seed;
+                vfloat ddx, ddy, ddz, d2;
+
+                seed = SIMD_NAME(vchurn)( seed );
+                ddx = V_SUB( V_ADD( V_ADD( VI_TOFLOAT( cx ), V_SET1( 0.5f ) ),
+                                    V_MUL( vj, V_SUB( SIMD_NAME(vseedunit)( seed ), V_SET1( 0.5f ) ) ) ),
+                             ax );
+                seed = SIMD_NAME(vchurn)( seed );
+                ddy = V_SUB( V_ADD( V_ADD( VI_TOFLOAT( cy ), V_SET1( 0.5f ) ),
+                                    V_MUL( vj, V_SUB( SIMD_NAME(vseedunit)( seed ), V_SET1( 0.5f ) ) ) ),
+                             ay );
+                seed = SIMD_NAME(vchurn)( seed );
+                ddz = V_SUB( V_ADD( V_ADD( VI_TOFLOAT( cz ), V_SET1( 0.5f ) ),
+                                    V_MUL( vj, V_SUB( SIMD_NAME(vseedunit)( seed ), V_SET1( 0.5f ) ) ) ),
+                             az );
+                d2 = V_ADD( V_ADD( V_MUL( ddx, ddx ), V_MUL( ddy, ddy ) ), V_MUL( ddz, ddz ) );
+
+                for( k = 0; k < max_order; k++ ) {
+                    vmask m = V_CMPLT( d2, vF[k] );
+                    vfloat t;
+                    vint ti;
+                    t = vF[k]; vF[k] = V_SEL( m, d2, t ); d2 = V_SEL( m, t, d2 );
+                    t = vdx[k]; vdx[k] = V_SEL( m, ddx, t ); ddx = V_SEL( m, t, ddx );
+                    t = vdy[k]; vdy[k] = V_SEL( m, ddy, t ); ddy = V_SEL( m, t, ddy );
+                    t = vdz[k]; vdz[k] = V_SEL( m, ddz, t ); ddz = V_SEL( m, t, ddz );
+                    ti = vid[k]; vid[k] = VI_SEL( m, id, ti ); id = VI_SEL( m, ti, id );
+                }
+            }
+        }
+    }
+
+    for( k = 0; k < max_order; k++ ) {
+        V_STOREU( F + k*stride, V_SQRT( vF[k] ) );
+        if( dx ) V_STOREU( dx + k*stride, vdx[k] );
+        if( dy ) V_STOREU( dy + k*stride, vdy[k] );
+        if( dz ) V_STOREU( dz + k*stride, vdz[k] );
+        if( ID ) VI_STOREU( ID + k*stride, vid[k] );
+    }
+}
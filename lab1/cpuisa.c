@@ -0,0 +1,87 @@
+/*
+ * Run-time detection of the SIMD instruction sets available on x86 CPUs.
+ * See cpuisa.h for details.
+ */
+
+#include "cpuisa.h"
+
+#if defined(CPUISA_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static int detected_isa = -1;
+static int isa_limit = ISA_AVX512;
+
+/*
+ * Any thread may call cpu_isa() first, so both of the above are read and
+ * written atomically. Relaxed order is enough: detection gives the same
+ * answer in every thread, so a race only means detecting twice. MSVC has
+ * no __atomic builtins, but aligned int accesses are atomic on x86, and
+ * volatile keeps the compiler from tearing or caching them.
+ */
+#if defined(__GNUC__)
+#define LOAD_RELAXED(v)     __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#define STORE_RELAXED(v, x) __atomic_store_n(&(v), x, __ATOMIC_RELAXED)
+#else
+#define LOAD_RELAXED(v)     (*(volatile int*)&(v))
+#define STORE_RELAXED(v, x) (*(volatile int*)&(v) = (x))
+#endif
+
+/*
+ * detect_isa() - Query the CPU. GCC and Clang have builtins for this which
+ * also check that the OS saves the wide registers on context switches.
+ * For MSVC, we have to do the CPUID and XGETBV dance ourselves.
+ */
+static int detect_isa(void) {
+#if defined(CPUISA_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return ISA_SSE41;
+    if (__builtin_cpu_supports("sse2")) return ISA_SSE2;
+    return ISA_SCALAR;
+#elif defined(CPUISA_X86) && defined(_MSC_VER)
+    int info[4];
+    unsigned long long xcr0 = 0;
+    int isa = ISA_SCALAR;
+
+    __cpuid(info, 1);
+    if (info[3] & (1<<26)) isa = ISA_SSE2;
+    if (info[2] & (1<<19)) isa = ISA_SSE41;
+    if (!(info[2] & (1<<27))) return isa; // No OSXSAVE, no AVX of any kind
+    xcr0 = _xgetbv(0);
+    if ((xcr0 & 0x06) != 0x06) return isa; // OS does not save YMM registers
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1<<5)) isa = ISA_AVX2;
+    if ((info[1] & (1<<16)) && (xcr0 & 0xe6) == 0xe6) isa = ISA_AVX512;
+    return isa;
+#else
+    return ISA_SCALAR;
+#endif
+}
+
+int cpu_isa(void) {
+    int isa = LOAD_RELAXED(detected_isa);
+    int limit = LOAD_RELAXED(isa_limit);
+
+    if (isa < 0) {
+        isa = detect_isa();
+        STORE_RELAXED(detected_isa, isa);
+    }
+    return isa < limit ? isa : limit;
+}
+
+void cpu_isa_limit(int maxisa) {
+    STORE_RELAXED(isa_limit, maxisa);
+}
+
+const char *cpu_isa_name(int isa) {
+    switch (isa) {
+        case ISA_SSE2:   return "SSE2";
+        case ISA_SSE41:  return "SSE4.1";
+        case ISA_AVX2:   return "AVX2";
+        case ISA_AVX512: return "AVX-512";
+        default:         return "scalar";
+    }
+}
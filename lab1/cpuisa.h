@@ -0,0 +1,45 @@
+/*
+ * Run-time detection of the SIMD instruction sets available on x86 CPUs.
+ * The batch noise functions use this to pick the widest kernel that the
+ * CPU (and the operating system) supports. The test is made once, on the
+ * first call, and the result is cached.
+ *
+ * On platforms other than x86, or with compilers that do not let us compile
+ * code for instruction sets beyond the baseline, this always returns
+ * ISA_SCALAR and the batch functions fall back to plain C loops.
+ */
+
+#ifndef CPUISA_H
+#define CPUISA_H
+
+#if (defined(__GNUC__) || defined(_MSC_VER)) && \
+    (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define CPUISA_X86 1
+#endif
+
+/* Instruction set levels, in increasing order of capability */
+#define ISA_SCALAR 0
+#define ISA_SSE2   1
+#define ISA_SSE41  2
+#define ISA_AVX2   3
+#define ISA_AVX512 4
+
+/*
+ * cpu_isa() - Return the best instruction set level supported by this CPU,
+ * capped by any limit set with cpu_isa_limit().
+ */
+int cpu_isa(void);
+
+/*
+ * cpu_isa_limit() - Cap the level returned by cpu_isa(). This is useful
+ * for testing and benchmarking the narrower kernels on a wider CPU.
+ * Pass ISA_AVX512 to remove the cap again.
+ */
+void cpu_isa_limit(int maxisa);
+
+/*
+ * cpu_isa_name() - A printable name for an instruction set level.
+ */
+const char *cpu_isa_name(int isa);
+
+#endif
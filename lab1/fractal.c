@@ -0,0 +1,217 @@
+/*
+ * Fractal sums of noise: fBm, turbulence and ridged multifractal.
+ * See fractal.h for the interface.
+ *
+ * The batch functions run all octaves for SIMD_W points in one kernel,
+ * from fractalsimd.h, which calls the 3D noise kernels of noise1234 and
+ * simplexnoise1234 on registers. The coordinates, the running sum and the
+ * ridge weights never leave the registers, and there is one dispatch per
+ * batch instead of one per octave. Without SIMD, the batch functions loop
+ * over the single point function.
+ *
+ * The early-out is based on an upper bound on what the remaining octaves
+ * can add: gain^i times the largest value a single octave term can take.
+ * Octaves at the end of the sum whose bounds add up to less than epsilon
+ * are never evaluated. The bound does not depend on the position, so the
+ * single point and batch functions always sum the same octaves.
+ */
+
+#include <math.h>
+#include "fractal.h"
+#include "noise1234.h"
+#include "simplexnoise1234.h"
+#include "noisegrad.h"
+#include "cpuisa.h"
+
+#define MODE_FBM    0
+#define MODE_TURB   1
+#define MODE_RIDGED 2
+
+#ifdef CPUISA_X86
+
+#define SIMD_ISA ISA_SSE2
+#include "simdlanes.h"
+#include "noise1234simd.h"
+#include "simplexnoise1234simd.h"
+#include "fractalsimd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX2
+#include "simdlanes.h"
+#include "noise1234simd.h"
+#include "simplexnoise1234simd.h"
+#include "fractalsimd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX512
+#include "simdlanes.h"
+#include "noise1234simd.h"
+#include "simplexnoise1234simd.h"
+#include "fractalsimd.h"
+#undef SIMD_ISA
+
+#endif // CPUISA_X86
+
+// The widest SIMD vector we have a kernel for
+#define FBATCH_MAXW 16
+
+void fractalInit(fractalParams *fp) {
+    fp->basis = FRACTAL_SIMPLEX;
+    fp->octaves = 8;
+    fp->lacunarity = 2.0f;
+    fp->gain = 0.5f;
+    fp->offset = 1.0f;
+    fp->epsilon = 0.0f;
+    fp->ctx = 0;
+}
+
+/*
+ * activeOctaves() - The number of octaves worth evaluating. Octaves are
+ * dropped from the end for as long as their combined amplitude bound
+ * stays below epsilon. A noise value is within [-1,1], so the term of one
+ * octave is bounded by 1 for fBm and turbulence, and by the largest of
+ * offset^2 and (offset-1)^2 for the ridged multifractal.
+ */
+static int activeOctaves(const fractalParams *fp, int mode) {
+    float peak = 1.0f;
+    float amp, tail = 0.0f;
+    int i, n = fp->octaves;
+
+    if (mode == MODE_RIDGED) {
+        float hi = fp->offset * fp->offset;
+        float lo = (fp->offset - 1.0f) * (fp->offset - 1.0f);
+        peak = hi > lo ? hi : lo;
+    }
+    if (fp->epsilon <= 0.0f) return n;
+
+    while (n > 0) {
+        // Amplitude of the last octave, gain^(n-1). This is computed from
+        // the start each time, since dividing by the gain on the way down
+        // goes wrong for a gain of 0.
+        amp = 1.0f;
+        for (i = 1; i < n; i++) amp *= fp->gain;
+        if ((tail + amp) * peak >= fp->epsilon) break;
+        tail += amp;
+        n--;
+    }
+    return n;
+}
+
+static const noiseContext *fractalContext(const fractalParams *fp) {
+    return fp->ctx ? fp->ctx : &noiseClassic;
+}
+
+static float noiseAt(const noiseContext *ctx, int basis, float x, float y, float z) {
+    return basis == FRACTAL_PERLIN ? noise3_ctx(ctx, x, y, z) : snoise3_ctx(ctx, x, y, z);
+}
+
+/*
+ * fractalPoint() - All three fractals for a single point.
+ */
+static float fractalPoint(const fractalParams *fp, int mode,
+                          float x, float y, float z) {
+    const noiseContext *ctx = fractalContext(fp);
+    int i, octaves = activeOctaves(fp, mode);
+    float freq = 1.0f, amp = 1.0f, sum = 0.0f, weight = 1.0f;
+    float n;
+
+    for (i = 0; i < octaves; i++) {
+        n = noiseAt(ctx, fp->basis, freq * x, freq * y, freq * z);
+        if (mode == MODE_FBM) {
+            sum += amp * n;
+        } else if (mode == MODE_TURB) {
+            sum += amp * fabsf(n);
+        } else {
+            n = fp->offset - fabsf(n);
+            n = n * n * weight;
+            sum += amp * n;
+            // Weight the next octave by this one, clamped to [0,1]
+            weight = n * 2.0f;
+            if (weight > 1.0f) weight = 1.0f;
+            if (weight <= 0.0f) break; // Nothing more can be added here
+        }
+        freq *= fp->lacunarity;
+        amp *= fp->gain;
+    }
+    return sum;
+}
+
+float fbm3(const fractalParams *fp, float x, float y, float z) {
+    return fractalPoint(fp, MODE_FBM, x, y, z);
+}
+
+float turbulence3(const fractalParams *fp, float x, float y, float z) {
+    return fractalPoint(fp, MODE_TURB, x, y, z);
+}
+
+float ridged3(const fractalParams *fp, float x, float y, float z) {
+    return fractalPoint(fp, MODE_RIDGED, x, y, z);
+}
+
+typedef void (*fblock_fn)(const noiseContext *ctx, const fractalParams *fp,
+                          int mode, int octaves, const float *x,
+                          const float *y, const float *z, float *out);
+
+/*
+ * Select the kernel for the best instruction set the CPU supports,
+ * and return its width in lanes, or 0 if there is no SIMD kernel.
+ * SSE4.1 has nothing to offer over SSE2 here, so it uses the SSE2 kernel.
+ */
+static int fractalKernel(fblock_fn *fb) {
+#ifdef CPUISA_X86
+    switch (cpu_isa()) {
+    case ISA_AVX512:
+        *fb = fractal_block_avx512;
+        return 16;
+    case ISA_AVX2:
+        *fb = fractal_block_avx2;
+        return 8;
+    case ISA_SSE41:
+    case ISA_SSE2:
+        *fb = fractal_block_sse2;
+        return 4;
+    }
+#endif
+    *fb = 0;
+    return 0;
+}
+
+/*
+ * fractalBatch() - All three fractals for n points.
+ */
+static void fractalBatch(const fractalParams *fp, int mode, const float *x,
+                         const float *y, const float *z, float *out, int n) {
+    const noiseContext *ctx = fractalContext(fp);
+    int octaves = activeOctaves(fp, mode);
+    fblock_fn fb;
+    int w = fractalKernel(&fb);
+    int i = 0, j;
+
+    if (w) {
+        float tx[FBATCH_MAXW] = {0.0f}, ty[FBATCH_MAXW] = {0.0f};
+        float tz[FBATCH_MAXW] = {0.0f}, res[FBATCH_MAXW];
+        for (; i + w <= n; i += w) fb(ctx, fp, mode, octaves, x+i, y+i, z+i, out+i);
+        if (i < n) {
+            for (j = 0; i + j < n; j++) { tx[j] = x[i+j]; ty[j] = y[i+j]; tz[j] = z[i+j]; }
+            fb(ctx, fp, mode, octaves, tx, ty, tz, res);
+            for (j = 0; i + j < n; j++) out[i+j] = res[j];
+        }
+        return;
+    }
+    for (; i < n; i++) out[i] = fractalPoint(fp, mode, x[i], y[i], z[i]);
+}
+
+void fbm3_batch(const fractalParams *fp, const float *x, const float *y,
+                const float *z, float *out, int n) {
+    fractalBatch(fp, MODE_FBM, x, y, z, out, n);
+}
+
+void turbulence3_batch(const fractalParams *fp, const float *x, const float *y,
+                       const float *z, float *out, int n) {
+    fractalBatch(fp, MODE_TURB, x, y, z, out, n);
+}
+
+void ridged3_batch(const fractalParams *fp, const float *x, const float *y,
+                   const float *z, float *out, int n) {
+    fractalBatch(fp, MODE_RIDGED, x, y, z, out, n);
+}
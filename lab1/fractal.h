@@ -0,0 +1,54 @@
+/*
+ * Fractal sums of noise: fBm, turbulence and ridged multifractal.
+ * These are the octave loops that every procedural texture ends up
+ * writing by hand, done once here on top of noise1234 and
+ * simplexnoise1234. The batch versions sum all octaves for a SIMD vector
+ * of points at a time in a single kernel, without storing anything but
+ * the finished sums.
+ */
+
+#ifndef FRACTAL_H
+#define FRACTAL_H
+
+#include "noisecontext.h"
+
+/* The noise function to build the fractal from */
+#define FRACTAL_PERLIN  0 /* noise3() from noise1234 */
+#define FRACTAL_SIMPLEX 1 /* snoise3() from simplexnoise1234 */
+
+/* Parameters for a fractal sum */
+typedef struct {
+    int basis;        // FRACTAL_PERLIN or FRACTAL_SIMPLEX
+    int octaves;      // Maximum number of octaves to sum
+    float lacunarity; // Frequency multiplier between octaves, usually 2.0
+    float gain;       // Amplitude multiplier between octaves, usually 0.5
+    float offset;     // Ridge level for ridged3(), usually 1.0
+    float epsilon;    // Skip the octaves whose total amplitude is below this
+    const noiseContext *ctx; // Noise context for all octaves, NULL for noiseClassic
+} fractalParams;
+
+/* Initialize a fractalParams struct to the usual values: simplex noise,
+   8 octaves, lacunarity 2, gain 0.5, offset 1, no early-out and the
+   classic permutation table. */
+void fractalInit(fractalParams *fp);
+
+/* Fractal Brownian motion: sum of gain^i * noise(lacunarity^i * p) */
+float fbm3(const fractalParams *fp, float x, float y, float z);
+
+/* Turbulence: like fBm, but summing |noise| for a billowy look */
+float turbulence3(const fractalParams *fp, float x, float y, float z);
+
+/* Ridged multifractal: (offset - |noise|)^2, with each octave weighted by
+   the one before it, so that detail accumulates along the ridges. */
+float ridged3(const fractalParams *fp, float x, float y, float z);
+
+/* Batch versions: out[i] = fbm3(fp, x[i], y[i], z[i]) for i = 0..n-1.
+   The output array must not overlap the input arrays. */
+void fbm3_batch(const fractalParams *fp, const float *x, const float *y,
+                const float *z, float *out, int n);
+void turbulence3_batch(const fractalParams *fp, const float *x, const float *y,
+                       const float *z, float *out, int n);
+void ridged3_batch(const fractalParams *fp, const float *x, const float *y,
+                   const float *z, float *out, int n);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * SIMD kernel for the batch versions of fbm3(), turbulence3() and
+ * ridged3(). This file is included several times from fractal.c, once
+ * for each instruction set, after simdlanes.h, noise1234simd.h and
+ * simplexnoise1234simd.h, which provide vnoise3() and vsnoise3().
+ *
+ * The kernel sums all octaves for SIMD_W points at once. The coordinates,
+ * the running sum and the ridge weights stay in registers from the first
+ * octave to the last, and only the finished sum is stored. The octave
+ * terms are computed with the same float operations as fractalPoint(),
+ * so the results differ from the single point functions only as much as
+ * the batch noise differs from the scalar noise.
+ */
+
+SIMD_FN void SIMD_NAME(fractal_block)( const noiseContext *ctx, const fractalParams *fp,
+                                       int mode, int octaves, const float *x,
+                                       const float *y, const float *z, float *out )
+{
+    vfloat vx = V_LOADU( x );
+    vfloat vy = V_LOADU( y );
+    vfloat vz = V_LOADU( z );
+    vfloat sum = V_ZERO;
+    vfloat weight = V_SET1( 1.0f );
+    vfloat n, f, a;
+    float freq = 1.0f, amp = 1.0f;
+    int i;
+
+    for( i = 0; i < octaves; i++ ) {
+        f = V_SET1( freq );
+        a = V_SET1( amp );
+        if( fp->basis == FRACTAL_PERLIN )
+            n = SIMD_NAME(vnoise3)( ctx, V_MUL( f, vx ), V_MUL( f, vy ), V_MUL( f, vz ) );
+        else
+            n = SIMD_NAME(vsnoise3)( ctx, V_MUL( f, vx ), V_MUL( f, vy ), V_MUL( f, vz ) );
+
+        if( mode == MODE_FBM ) {
+            sum = V_ADD( sum, V_MUL( a, n ) );
+        } else if( mode == MODE_TURB ) {
+            sum = V_ADD( sum, V_MUL( a, V_MAX( n, V_SUB( V_ZERO, n ) ) ) );
+        } else {
+            n = V_SUB( V_SET1( fp->offset ), V_MAX( n, V_SUB( V_ZERO, n ) ) );
+            n = V_MUL( V_MUL( n, n ), weight );
+            sum = V_ADD( sum, V_MUL( a, n ) );
+            // Weight the next octave by this one, clamped to [0,1]
+            weight = V_MIN( V_MAX( V_MUL( n, V_SET1( 2.0f ) ), V_ZERO ), V_SET1( 1.0f ) );
+            if( !VM_ANY( V_CMPGT( weight, V_ZERO ) ) ) break; // No lane can change any more
+        }
+        freq *= fp->lacunarity;
+        amp *= fp->gain;
+    }
+    V_STOREU( out, sum );
+}
@@ -0,0 +1,81 @@
+/*
+ * A bounded lock-free MPMC queue. See framequeue.h.
+ *
+ * The atomics are the GCC/Clang __atomic builtins, as in tilepool.c.
+ * A cell at position pos is free for the push of that position when its
+ * sequence number is pos, and holds the value for the pop of that
+ * position when it is pos+1. After the pop, it is set to pos+capacity,
+ * which makes it free for the push one lap later.
+ */
+
+#include <stdlib.h>
+#include "framequeue.h"
+
+int queueInit(frameQueue *q, int capacity) {
+    size_t n = 1, i;
+
+    while (n < (size_t)capacity) n *= 2;
+    q->cells = (queueCell*) malloc(n * sizeof(queueCell));
+    if (!q->cells) return 0;
+    for (i = 0; i < n; i++) q->cells[i].seq = i;
+    q->mask = n - 1;
+    q->head = 0;
+    q->tail = 0;
+    return 1;
+}
+
+void queueDelete(frameQueue *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+int queuePush(frameQueue *q, int value) {
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    queueCell *cell;
+    size_t seq;
+    long dif;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        dif = (long)seq - (long)pos;
+        if (dif == 0) {
+            // The cell is free for this lap, so try to claim the position
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            return 0; // The cell still holds a value from the last lap
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+    cell->value = value;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int queuePop(frameQueue *q, int *value) {
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    queueCell *cell;
+    size_t seq;
+    long dif;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        dif = (long)seq - (long)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            return 0; // Nothing has been pushed to this position yet
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    *value = cell->value;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return 1;
+}
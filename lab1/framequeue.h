@@ -0,0 +1,57 @@
+/*
+ * A bounded lock-free queue of small integers, for handing frame buffers
+ * between threads by their index in a pool of pre-allocated buffers.
+ * Any number of threads may push and pop at the same time. Neither
+ * operation ever blocks: a push to a full queue or a pop from an empty
+ * one just fails, and the caller decides whether to wait, retry or drop.
+ *
+ * This is Dmitry Vyukov's bounded MPMC queue: each cell carries a sequence
+ * number that says whether it is ready to be written or read for the
+ * current lap around the ring, so the threads only contend on the head or
+ * the tail index, with one compare-and-swap per operation.
+ */
+
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t seq;
+    int value;
+} queueCell;
+
+/* A queue. The head and the tail are on separate cache lines, so that
+   pushing and popping threads don't slow each other down. */
+typedef struct {
+    queueCell *cells;
+    size_t mask;       // Capacity - 1, the capacity is a power of two
+    char pad0[64];
+    size_t head;       // Next position to push to
+    char pad1[64];
+    size_t tail;       // Next position to pop from
+    char pad2[64];
+} frameQueue;
+
+/* Set up an empty queue for at least capacity values. Returns 0 if out of
+   memory. */
+int queueInit(frameQueue *q, int capacity);
+
+/* Free the memory of a queue */
+void queueDelete(frameQueue *q);
+
+/* Add a value at the head. Returns 0 if the queue is full. */
+int queuePush(frameQueue *q, int value);
+
+/* Take the oldest value from the tail. Returns 0 if the queue is empty. */
+int queuePop(frameQueue *q, int *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Writing of shaded frames to files or pipes. See framewrite.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "framewrite.h"
+
+/*
+ * yuvBytes() - the size of a 4:2:0 y4m frame, without the FRAME line
+ */
+static size_t yuvBytes(int size) {
+    size_t cw = (size + 1)/2;
+
+    return (size_t)size*size + 2*cw*cw;
+}
+
+/*
+ * gcd() - for the frame rate of a y4m stream, as a ratio
+ */
+static long gcd(long a, long b) {
+    while (b) {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * patternNumbers() - the number of frame numbers in a file name pattern,
+ * or -1 if it has a conversion that isn't %d or %0Nd. Since the pattern
+ * goes to snprintf() as the format, anything else would be undefined.
+ */
+static int patternNumbers(const char *pattern) {
+    const char *p;
+    int count = 0;
+
+    for (p = pattern; *p; p++) {
+        if (*p != '%') continue;
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p != 'd') return -1;
+        count++;
+    }
+    return count;
+}
+
+int writerOpen(frameWriter *w, const char *name, int size, int frames, double dt) {
+    const char *ext = strrchr(name, '.');
+    long num, den, g;
+    int numbers;
+
+    memset(w, 0, sizeof(frameWriter));
+    w->size = size;
+    w->pattern = name;
+    w->blue = 2;
+    if (!strcmp(name, "-") || (ext && !strcmp(ext, ".y4m"))) {
+        w->format = WRITE_Y4M;
+    } else if (ext && !strcmp(ext, ".ppm")) {
+        w->format = WRITE_PPM;
+    } else if (ext && !strcmp(ext, ".tga")) {
+        w->format = WRITE_TGA;
+        w->blue = 0;
+        if (size > 65535) {
+            fprintf(stderr, "TGA can't be larger than 65535 pixels\n");
+            return 0;
+        }
+    } else {
+        fprintf(stderr, "Unknown output %s, it should end in .tga, .ppm or .y4m, or be -\n", name);
+        return 0;
+    }
+    if (w->format != WRITE_Y4M) {
+        numbers = patternNumbers(name);
+        if (numbers < 0 || numbers > 1) {
+            fprintf(stderr, "The name %s should have one %%d or %%0Nd for the frame number,"
+                    " and no other %% but %%%%\n", name);
+            return 0;
+        }
+        if (numbers == 0 && frames > 1) {
+            fprintf(stderr, "The name %s has no %%d for the frame number,"
+                    " so every frame would overwrite the last\n", name);
+            return 0;
+        }
+    }
+
+    if (w->format == WRITE_PPM) {
+        w->scratch = (unsigned char*) malloc((size_t)size*3);
+        if (!w->scratch) {
+            fprintf(stderr, "Out of memory for a PPM row\n");
+            writerClose(w);
+            return 0;
+        }
+    }
+    if (w->format == WRITE_Y4M) {
+        w->scratch = (unsigned char*) malloc(yuvBytes(size));
+        if (!w->scratch) {
+            fprintf(stderr, "Out of memory for a y4m frame\n");
+            writerClose(w);
+            return 0;
+        }
+        if (!strcmp(name, "-")) {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            w->file = stdout;
+        } else {
+            w->file = fopen(name, "wb");
+            if (!w->file) {
+                perror(name);
+                writerClose(w);
+                return 0;
+            }
+        }
+        // The frame rate as a ratio of integers: a whole number of frames
+        // per second if it is one, like 60 for a dt of 1/60, or else to
+        // the microsecond
+        num = (long)floor(1.0/dt + 0.5);
+        if (num >= 1 && fabs(num*dt - 1.0) < 1e-6) {
+            den = 1;
+        } else {
+            num = 1000000;
+            den = (long)floor(dt*num + 0.5);
+            if (den < 1) den = 1;
+            g = gcd(num, den);
+            num /= g;
+            den /= g;
+        }
+        fprintf(w->file, "YUV4MPEG2 W%d H%d F%ld:%ld Ip A1:1 C420jpeg\n", size, size, num, den);
+    }
+    return 1;
+}
+
+/*
+ * toYUV() - convert a frame to the planes of a 4:2:0 y4m frame, BT.601
+ * with studio range, from the top row down. Each chroma sample is the
+ * mean of a 2x2 block, or less at odd edges, as C420jpeg says.
+ */
+static void toYUV(const unsigned char *pixels, int size, int blue, unsigned char *planes) {
+    int red = 2 - blue;
+    int cw = (size + 1)/2;
+    unsigned char *Y = planes, *U = planes + (size_t)size*size, *V = U + (size_t)cw*cw;
+    const unsigned char *p;
+    int i, j, ci, cj, r, g, b, n;
+
+    for (j = 0; j < size; j++) {
+        p = pixels + (size_t)(size - 1 - j)*size*4;
+        for (i = 0; i < size; i++, p += 4)
+            *Y++ = ((66*p[red] + 129*p[1] + 25*p[blue] + 128) >> 8) + 16;
+    }
+    for (cj = 0; cj < cw; cj++) {
+        for (ci = 0; ci < cw; ci++) {
+            r = g = b = n = 0;
+            for (j = 2*cj; j < 2*cj + 2 && j < size; j++) {
+                p = pixels + ((size_t)(size - 1 - j)*size + 2*ci)*4;
+                for (i = 2*ci; i < 2*ci + 2 && i < size; i++, p += 4) {
+                    r += p[red];
+                    g += p[1];
+                    b += p[blue];
+                    n++;
+                }
+            }
+            r = (r + n/2)/n;
+            g = (g + n/2)/n;
+            b = (b + n/2)/n;
+            // The offset of 128*256 keeps the shifts on positive numbers
+            *U++ = (-38*r - 74*g + 112*b + 128 + 32768) >> 8;
+            *V++ = (112*r - 94*g - 18*b + 128 + 32768) >> 8;
+        }
+    }
+}
+
+int writerFrame(frameWriter *w, const unsigned char *pixels, int frame) {
+    int size = w->size;
+    size_t bytes = (size_t)size*size*4;
+    unsigned char header[18];
+    char name[1024];
+    const unsigned char *p;
+    unsigned char *q;
+    FILE *f;
+    int i, j, ok;
+
+    if (w->format == WRITE_Y4M) {
+        toYUV(pixels, size, w->blue, w->scratch);
+        ok = fputs("FRAME\n", w->file) >= 0
+            && fwrite(w->scratch, 1, yuvBytes(size), w->file) == yuvBytes(size);
+        if (!ok) perror("Writing the y4m stream");
+        return ok;
+    }
+
+    snprintf(name, sizeof(name), w->pattern, frame);
+    f = fopen(name, "wb");
+    if (!f) {
+        perror(name);
+        return 0;
+    }
+    if (w->format == WRITE_TGA) {
+        // Uncompressed true color, with 8 bits of alpha and the origin at
+        // the bottom left, so the frame is the image data as it is
+        memset(header, 0, sizeof(header));
+        header[2] = 2;
+        header[12] = size & 255;
+        header[13] = size >> 8;
+        header[14] = size & 255;
+        header[15] = size >> 8;
+        header[16] = 32;
+        header[17] = 8;
+        ok = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+            && fwrite(pixels, 1, bytes, f) == bytes;
+    } else {
+        ok = fprintf(f, "P6\n%d %d\n255\n", size, size) > 0;
+        for (j = size - 1; ok && j >= 0; j--) {
+            p = pixels + (size_t)j*size*4;
+            q = w->scratch;
+            for (i = 0; i < size; i++, p += 4, q += 3) {
+                q[0] = p[2 - w->blue];
+                q[1] = p[1];
+                q[2] = p[w->blue];
+            }
+            ok = fwrite(w->scratch, 3, size, f) == (size_t)size;
+        }
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) perror(name);
+    return ok;
+}
+
+void writerClose(frameWriter *w) {
+    if (w->file && w->file != stdout) fclose(w->file);
+    else if (w->file) fflush(w->file);
+    w->file = NULL;
+    free(w->scratch);
+    w->scratch = NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ * Writing of shaded frames to files or pipes, for rendering without a
+ * display. A frame is size x size pixels of 4 bytes, in the layout the
+ * shading kernel writes, with row 0 at the bottom like a GL texture.
+ *
+ * The kind of output is picked from the name:
+ *   name%04d.tga  a TGA file per frame, 32 bit BGRA, bottom-up
+ *   name%04d.ppm  a binary PPM file per frame, RGB
+ *   name.y4m      a YUV4MPEG2 stream, 4:2:0 BT.601, for video encoders
+ *   -             the same YUV4MPEG2 stream on stdout
+ * The file names are printf patterns with the frame number, with exactly
+ * one %d or %0Nd, and %% for a percent sign. A single frame may also go
+ * to a plain name.
+ *
+ * A TGA file is written straight from the frame with a single fwrite(),
+ * since a bottom-up 32 bit TGA is the same bytes as a BGRA frame, which the
+ * kernel writes when asked to. PPM drops the alpha and goes from the top,
+ * and y4m converts to YUV, so those go through a buffer that is allocated
+ * once.
+ */
+
+#ifndef FRAMEWRITE_H
+#define FRAMEWRITE_H
+
+#include <stdio.h>
+
+#define WRITE_TGA 0
+#define WRITE_PPM 1
+#define WRITE_Y4M 2
+
+/* A struct to hold an output and what it needs */
+typedef struct {
+    int format;             // One of WRITE_TGA, WRITE_PPM or WRITE_Y4M
+    int size;               // Width and height of the frames
+    int blue;               // Byte offset of blue the writer wants, 0 for BGRA, 2 for RGBA
+    const char *pattern;    // File name pattern, for a file per frame
+    FILE *file;             // The stream, for y4m
+    unsigned char *scratch; // A row of RGB for PPM, or the planes of a y4m frame
+} frameWriter;
+
+/* Set up an output by the name, see above, for the given number of frames
+   dt seconds apart. Returns 0 and prints why on stderr if it can't. */
+int writerOpen(frameWriter *w, const char *name, int size, int frames, double dt);
+
+/* Write a frame, numbered frame for a file per frame. The pixels must have
+   blue at byte w->blue. Returns 0 and prints why on stderr on failure. */
+int writerFrame(frameWriter *w, const unsigned char *pixels, int frame);
+
+/* Finish the output */
+void writerClose(frameWriter *w);
+
+#endif
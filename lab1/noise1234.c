@@ -38,9 +38,14 @@
 
 
 #include	"noise1234.h"
+#include	"noisegrad.h"
+#include	"cpuisa.h"
+#include	<stdlib.h>
 
 // This is the new and improved, C(2) continuous interpolant
 #define FADE(t) ( t * t * t * ( t * ( t * 6 - 15 ) + 10 ) )
+// ...and its derivative, for the noise functions with analytic derivatives
+#define DFADE(t) ( 30 * t * t * ( t * ( t - 2 ) + 1 ) )
 
 #define FASTFLOOR(x) ( ((x)<(int)(x)) ? ((int)(x)-1) : ((int)(x)) )
 #define LERP(t, a, b) ((a) + (t)*((b)-(a)))
@@ -114,33 +119,59 @@ unsigned char perm[] = {151,160,137,91,90,15,
  * float SLnoise = (noise3(x,y,z) + 1.0) * 0.5;
  */
 
+/*
+ * The gradients are looked up in the tables from noisegrad.h rather than
+ * decoded from the hash bits with ternaries, which keeps these free of
+ * branches. The tables hold the same gradients as the decoding did:
+ * grad1: 1.0, 2.0, ..., 8.0 with a random sign, from the low 4 bits
+ * grad2: 8 directions (+/-1, +/-2) and (+/-2, +/-1), from the low 3 bits
+ * grad3: 12 cube edge midpoints, with 4 repeats, from the low 4 bits
+ * grad4: 32 hypercube edge midpoints, from the low 5 bits
+ */
+
 float grad1( int hash, float x ) {
-    int h = hash & 15;
-    float grad = 1.0f + (h & 7);  // Gradient value 1.0, 2.0, ..., 8.0
-    if (h&8) grad = -grad;         // and a random sign for the gradient
-    return ( grad * x );           // Multiply the gradient with the distance
+    return noiseGrad1[hash & 15] * x;
 }
 
 float grad2( int hash, float x, float y ) {
-    int h = hash & 7;      // Convert low 3 bits of hash code
-    float u = h<4 ? x : y;  // into 8 simple gradient directions,
-    float v = h<4 ? y : x;  // and compute the dot product with (x,y).
-    return ((h&1)? -u : u) + ((h&2)? -2.0f*v : 2.0f*v);
+    int h = hash & 15;
+    return noiseGrad2[0][h] * x + noiseGrad2[1][h] * y;
 }
 
 float grad3( int hash, float x, float y , float z ) {
-    int h = hash & 15;     // Convert low 4 bits of hash code into 12 simple
-    float u = h<8 ? x : y; // gradient directions, and compute dot product.
-    float v = h<4 ? y : h==12||h==14 ? x : z; // Fix repeats at h = 12 to 15
-    return ((h&1)? -u : u) + ((h&2)? -v : v);
+    int h = hash & 15;
+    return noiseGrad3[0][h] * x + noiseGrad3[1][h] * y + noiseGrad3[2][h] * z;
 }
 
 float grad4( int hash, float x, float y, float z, float t ) {
-    int h = hash & 31;      // Convert low 5 bits of hash code into 32 simple
-    float u = h<24 ? x : y; // gradient directions, and compute dot product.
-    float v = h<16 ? y : z;
-    float w = h<8 ? z : t;
-    return ((h&1)? -u : u) + ((h&2)? -v : v) + ((h&4)? -w : w);
+    int h = hash & 31;
+    return noiseGrad4[0][h] * x + noiseGrad4[1][h] * y
+         + noiseGrad4[2][h] * z + noiseGrad4[3][h] * t;
+}
+
+/*
+ * Wrap lattice coordinate i to 0..period-1. The quotient from the float
+ * multiply can be off by one, which the two tests correct. The SIMD
+ * kernels do exactly the same, so they wrap to the same coordinate.
+ */
+static int tile_wrap( int i, int period, float inv )
+{
+    int w = i - FASTFLOOR( (float)i * inv ) * period;
+    if( w < 0 ) w += period;
+    else if( w >= period ) w -= period;
+    return w;
+}
+
+/*
+ * Wrap lattice coordinate i to 0..period-1 for the hash of a context:
+ * with the mask for a permutation table, or like tile_wrap() for the
+ * mod 289 hash, which is what the SIMD kernels do as well.
+ */
+static int lattice_wrap( const noiseContext *ctx, int i )
+{
+    if( ctx->hash == NOISE_HASH_MOD289 )
+        return tile_wrap( i, NOISE_PERIOD_MOD289, 1.0f / NOISE_PERIOD_MOD289 );
+    return i & ctx->mask;
 }
 
 //---------------------------------------------------------------------
@@ -165,6 +196,21 @@ float noise1( float x )
     return 0.188f * ( LERP( s, n0, n1 ) );
 }
 
+//---------------------------------------------------------------------
+/*
+ * Wrap lattice coordinate i to 0..p-1 for the periodic noise functions,
+ * and return the wrapped coordinate of the next lattice point in *inext.
+ * That is one remainder per axis, rather than one per corner, and unlike
+ * a plain %, it also wraps negative coordinates the right way.
+ */
+static int pwrap( int i, int p, int *inext )
+{
+    i = i % p;
+    if( i < 0 ) i += p;
+    *inext = ( i + 1 == p ) ? 0 : i + 1;
+    return i;
+}
+
 //---------------------------------------------------------------------
 /** 1D float Perlin periodic noise, SL "pnoise()"
  */
@@ -177,8 +223,9 @@ float pnoise1( float x, int px )
     ix0 = FASTFLOOR( x ); // Integer part of x
     fx0 = x - ix0;       // Fractional part of x
     fx1 = fx0 - 1.0f;
-    ix1 = (( ix0 + 1 ) % px) & 0xff; // Wrap to 0..px-1 *and* wrap to 0..255
-    ix0 = ( ix0 % px ) & 0xff;      // (because px might be greater than 256)
+    ix0 = pwrap( ix0, px, &ix1 ); // Wrap to 0..px-1
+    ix1 = ix1 & 0xff;             // *and* wrap to 0..255
+    ix0 = ix0 & 0xff;             // (because px might be greater than 256)
 
     s = FADE( fx0 );
 
@@ -189,10 +236,11 @@ float pnoise1( float x, int px )
 
 
 //---------------------------------------------------------------------
-/** 2D float Perlin noise.
+/** 2D float Perlin noise, using the permutation table of a noise context.
  */
-float noise2( float x, float y )
+float noise2_ctx( const noiseContext *ctx, float x, float y )
 {
+    const int *pp = ctx->perm;
     int ix0, iy0, ix1, iy1;
     float fx0, fy0, fx1, fy1;
     float s, t, nx0, nx1, n0, n1;
@@ -203,25 +251,30 @@ float noise2( float x, float y )
     fy0 = y - iy0;        // Fractional part of y
     fx1 = fx0 - 1.0f;
     fy1 = fy0 - 1.0f;
-    ix1 = (ix0 + 1) & 0xff;  // Wrap to 0..255
-    iy1 = (iy0 + 1) & 0xff;
-    ix0 = ix0 & 0xff;
-    iy0 = iy0 & 0xff;
+    ix1 = lattice_wrap( ctx, ix0 + 1 );  // Wrap to 0..period-1
+    iy1 = lattice_wrap( ctx, iy0 + 1 );
+    ix0 = lattice_wrap( ctx, ix0 );
+    iy0 = lattice_wrap( ctx, iy0 );
     
     t = FADE( fy0 );
     s = FADE( fx0 );
 
-    nx0 = grad2(perm[ix0 + perm[iy0]], fx0, fy0);
-    nx1 = grad2(perm[ix0 + perm[iy1]], fx0, fy1);
+    nx0 = grad2(pp[ix0 + pp[iy0]], fx0, fy0);
+    nx1 = grad2(pp[ix0 + pp[iy1]], fx0, fy1);
     n0 = LERP( t, nx0, nx1 );
 
-    nx0 = grad2(perm[ix1 + perm[iy0]], fx1, fy0);
-    nx1 = grad2(perm[ix1 + perm[iy1]], fx1, fy1);
+    nx0 = grad2(pp[ix1 + pp[iy0]], fx1, fy0);
+    nx1 = grad2(pp[ix1 + pp[iy1]], fx1, fy1);
     n1 = LERP(t, nx0, nx1);
 
     return 0.507f * ( LERP( s, n0, n1 ) );
 }
 
+float noise2( float x, float y )
+{
+    return noise2_ctx( &noiseClassic, x, y );
+}
+
 //---------------------------------------------------------------------
 /** 2D float Perlin periodic noise.
  */
@@ -237,10 +290,12 @@ float pnoise2( float x, float y, int px, int py )
     fy0 = y - iy0;        // Fractional part of y
     fx1 = fx0 - 1.0f;
     fy1 = fy0 - 1.0f;
-    ix1 = (( ix0 + 1 ) % px) & 0xff;  // Wrap to 0..px-1 and wrap to 0..255
-    iy1 = (( iy0 + 1 ) % py) & 0xff;  // Wrap to 0..py-1 and wrap to 0..255
-    ix0 = ( ix0 % px ) & 0xff;
-    iy0 = ( iy0 % py ) & 0xff;
+    ix0 = pwrap( ix0, px, &ix1 ); // Wrap to 0..px-1
+    iy0 = pwrap( iy0, py, &iy1 ); // Wrap to 0..py-1
+    ix1 = ix1 & 0xff;             // and wrap to 0..255
+    iy1 = iy1 & 0xff;
+    ix0 = ix0 & 0xff;
+    iy0 = iy0 & 0xff;
     
     t = FADE( fy0 );
     s = FADE( fx0 );
@@ -258,10 +313,11 @@ float pnoise2( float x, float y, int px, int py )
 
 
 //---------------------------------------------------------------------
-/** 3D float Perlin noise.
+/** 3D float Perlin noise, using the permutation table of a noise context.
  */
-float noise3( float x, float y, float z )
+float noise3_ctx( const noiseContext *ctx, float x, float y, float z )
 {
+    const int *pp = ctx->perm;
     int ix0, iy0, ix1, iy1, iz0, iz1;
     float fx0, fy0, fz0, fx1, fy1, fz1;
     float s, t, r;
@@ -276,33 +332,33 @@ float noise3( float x, float y, float z )
     fx1 = fx0 - 1.0f;
     fy1 = fy0 - 1.0f;
     fz1 = fz0 - 1.0f;
-    ix1 = ( ix0 + 1 ) & 0xff; // Wrap to 0..255
-    iy1 = ( iy0 + 1 ) & 0xff;
-    iz1 = ( iz0 + 1 ) & 0xff;
-    ix0 = ix0 & 0xff;
-    iy0 = iy0 & 0xff;
-    iz0 = iz0 & 0xff;
+    ix1 = lattice_wrap( ctx, ix0 + 1 ); // Wrap to 0..period-1
+    iy1 = lattice_wrap( ctx, iy0 + 1 );
+    iz1 = lattice_wrap( ctx, iz0 + 1 );
+    ix0 = lattice_wrap( ctx, ix0 );
+    iy0 = lattice_wrap( ctx, iy0 );
+    iz0 = lattice_wrap( ctx, iz0 );
     
     r = FADE( fz0 );
     t = FADE( fy0 );
     s = FADE( fx0 );
 
-    nxy0 = grad3(perm[ix0 + perm[iy0 + perm[iz0]]], fx0, fy0, fz0);
-    nxy1 = grad3(perm[ix0 + perm[iy0 + perm[iz1]]], fx0, fy0, fz1);
+    nxy0 = grad3(pp[ix0 + pp[iy0 + pp[iz0]]], fx0, fy0, fz0);
+    nxy1 = grad3(pp[ix0 + pp[iy0 + pp[iz1]]], fx0, fy0, fz1);
     nx0 = LERP( r, nxy0, nxy1 );
 
-    nxy0 = grad3(perm[ix0 + perm[iy1 + perm[iz0]]], fx0, fy1, fz0);
-    nxy1 = grad3(perm[ix0 + perm[iy1 + perm[iz1]]], fx0, fy1, fz1);
+    nxy0 = grad3(pp[ix0 + pp[iy1 + pp[iz0]]], fx0, fy1, fz0);
+    nxy1 = grad3(pp[ix0 + pp[iy1 + pp[iz1]]], fx0, fy1, fz1);
     nx1 = LERP( r, nxy0, nxy1 );
 
     n0 = LERP( t, nx0, nx1 );
 
-    nxy0 = grad3(perm[ix1 + perm[iy0 + perm[iz0]]], fx1, fy0, fz0);
-    nxy1 = grad3(perm[ix1 + perm[iy0 + perm[iz1]]], fx1, fy0, fz1);
+    nxy0 = grad3(pp[ix1 + pp[iy0 + pp[iz0]]], fx1, fy0, fz0);
+    nxy1 = grad3(pp[ix1 + pp[iy0 + pp[iz1]]], fx1, fy0, fz1);
     nx0 = LERP( r, nxy0, nxy1 );
 
-    nxy0 = grad3(perm[ix1 + perm[iy1 + perm[iz0]]], fx1, fy1, fz0);
-    nxy1 = grad3(perm[ix1 + perm[iy1 + perm[iz1]]], fx1, fy1, fz1);
+    nxy0 = grad3(pp[ix1 + pp[iy1 + pp[iz0]]], fx1, fy1, fz0);
+    nxy1 = grad3(pp[ix1 + pp[iy1 + pp[iz1]]], fx1, fy1, fz1);
     nx1 = LERP( r, nxy0, nxy1 );
 
     n1 = LERP( t, nx0, nx1 );
@@ -310,6 +366,11 @@ float noise3( float x, float y, float z )
     return 0.936f * ( LERP( s, n0, n1 ) );
 }
 
+float noise3( float x, float y, float z )
+{
+    return noise3_ctx( &noiseClassic, x, y, z );
+}
+
 //---------------------------------------------------------------------
 /** 3D float Perlin periodic noise.
  */
@@ -329,12 +390,15 @@ float pnoise3( float x, float y, float z, int px, int py, int pz )
     fx1 = fx0 - 1.0f;
     fy1 = fy0 - 1.0f;
     fz1 = fz0 - 1.0f;
-    ix1 = (( ix0 + 1 ) % px ) & 0xff; // Wrap to 0..px-1 and wrap to 0..255
-    iy1 = (( iy0 + 1 ) % py ) & 0xff; // Wrap to 0..py-1 and wrap to 0..255
-    iz1 = (( iz0 + 1 ) % pz ) & 0xff; // Wrap to 0..pz-1 and wrap to 0..255
-    ix0 = ( ix0 % px ) & 0xff;
-    iy0 = ( iy0 % py ) & 0xff;
-    iz0 = ( iz0 % pz ) & 0xff;
+    ix0 = pwrap( ix0, px, &ix1 ); // Wrap to 0..px-1
+    iy0 = pwrap( iy0, py, &iy1 ); // Wrap to 0..py-1
+    iz0 = pwrap( iz0, pz, &iz1 ); // Wrap to 0..pz-1
+    ix1 = ix1 & 0xff;             // and wrap to 0..255
+    iy1 = iy1 & 0xff;
+    iz1 = iz1 & 0xff;
+    ix0 = ix0 & 0xff;
+    iy0 = iy0 & 0xff;
+    iz0 = iz0 & 0xff;
     
     r = FADE( fz0 );
     t = FADE( fy0 );
@@ -365,11 +429,112 @@ float pnoise3( float x, float y, float z, int px, int py, int pz )
 
 
 //---------------------------------------------------------------------
-/** 4D float Perlin noise.
+/** 3D float Perlin noise with analytic derivatives.
+ * Returns the same value as noise3(), and the gradient of that value
+ * in (*dnoise_dx, *dnoise_dy, *dnoise_dz), from one lattice traversal.
+ * The gradient is that of the trilinear blend of the eight corner
+ * gradient ramps, differentiated through FADE() with the chain rule.
  */
+float noise3_deriv_ctx( const noiseContext *ctx, float x, float y, float z,
+                        float *dnoise_dx, float *dnoise_dy, float *dnoise_dz )
+{
+    const int *pp = ctx->perm;
+    int ix0, iy0, ix1, iy1, iz0, iz1;
+    float fx0, fy0, fz0, fx1, fy1, fz1;
+    float s, t, r, ds, dt, dr;
+    float nxy0, nxy1, nx0, nx1, n0, n1;
+    float n[2][2][2], g[2][2][2][3];
+    float k1, k2, k3, k4, k5, k6, k7;
+    int a, b, c, h;
 
-float noise4( float x, float y, float z, float w )
+    ix0 = FASTFLOOR( x ); // Integer part of x
+    iy0 = FASTFLOOR( y ); // Integer part of y
+    iz0 = FASTFLOOR( z ); // Integer part of z
+    fx0 = x - ix0;        // Fractional part of x
+    fy0 = y - iy0;        // Fractional part of y
+    fz0 = z - iz0;        // Fractional part of z
+    fx1 = fx0 - 1.0f;
+    fy1 = fy0 - 1.0f;
+    fz1 = fz0 - 1.0f;
+    ix1 = lattice_wrap( ctx, ix0 + 1 ); // Wrap to 0..period-1
+    iy1 = lattice_wrap( ctx, iy0 + 1 );
+    iz1 = lattice_wrap( ctx, iz0 + 1 );
+    ix0 = lattice_wrap( ctx, ix0 );
+    iy0 = lattice_wrap( ctx, iy0 );
+    iz0 = lattice_wrap( ctx, iz0 );
+
+    r = FADE( fz0 );
+    t = FADE( fy0 );
+    s = FADE( fx0 );
+    dr = DFADE( fz0 );
+    dt = DFADE( fy0 );
+    ds = DFADE( fx0 );
+
+    // The gradient at each corner, and its dot product with the offset
+    for( a = 0; a < 2; a++ ) for( b = 0; b < 2; b++ ) for( c = 0; c < 2; c++ ) {
+        h = pp[(a ? ix1 : ix0) + pp[(b ? iy1 : iy0) + pp[c ? iz1 : iz0]]];
+        g[a][b][c][0] = grad3( h, 1.0f, 0.0f, 0.0f );
+        g[a][b][c][1] = grad3( h, 0.0f, 1.0f, 0.0f );
+        g[a][b][c][2] = grad3( h, 0.0f, 0.0f, 1.0f );
+        n[a][b][c] = grad3( h, a ? fx1 : fx0, b ? fy1 : fy0, c ? fz1 : fz0 );
+    }
+
+    // The value, with the same LERP() nesting as noise3()
+    nxy0 = n[0][0][0];
+    nxy1 = n[0][0][1];
+    nx0 = LERP( r, nxy0, nxy1 );
+    nxy0 = n[0][1][0];
+    nxy1 = n[0][1][1];
+    nx1 = LERP( r, nxy0, nxy1 );
+    n0 = LERP( t, nx0, nx1 );
+    nxy0 = n[1][0][0];
+    nxy1 = n[1][0][1];
+    nx0 = LERP( r, nxy0, nxy1 );
+    nxy0 = n[1][1][0];
+    nxy1 = n[1][1][1];
+    nx1 = LERP( r, nxy0, nxy1 );
+    n1 = LERP( t, nx0, nx1 );
+
+    // The blend written as a polynomial in s, t and r, for the derivatives:
+    // n = n000 + k1*s + k2*t + k3*r + k4*s*t + k5*t*r + k6*r*s + k7*s*t*r
+    k1 = n[1][0][0] - n[0][0][0];
+    k2 = n[0][1][0] - n[0][0][0];
+    k3 = n[0][0][1] - n[0][0][0];
+    k4 = n[0][0][0] - n[1][0][0] - n[0][1][0] + n[1][1][0];
+    k5 = n[0][0][0] - n[0][1][0] - n[0][0][1] + n[0][1][1];
+    k6 = n[0][0][0] - n[1][0][0] - n[0][0][1] + n[1][0][1];
+    k7 = - n[0][0][0] + n[1][0][0] + n[0][1][0] - n[1][1][0]
+         + n[0][0][1] - n[1][0][1] - n[0][1][1] + n[1][1][1];
+
+    // Each corner ramp contributes its gradient, weighted like its value
+    *dnoise_dx = *dnoise_dy = *dnoise_dz = 0.0f;
+    for( a = 0; a < 2; a++ ) for( b = 0; b < 2; b++ ) for( c = 0; c < 2; c++ ) {
+        float wt = ( a ? s : 1.0f - s ) * ( b ? t : 1.0f - t ) * ( c ? r : 1.0f - r );
+        *dnoise_dx += wt * g[a][b][c][0];
+        *dnoise_dy += wt * g[a][b][c][1];
+        *dnoise_dz += wt * g[a][b][c][2];
+    }
+    // ...and the blend weights themselves vary with position
+    *dnoise_dx = 0.936f * ( *dnoise_dx + ds * ( k1 + k4 * t + k6 * r + k7 * t * r ) );
+    *dnoise_dy = 0.936f * ( *dnoise_dy + dt * ( k2 + k4 * s + k5 * r + k7 * s * r ) );
+    *dnoise_dz = 0.936f * ( *dnoise_dz + dr * ( k3 + k5 * t + k6 * s + k7 * s * t ) );
+
+    return 0.936f * ( LERP( s, n0, n1 ) );
+}
+
+float noise3_deriv( float x, float y, float z,
+                    float *dnoise_dx, float *dnoise_dy, float *dnoise_dz )
 {
+    return noise3_deriv_ctx( &noiseClassic, x, y, z, dnoise_dx, dnoise_dy, dnoise_dz );
+}
+
+//---------------------------------------------------------------------
+/** 4D float Perlin noise, using the permutation table of a noise context.
+ */
+
+float noise4_ctx( const noiseContext *ctx, float x, float y, float z, float w )
+{
+    const int *pp = ctx->perm;
     int ix0, iy0, iz0, iw0, ix1, iy1, iz1, iw1;
     float fx0, fy0, fz0, fw0, fx1, fy1, fz1, fw1;
     float s, t, r, q;
@@ -387,58 +552,58 @@ float noise4( float x, float y, float z, float w )
     fy1 = fy0 - 1.0f;
     fz1 = fz0 - 1.0f;
     fw1 = fw0 - 1.0f;
-    ix1 = ( ix0 + 1 ) & 0xff;  // Wrap to 0..255
-    iy1 = ( iy0 + 1 ) & 0xff;
-    iz1 = ( iz0 + 1 ) & 0xff;
-    iw1 = ( iw0 + 1 ) & 0xff;
-    ix0 = ix0 & 0xff;
-    iy0 = iy0 & 0xff;
-    iz0 = iz0 & 0xff;
-    iw0 = iw0 & 0xff;
+    ix1 = lattice_wrap( ctx, ix0 + 1 );  // Wrap to 0..period-1
+    iy1 = lattice_wrap( ctx, iy0 + 1 );
+    iz1 = lattice_wrap( ctx, iz0 + 1 );
+    iw1 = lattice_wrap( ctx, iw0 + 1 );
+    ix0 = lattice_wrap( ctx, ix0 );
+    iy0 = lattice_wrap( ctx, iy0 );
+    iz0 = lattice_wrap( ctx, iz0 );
+    iw0 = lattice_wrap( ctx, iw0 );
 
     q = FADE( fw0 );
     r = FADE( fz0 );
     t = FADE( fy0 );
     s = FADE( fx0 );
 
-    nxyz0 = grad4(perm[ix0 + perm[iy0 + perm[iz0 + perm[iw0]]]], fx0, fy0, fz0, fw0);
-    nxyz1 = grad4(perm[ix0 + perm[iy0 + perm[iz0 + perm[iw1]]]], fx0, fy0, fz0, fw1);
+    nxyz0 = grad4(pp[ix0 + pp[iy0 + pp[iz0 + pp[iw0]]]], fx0, fy0, fz0, fw0);
+    nxyz1 = grad4(pp[ix0 + pp[iy0 + pp[iz0 + pp[iw1]]]], fx0, fy0, fz0, fw1);
     nxy0 = LERP( q, nxyz0, nxyz1 );
         
-    nxyz0 = grad4(perm[ix0 + perm[iy0 + perm[iz1 + perm[iw0]]]], fx0, fy0, fz1, fw0);
-    nxyz1 = grad4(perm[ix0 + perm[iy0 + perm[iz1 + perm[iw1]]]], fx0, fy0, fz1, fw1);
+    nxyz0 = grad4(pp[ix0 + pp[iy0 + pp[iz1 + pp[iw0]]]], fx0, fy0, fz1, fw0);
+    nxyz1 = grad4(pp[ix0 + pp[iy0 + pp[iz1 + pp[iw1]]]], fx0, fy0, fz1, fw1);
     nxy1 = LERP( q, nxyz0, nxyz1 );
         
     nx0 = LERP ( r, nxy0, nxy1 );
 
-    nxyz0 = grad4(perm[ix0 + perm[iy1 + perm[iz0 + perm[iw0]]]], fx0, fy1, fz0, fw0);
-    nxyz1 = grad4(perm[ix0 + perm[iy1 + perm[iz0 + perm[iw1]]]], fx0, fy1, fz0, fw1);
+    nxyz0 = grad4(pp[ix0 + pp[iy1 + pp[iz0 + pp[iw0]]]], fx0, fy1, fz0, fw0);
+    nxyz1 = grad4(pp[ix0 + pp[iy1 + pp[iz0 + pp[iw1]]]], fx0, fy1, fz0, fw1);
     nxy0 = LERP( q, nxyz0, nxyz1 );
         
-    nxyz0 = grad4(perm[ix0 + perm[iy1 + perm[iz1 + perm[iw0]]]], fx0, fy1, fz1, fw0);
-    nxyz1 = grad4(perm[ix0 + perm[iy1 + perm[iz1 + perm[iw1]]]], fx0, fy1, fz1, fw1);
+    nxyz0 = grad4(pp[ix0 + pp[iy1 + pp[iz1 + pp[iw0]]]], fx0, fy1, fz1, fw0);
+    nxyz1 = grad4(pp[ix0 + pp[iy1 + pp[iz1 + pp[iw1]]]], fx0, fy1, fz1, fw1);
     nxy1 = LERP( q, nxyz0, nxyz1 );
 
     nx1 = LERP ( r, nxy0, nxy1 );
 
     n0 = LERP( t, nx0, nx1 );
 
-    nxyz0 = grad4(perm[ix1 + perm[iy0 + perm[iz0 + perm[iw0]]]], fx1, fy0, fz0, fw0);
-    nxyz1 = grad4(perm[ix1 + perm[iy0 + perm[iz0 + perm[iw1]]]], fx1, fy0, fz0, fw1);
+    nxyz0 = grad4(pp[ix1 + pp[iy0 + pp[iz0 + pp[iw0]]]], fx1, fy0, fz0, fw0);
+    nxyz1 = grad4(pp[ix1 + pp[iy0 + pp[iz0 + pp[iw1]]]], fx1, fy0, fz0, fw1);
     nxy0 = LERP( q, nxyz0, nxyz1 );
         
-    nxyz0 = grad4(perm[ix1 + perm[iy0 + perm[iz1 + perm[iw0]]]], fx1, fy0, fz1, fw0);
-    nxyz1 = grad4(perm[ix1 + perm[iy0 + perm[iz1 + perm[iw1]]]], fx1, fy0, fz1, fw1);
+    nxyz0 = grad4(pp[ix1 + pp[iy0 + pp[iz1 + pp[iw0]]]], fx1, fy0, fz1, fw0);
+    nxyz1 = grad4(pp[ix1 + pp[iy0 + pp[iz1 + pp[iw1]]]], fx1, fy0, fz1, fw1);
     nxy1 = LERP( q, nxyz0, nxyz1 );
 
     nx0 = LERP ( r, nxy0, nxy1 );
 
-    nxyz0 = grad4(perm[ix1 + perm[iy1 + perm[iz0 + perm[iw0]]]], fx1, fy1, fz0, fw0);
-    nxyz1 = grad4(perm[ix1 + perm[iy1 + perm[iz0 + perm[iw1]]]], fx1, fy1, fz0, fw1);
+    nxyz0 = grad4(pp[ix1 + pp[iy1 + pp[iz0 + pp[iw0]]]], fx1, fy1, fz0, fw0);
+    nxyz1 = grad4(pp[ix1 + pp[iy1 + pp[iz0 + pp[iw1]]]], fx1, fy1, fz0, fw1);
     nxy0 = LERP( q, nxyz0, nxyz1 );
         
-    nxyz0 = grad4(perm[ix1 + perm[iy1 + perm[iz1 + perm[iw0]]]], fx1, fy1, fz1, fw0);
-    nxyz1 = grad4(perm[ix1 + perm[iy1 + perm[iz1 + perm[iw1]]]], fx1, fy1, fz1, fw1);
+    nxyz0 = grad4(pp[ix1 + pp[iy1 + pp[iz1 + pp[iw0]]]], fx1, fy1, fz1, fw0);
+    nxyz1 = grad4(pp[ix1 + pp[iy1 + pp[iz1 + pp[iw1]]]], fx1, fy1, fz1, fw1);
     nxy1 = LERP( q, nxyz0, nxyz1 );
 
     nx1 = LERP ( r, nxy0, nxy1 );
@@ -448,6 +613,11 @@ float noise4( float x, float y, float z, float w )
     return 0.87f * ( LERP( s, n0, n1 ) );
 }
 
+float noise4( float x, float y, float z, float w )
+{
+    return noise4_ctx( &noiseClassic, x, y, z, w );
+}
+
 //---------------------------------------------------------------------
 /** 4D float Perlin periodic noise.
  */
@@ -472,14 +642,18 @@ float pnoise4( float x, float y, float z, float w,
     fy1 = fy0 - 1.0f;
     fz1 = fz0 - 1.0f;
     fw1 = fw0 - 1.0f;
-    ix1 = (( ix0 + 1 ) % px ) & 0xff;  // Wrap to 0..px-1 and wrap to 0..255
-    iy1 = (( iy0 + 1 ) % py ) & 0xff;  // Wrap to 0..py-1 and wrap to 0..255
-    iz1 = (( iz0 + 1 ) % pz ) & 0xff;  // Wrap to 0..pz-1 and wrap to 0..255
-    iw1 = (( iw0 + 1 ) % pw ) & 0xff;  // Wrap to 0..pw-1 and wrap to 0..255
-    ix0 = ( ix0 % px ) & 0xff;
-    iy0 = ( iy0 % py ) & 0xff;
-    iz0 = ( iz0 % pz ) & 0xff;
-    iw0 = ( iw0 % pw ) & 0xff;
+    ix0 = pwrap( ix0, px, &ix1 ); // Wrap to 0..px-1
+    iy0 = pwrap( iy0, py, &iy1 ); // Wrap to 0..py-1
+    iz0 = pwrap( iz0, pz, &iz1 ); // Wrap to 0..pz-1
+    iw0 = pwrap( iw0, pw, &iw1 ); // Wrap to 0..pw-1
+    ix1 = ix1 & 0xff;             // and wrap to 0..255
+    iy1 = iy1 & 0xff;
+    iz1 = iz1 & 0xff;
+    iw1 = iw1 & 0xff;
+    ix0 = ix0 & 0xff;
+    iy0 = iy0 & 0xff;
+    iz0 = iz0 & 0xff;
+    iw0 = iw0 & 0xff;
 
     q = FADE( fw0 );
     r = FADE( fz0 );
@@ -534,3 +708,616 @@ float pnoise4( float x, float y, float z, float w,
 }
 
 //---------------------------------------------------------------------
+
+/*
+ * Tiled periodic noise. These repeat with the periods of a noiseTiling,
+ * up to NOISE_TILE_MAXPERIOD, and look the corner hashes up in its wrap
+ * tables. The lattice coordinate is wrapped once per axis by tile_wrap(),
+ * with a multiply by 1/period instead of a division, and the far corner
+ * needs no wrapping at all, because the wrap tables have an extra entry.
+ * With periods no longer than that of the context, and coordinates
+ * inside the first period, the results are the same as noise2_ctx() etc.
+ */
+
+//---------------------------------------------------------------------
+/** 2D float Perlin noise, periodic with the tiling nt.
+ */
+float noise2_tiled( const noiseTiling *nt, float x, float y )
+{
+    const int *pp = nt->ctx->perm;
+    int ix0, iy0, hx0, hy0, hx1, hy1;
+    float fx0, fy0, fx1, fy1;
+    float s, t, nx0, nx1, n0, n1;
+
+    ix0 = FASTFLOOR( x ); // Integer part of x
+    iy0 = FASTFLOOR( y ); // Integer part of y
+    fx0 = x - ix0;        // Fractional part of x
+    fy0 = y - iy0;        // Fractional part of y
+    fx1 = fx0 - 1.0f;
+    fy1 = fy0 - 1.0f;
+    ix0 = tile_wrap( ix0, nt->period[0], nt->inv[0] );
+    iy0 = tile_wrap( iy0, nt->period[1], nt->inv[1] );
+    hx0 = nt->wrap[0][ix0];
+    hx1 = nt->wrap[0][ix0 + 1];
+    hy0 = nt->wrap[1][iy0];
+    hy1 = nt->wrap[1][iy0 + 1];
+
+    t = FADE( fy0 );
+    s = FADE( fx0 );
+
+    nx0 = grad2(pp[hx0 + pp[hy0]], fx0, fy0);
+    nx1 = grad2(pp[hx0 + pp[hy1]], fx0, fy1);
+    n0 = LERP( t, nx0, nx1 );
+
+    nx0 = grad2(pp[hx1 + pp[hy0]], fx1, fy0);
+    nx1 = grad2(pp[hx1 + pp[hy1]], fx1, fy1);
+    n1 = LERP(t, nx0, nx1);
+
+    return 0.507f * ( LERP( s, n0, n1 ) );
+}
+
+//---------------------------------------------------------------------
+/** 3D float Perlin noise, periodic with the tiling nt.
+ */
+float noise3_tiled( const noiseTiling *nt, float x, float y, float z )
+{
+    const int *pp = nt->ctx->perm;
+    int ix0, iy0, iz0, hx0, hy0, hz0, hx1, hy1, hz1;
+    float fx0, fy0, fz0, fx1, fy1, fz1;
+    float s, t, r;
+    float nxy0, nxy1, nx0, nx1, n0, n1;
+
+    ix0 = FASTFLOOR( x ); // Integer part of x
+    iy0 = FASTFLOOR( y ); // Integer part of y
+    iz0 = FASTFLOOR( z ); // Integer part of z
+    fx0 = x - ix0;        // Fractional part of x
+    fy0 = y - iy0;        // Fractional part of y
+    fz0 = z - iz0;        // Fractional part of z
+    fx1 = fx0 - 1.0f;
+    fy1 = fy0 - 1.0f;
+    fz1 = fz0 - 1.0f;
+    ix0 = tile_wrap( ix0, nt->period[0], nt->inv[0] );
+    iy0 = tile_wrap( iy0, nt->period[1], nt->inv[1] );
+    iz0 = tile_wrap( iz0, nt->period[2], nt->inv[2] );
+    hx0 = nt->wrap[0][ix0];
+    hx1 = nt->wrap[0][ix0 + 1];
+    hy0 = nt->wrap[1][iy0];
+    hy1 = nt->wrap[1][iy0 + 1];
+    hz0 = nt->wrap[2][iz0];
+    hz1 = nt->wrap[2][iz0 + 1];
+
+    r = FADE( fz0 );
+    t = FADE( fy0 );
+    s = FADE( fx0 );
+
+    nxy0 = grad3(pp[hx0 + pp[hy0 + pp[hz0]]], fx0, fy0, fz0);
+    nxy1 = grad3(pp[hx0 + pp[hy0 + pp[hz1]]], fx0, fy0, fz1);
+    nx0 = LERP( r, nxy0, nxy1 );
+
+    nxy0 = grad3(pp[hx0 + pp[hy1 + pp[hz0]]], fx0, fy1, fz0);
+    nxy1 = grad3(pp[hx0 + pp[hy1 + pp[hz1]]], fx0, fy1, fz1);
+    nx1 = LERP( r, nxy0, nxy1 );
+
+    n0 = LERP( t, nx0, nx1 );
+
+    nxy0 = grad3(pp[hx1 + pp[hy0 + pp[hz0]]], fx1, fy0, fz0);
+    nxy1 = grad3(pp[hx1 + pp[hy0 + pp[hz1]]], fx1, fy0, fz1);
+    nx0 = LERP( r, nxy0, nxy1 );
+
+    nxy0 = grad3(pp[hx1 + pp[hy1 + pp[hz0]]], fx1, fy1, fz0);
+    nxy1 = grad3(pp[hx1 + pp[hy1 + pp[hz1]]], fx1, fy1, fz1);
+    nx1 = LERP( r, nxy0, nxy1 );
+
+    n1 = LERP( t, nx0, nx1 );
+
+    return 0.936f * ( LERP( s, n0, n1 ) );
+}
+
+//---------------------------------------------------------------------
+/** 4D float Perlin noise, periodic with the tiling nt. The 16 corners are
+ * visited in the same order as in noise4(), written as loops.
+ */
+float noise4_tiled( const noiseTiling *nt, float x, float y, float z, float w )
+{
+    const int *pp = nt->ctx->perm;
+    int hx[2], hy[2], hz[2], hw[2];
+    float fx[2], fy[2], fz[2], fw[2];
+    float s, t, r, q;
+    float nxy[2], nx[2], n[2];
+    int i0, a, b, c;
+
+    i0 = FASTFLOOR( x );
+    fx[0] = x - i0;
+    i0 = tile_wrap( i0, nt->period[0], nt->inv[0] );
+    hx[0] = nt->wrap[0][i0];
+    hx[1] = nt->wrap[0][i0 + 1];
+    i0 = FASTFLOOR( y );
+    fy[0] = y - i0;
+    i0 = tile_wrap( i0, nt->period[1], nt->inv[1] );
+    hy[0] = nt->wrap[1][i0];
+    hy[1] = nt->wrap[1][i0 + 1];
+    i0 = FASTFLOOR( z );
+    fz[0] = z - i0;
+    i0 = tile_wrap( i0, nt->period[2], nt->inv[2] );
+    hz[0] = nt->wrap[2][i0];
+    hz[1] = nt->wrap[2][i0 + 1];
+    i0 = FASTFLOOR( w );
+    fw[0] = w - i0;
+    i0 = tile_wrap( i0, nt->period[3], nt->inv[3] );
+    hw[0] = nt->wrap[3][i0];
+    hw[1] = nt->wrap[3][i0 + 1];
+    fx[1] = fx[0] - 1.0f;
+    fy[1] = fy[0] - 1.0f;
+    fz[1] = fz[0] - 1.0f;
+    fw[1] = fw[0] - 1.0f;
+
+    q = FADE( fw[0] );
+    r = FADE( fz[0] );
+    t = FADE( fy[0] );
+    s = FADE( fx[0] );
+
+    for( a = 0; a < 2; a++ ) {
+        for( b = 0; b < 2; b++ ) {
+            for( c = 0; c < 2; c++ ) {
+                float nxyz0 = grad4(pp[hx[a] + pp[hy[b] + pp[hz[c] + pp[hw[0]]]]],
+                                    fx[a], fy[b], fz[c], fw[0]);
+                float nxyz1 = grad4(pp[hx[a] + pp[hy[b] + pp[hz[c] + pp[hw[1]]]]],
+                                    fx[a], fy[b], fz[c], fw[1]);
+                nxy[c] = LERP( q, nxyz0, nxyz1 );
+            }
+            nx[b] = LERP( r, nxy[0], nxy[1] );
+        }
+        n[a] = LERP( t, nx[0], nx[1] );
+    }
+
+    return 0.87f * ( LERP( s, n[0], n[1] ) );
+}
+
+//---------------------------------------------------------------------
+
+/*
+ * Batch versions of noise2() to noise4(), for evaluating lots of points
+ * at once from structure-of-arrays input. On x86, SIMD kernels for
+ * SSE4.1, AVX2 and AVX-512 are compiled from the same source in
+ * noise1234simd.h, and the widest one the CPU supports is picked at
+ * run time. Elsewhere, this just loops over the scalar functions.
+ *
+ * The SIMD kernels perform the same float operations in the same order
+ * as the scalar code. The SSE4.1 and AVX2 results are bit-for-bit equal
+ * to those of noise2(), noise3() and noise4(). AVX-512 implies FMA, and
+ * the compiler is then free to fuse a multiply and an add, so in that
+ * case the results may differ in the last bits, by at most 1e-5.
+ */
+
+#ifdef CPUISA_X86
+
+#define SIMD_ISA ISA_SSE41
+#include "simdlanes.h"
+#include "noise1234simd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX2
+#include "simdlanes.h"
+#include "noise1234simd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX512
+#include "simdlanes.h"
+#include "noise1234simd.h"
+#undef SIMD_ISA
+
+#endif // CPUISA_X86
+
+// The widest SIMD vector we have a kernel for
+#define BATCH_MAXW 16
+
+/*
+ * The kernels take the noise context. With a permutation table they
+ * gather from its 32-bit form, because the gather instructions can't
+ * fetch single bytes. With the mod 289 hash they compute the hash in
+ * registers and never touch the table.
+ */
+typedef void (*block2_fn)( const noiseContext *ctx, const float *x,
+                           const float *y, float *out );
+typedef void (*block3_fn)( const noiseContext *ctx, const float *x,
+                           const float *y, const float *z, float *out );
+typedef void (*block4_fn)( const noiseContext *ctx, const float *x,
+                           const float *y, const float *z, const float *w,
+                           float *out );
+
+/*
+ * Select the kernel for the best instruction set the CPU supports,
+ * and return its width in lanes, or 0 if there is no SIMD kernel.
+ */
+static int batch_kernels( block2_fn *b2, block3_fn *b3, block4_fn *b4 )
+{
+#ifdef CPUISA_X86
+    switch( cpu_isa() ) {
+    case ISA_AVX512:
+        *b2 = noise2_block_avx512; *b3 = noise3_block_avx512; *b4 = noise4_block_avx512;
+        return 16;
+    case ISA_AVX2:
+        *b2 = noise2_block_avx2; *b3 = noise3_block_avx2; *b4 = noise4_block_avx2;
+        return 8;
+    case ISA_SSE41:
+        *b2 = noise2_block_sse41; *b3 = noise3_block_sse41; *b4 = noise4_block_sse41;
+        return 4;
+    }
+#endif
+    *b2 = 0; *b3 = 0; *b4 = 0;
+    return 0;
+}
+
+//---------------------------------------------------------------------
+/** Batch 2D float Perlin noise: out[i] = noise2_ctx( ctx, x[i], y[i] ), i = 0..n-1
+ */
+void noise2_batch_ctx( const noiseContext *ctx, const float *x, const float *y,
+                       float *out, int n )
+{
+    block2_fn b2; block3_fn b3; block4_fn b4;
+    int w = batch_kernels( &b2, &b3, &b4 );
+    int i = 0, j;
+
+    if( w ) {
+        float tx[BATCH_MAXW] = { 0.0f }, ty[BATCH_MAXW] = { 0.0f };
+        float res[BATCH_MAXW];
+        for( ; i + w <= n; i += w ) b2( ctx, x+i, y+i, out+i );
+        if( i < n ) {
+            for( j = 0; i + j < n; j++ ) { tx[j] = x[i+j]; ty[j] = y[i+j]; }
+            b2( ctx, tx, ty, res );
+            for( j = 0; i + j < n; j++ ) out[i+j] = res[j];
+        }
+        return;
+    }
+    for( ; i < n; i++ ) out[i] = noise2_ctx( ctx, x[i], y[i] );
+}
+
+void noise2_batch( const float *x, const float *y, float *out, int n )
+{
+    noise2_batch_ctx( &noiseClassic, x, y, out, n );
+}
+
+//---------------------------------------------------------------------
+/** Batch 3D float Perlin noise: out[i] = noise3_ctx( ctx, x[i], y[i], z[i] )
+ */
+void noise3_batch_ctx( const noiseContext *ctx, const float *x, const float *y,
+                       const float *z, float *out, int n )
+{
+    block2_fn b2; block3_fn b3; block4_fn b4;
+    int w = batch_kernels( &b2, &b3, &b4 );
+    int i = 0, j;
+
+    if( w ) {
+        float tx[BATCH_MAXW] = { 0.0f }, ty[BATCH_MAXW] = { 0.0f };
+        float tz[BATCH_MAXW] = { 0.0f }, res[BATCH_MAXW];
+        for( ; i + w <= n; i += w ) b3( ctx, x+i, y+i, z+i, out+i );
+        if( i < n ) {
+            for( j = 0; i + j < n; j++ ) {
+                tx[j] = x[i+j]; ty[j] = y[i+j]; tz[j] = z[i+j];
+            }
+            b3( ctx, tx, ty, tz, res );
+            for( j = 0; i + j < n; j++ ) out[i+j] = res[j];
+        }
+        return;
+    }
+    for( ; i < n; i++ ) out[i] = noise3_ctx( ctx, x[i], y[i], z[i] );
+}
+
+void noise3_batch( const float *x, const float *y, const float *z,
+                   float *out, int n )
+{
+    noise3_batch_ctx( &noiseClassic, x, y, z, out, n );
+}
+
+//---------------------------------------------------------------------
+/** Batch 4D float Perlin noise: out[i] = noise4_ctx( ctx, x[i], y[i], z[i], w[i] )
+ */
+void noise4_batch_ctx( const noiseContext *ctx, const float *x, const float *y,
+                       const float *z, const float *w, float *out, int n )
+{
+    block2_fn b2; block3_fn b3; block4_fn b4;
+    int lanes = batch_kernels( &b2, &b3, &b4 );
+    int i = 0, j;
+
+    if( lanes ) {
+        float tx[BATCH_MAXW] = { 0.0f }, ty[BATCH_MAXW] = { 0.0f };
+        float tz[BATCH_MAXW] = { 0.0f }, tw[BATCH_MAXW] = { 0.0f };
+        float res[BATCH_MAXW];
+        for( ; i + lanes <= n; i += lanes ) b4( ctx, x+i, y+i, z+i, w+i, out+i );
+        if( i < n ) {
+            for( j = 0; i + j < n; j++ ) {
+                tx[j] = x[i+j]; ty[j] = y[i+j]; tz[j] = z[i+j]; tw[j] = w[i+j];
+            }
+            b4( ctx, tx, ty, tz, tw, res );
+            for( j = 0; i + j < n; j++ ) out[i+j] = res[j];
+        }
+        return;
+    }
+    for( ; i < n; i++ ) out[i] = noise4_ctx( ctx, x[i], y[i], z[i], w[i] );
+}
+
+void noise4_batch( const float *x, const float *y, const float *z,
+                   const float *w, float *out, int n )
+{
+    noise4_batch_ctx( &noiseClassic, x, y, z, w, out, n );
+}
+
+//---------------------------------------------------------------------
+
+/*
+ * Grid evaluation of 3D Perlin noise. Sample (i,j,k) of the grid is
+ * noise3( x0 + i*dx, y0 + j*dy, z0 + k*dz ), written to
+ * out[ i + j*ystride + k*zstride ].
+ *
+ * Many neighbouring samples share a lattice cell when the step is small,
+ * so instead of starting over for every sample, we walk the grid row by
+ * row. The floor and fade of each column are computed once for the whole
+ * grid, those of each row once per row, and the corner hashes and
+ * gradients once for each cell a row passes through. Within a cell, the
+ * y and z parts of the eight gradient dot products are constant along
+ * the row, so each sample only needs eight multiply-adds and the seven
+ * LERP()s. The gradients have components 0 and +/-1, so the dot products
+ * come out exactly as in grad3(), and the result is the same as noise3().
+ */
+
+// The gradient vector that grad3() uses for a given hash
+static void grad3vec( int hash, float *gx, float *gy, float *gz )
+{
+    *gx = grad3( hash, 1.0f, 0.0f, 0.0f );
+    *gy = grad3( hash, 0.0f, 1.0f, 0.0f );
+    *gz = grad3( hash, 0.0f, 0.0f, 1.0f );
+}
+
+//---------------------------------------------------------------------
+/** 3D float Perlin noise over a regular grid, using a noise context.
+ */
+void noise3_grid_ctx( const noiseContext *ctx, float x0, float y0, float z0,
+                      float dx, float dy, float dz, int nx, int ny, int nz,
+                      float *out, int ystride, int zstride )
+{
+    const int *pp = ctx->perm;
+    int *cix;
+    float *cfx, *cs;
+    int i, j, k, a, b, c, cell;
+    int iy0, iz0, iyw[2], izw[2], hyz[2][2];
+    float fy[2], fz[2], s, t, r;
+    float gx[2][2][2], gyz[2][2][2], gy, gz;
+    float nxy0, nxy1, nx0, nx1, n0, n1, fx0, fx1;
+    float *row;
+
+    if( nx <= 0 || ny <= 0 || nz <= 0 ) return;
+
+    // Per-column integer part, fractional part and fade, shared by all rows
+    cix = (int*) malloc( nx * sizeof(int) );
+    cfx = (float*) malloc( nx * sizeof(float) );
+    cs = (float*) malloc( nx * sizeof(float) );
+    if( !cix || !cfx || !cs ) {
+        // Out of memory, so do it the slow way
+        for( k = 0; k < nz; k++ ) for( j = 0; j < ny; j++ ) for( i = 0; i < nx; i++ )
+            out[i + j*ystride + k*zstride] = noise3_ctx( ctx, x0 + i*dx, y0 + j*dy, z0 + k*dz );
+        free( cix ); free( cfx ); free( cs );
+        return;
+    }
+    for( i = 0; i < nx; i++ ) {
+        float x = x0 + i*dx;
+        cix[i] = FASTFLOOR( x );
+        cfx[i] = x - cix[i];
+        cs[i] = FADE( cfx[i] );
+    }
+
+    for( k = 0; k < nz; k++ ) {
+        float z = z0 + k*dz;
+        iz0 = FASTFLOOR( z );
+        fz[0] = z - iz0;
+        fz[1] = fz[0] - 1.0f;
+        izw[0] = lattice_wrap( ctx, iz0 );
+        izw[1] = lattice_wrap( ctx, iz0 + 1 );
+        r = FADE( fz[0] );
+
+        for( j = 0; j < ny; j++ ) {
+            float y = y0 + j*dy;
+            iy0 = FASTFLOOR( y );
+            fy[0] = y - iy0;
+            fy[1] = fy[0] - 1.0f;
+            iyw[0] = lattice_wrap( ctx, iy0 );
+            iyw[1] = lattice_wrap( ctx, iy0 + 1 );
+            t = FADE( fy[0] );
+            for( b = 0; b < 2; b++ ) for( c = 0; c < 2; c++ )
+                hyz[b][c] = pp[iyw[b] + pp[izw[c]]];
+
+            row = out + j*ystride + k*zstride;
+            cell = cix[0] - 1; // Anything but the first cell
+            for( i = 0; i < nx; i++ ) {
+                if( cix[i] != cell ) {
+                    // Entering a new cell: hash its corners once
+                    cell = cix[i];
+                    for( a = 0; a < 2; a++ ) for( b = 0; b < 2; b++ ) for( c = 0; c < 2; c++ ) {
+                        grad3vec( pp[lattice_wrap( ctx, cell + a ) + hyz[b][c]],
+                                  &gx[a][b][c], &gy, &gz );
+                        gyz[a][b][c] = gy * fy[b] + gz * fz[c];
+                    }
+                }
+                fx0 = cfx[i];
+                fx1 = fx0 - 1.0f;
+                s = cs[i];
+
+                nxy0 = gx[0][0][0] * fx0 + gyz[0][0][0];
+                nxy1 = gx[0][0][1] * fx0 + gyz[0][0][1];
+                nx0 = LERP( r, nxy0, nxy1 );
+
+                nxy0 = gx[0][1][0] * fx0 + gyz[0][1][0];
+                nxy1 = gx[0][1][1] * fx0 + gyz[0][1][1];
+                nx1 = LERP( r, nxy0, nxy1 );
+
+                n0 = LERP( t, nx0, nx1 );
+
+                nxy0 = gx[1][0][0] * fx1 + gyz[1][0][0];
+                nxy1 = gx[1][0][1] * fx1 + gyz[1][0][1];
+                nx0 = LERP( r, nxy0, nxy1 );
+
+                nxy0 = gx[1][1][0] * fx1 + gyz[1][1][0];
+                nxy1 = gx[1][1][1] * fx1 + gyz[1][1][1];
+                nx1 = LERP( r, nxy0, nxy1 );
+
+                n1 = LERP( t, nx0, nx1 );
+
+                row[i] = 0.936f * ( LERP( s, n0, n1 ) );
+            }
+        }
+    }
+
+    free( cix );
+    free( cfx );
+    free( cs );
+}
+
+void noise3_grid( float x0, float y0, float z0, float dx, float dy, float dz,
+                  int nx, int ny, int nz, float *out, int ystride, int zstride )
+{
+    noise3_grid_ctx( &noiseClassic, x0, y0, z0, dx, dy, dz, nx, ny, nz,
+                     out, ystride, zstride );
+}
+
+//---------------------------------------------------------------------
+
+/*
+ * Batch and grid versions of the tiled periodic noise. The kernels are
+ * picked the same way as for noise2_batch() and noise3_batch(), and give
+ * the same results as noise2_tiled() and noise3_tiled(), to within 1e-5
+ * with AVX-512 as above.
+ */
+typedef void (*tblock2_fn)( const noiseTiling *nt, const float *x,
+                            const float *y, float *out );
+typedef void (*tblock3_fn)( const noiseTiling *nt, const float *x,
+                            const float *y, const float *z, float *out );
+
+static int tiled_kernels( tblock2_fn *b2, tblock3_fn *b3 )
+{
+#ifdef CPUISA_X86
+    switch( cpu_isa() ) {
+    case ISA_AVX512:
+        *b2 = noise2_tiled_block_avx512; *b3 = noise3_tiled_block_avx512;
+        return 16;
+    case ISA_AVX2:
+        *b2 = noise2_tiled_block_avx2; *b3 = noise3_tiled_block_avx2;
+        return 8;
+    case ISA_SSE41:
+        *b2 = noise2_tiled_block_sse41; *b3 = noise3_tiled_block_sse41;
+        return 4;
+    }
+#endif
+    *b2 = 0; *b3 = 0;
+    return 0;
+}
+
+//---------------------------------------------------------------------
+/** Batch 2D tiled Perlin noise: out[i] = noise2_tiled( nt, x[i], y[i] ), i = 0..n-1
+ */
+void noise2_tiled_batch( const noiseTiling *nt, const float *x, const float *y,
+                         float *out, int n )
+{
+    tblock2_fn b2; tblock3_fn b3;
+    int w = tiled_kernels( &b2, &b3 );
+    int i = 0, j;
+
+    if( w ) {
+        float tx[BATCH_MAXW] = { 0.0f }, ty[BATCH_MAXW] = { 0.0f };
+        float res[BATCH_MAXW];
+        for( ; i + w <= n; i += w ) b2( nt, x+i, y+i, out+i );
+        if( i < n ) {
+            for( j = 0; i + j < n; j++ ) { tx[j] = x[i+j]; ty[j] = y[i+j]; }
+            b2( nt, tx, ty, res );
+            for( j = 0; i + j < n; j++ ) out[i+j] = res[j];
+        }
+        return;
+    }
+    for( ; i < n; i++ ) out[i] = noise2_tiled( nt, x[i], y[i] );
+}
+
+//---------------------------------------------------------------------
+/** Batch 3D tiled Perlin noise: out[i] = noise3_tiled( nt, x[i], y[i], z[i] ), i = 0..n-1
+ */
+void noise3_tiled_batch( const noiseTiling *nt, const float *x, const float *y,
+                         const float *z, float *out, int n )
+{
+    tblock2_fn b2; tblock3_fn b3;
+    int w = tiled_kernels( &b2, &b3 );
+    int i = 0, j;
+
+    if( w ) {
+        float tx[BATCH_MAXW] = { 0.0f }, ty[BATCH_MAXW] = { 0.0f };
+        float tz[BATCH_MAXW] = { 0.0f }, res[BATCH_MAXW];
+        for( ; i + w <= n; i += w ) b3( nt, x+i, y+i, z+i, out+i );
+        if( i < n ) {
+            for( j = 0; i + j < n; j++ ) { tx[j] = x[i+j]; ty[j] = y[i+j]; tz[j] = z[i+j]; }
+            b3( nt, tx, ty, tz, res );
+            for( j = 0; i + j < n; j++ ) out[i+j] = res[j];
+        }
+        return;
+    }
+    for( ; i < n; i++ ) out[i] = noise3_tiled( nt, x[i], y[i], z[i] );
+}
+
+//---------------------------------------------------------------------
+/** 2D tiled Perlin noise over a regular grid of nx*ny samples, for baking
+ * tiles. Sample (i,j) is noise2_tiled( nt, x0 + i*dx, y0 + j*dy ), written
+ * to out[i + j*ystride], a row at a time through noise2_tiled_batch().
+ */
+void noise2_tiled_grid( const noiseTiling *nt, float x0, float y0,
+                        float dx, float dy, int nx, int ny,
+                        float *out, int ystride )
+{
+    float *xs, *ys;
+    int i, j;
+
+    if( nx <= 0 || ny <= 0 ) return;
+    xs = (float*) malloc( 2 * nx * sizeof( float ) );
+    if( !xs ) {
+        // Out of memory, so do it the slow way
+        for( j = 0; j < ny; j++ ) for( i = 0; i < nx; i++ )
+            out[i + j*ystride] = noise2_tiled( nt, x0 + i*dx, y0 + j*dy );
+        return;
+    }
+    ys = xs + nx;
+    for( i = 0; i < nx; i++ ) xs[i] = x0 + i*dx;
+    for( j = 0; j < ny; j++ ) {
+        for( i = 0; i < nx; i++ ) ys[i] = y0 + j*dy;
+        noise2_tiled_batch( nt, xs, ys, out + j*ystride, nx );
+    }
+    free( xs );
+}
+
+//---------------------------------------------------------------------
+/** 3D tiled Perlin noise over a regular grid of nx*ny*nz samples, laid
+ * out as for noise3_grid(), a row at a time through noise3_tiled_batch().
+ */
+void noise3_tiled_grid( const noiseTiling *nt, float x0, float y0, float z0,
+                        float dx, float dy, float dz, int nx, int ny, int nz,
+                        float *out, int ystride, int zstride )
+{
+    float *xs, *ys, *zs;
+    int i, j, k;
+
+    if( nx <= 0 || ny <= 0 || nz <= 0 ) return;
+    xs = (float*) malloc( 3 * nx * sizeof( float ) );
+    if( !xs ) {
+        // Out of memory, so do it the slow way
+        for( k = 0; k < nz; k++ ) for( j = 0; j < ny; j++ ) for( i = 0; i < nx; i++ )
+            out[i + j*ystride + k*zstride] =
+                noise3_tiled( nt, x0 + i*dx, y0 + j*dy, z0 + k*dz );
+        return;
+    }
+    ys = xs + nx;
+    zs = ys + nx;
+    for( i = 0; i < nx; i++ ) xs[i] = x0 + i*dx;
+    for( k = 0; k < nz; k++ ) {
+        for( i = 0; i < nx; i++ ) zs[i] = z0 + k*dz;
+        for( j = 0; j < ny; j++ ) {
+            for( i = 0; i < nx; i++ ) ys[i] = y0 + j*dy;
+            noise3_tiled_batch( nt, xs, ys, zs, out + j*ystride + k*zstride, nx );
+        }
+    }
+    free( xs );
+}
+
+//---------------------------------------------------------------------
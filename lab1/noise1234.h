@@ -31,6 +31,8 @@
  * on some platforms. A templatized version of Noise1234 could be useful.
  */
 
+#include "noisecontext.h"
+
 /** 1D, 2D, 3D and 4D float Perlin noise, SL "noise()"
  */
 extern float noise1( float x );
@@ -38,6 +40,25 @@ extern float noise2( float x, float y );
 extern float noise3( float x, float y, float z );
 extern float noise4( float x, float y, float z, float w );
 
+/** 2D, 3D and 4D float Perlin noise with the permutation table of a noise
+ * context instead of the built-in one. With noiseClassic, or a context
+ * made from seed 0, these are the same as noise2() and so on. They also
+ * take contexts from noiseContextInitMod289(), for which the batch
+ * functions compute the hash instead of looking it up in a table.
+ * The derivative, batch and grid functions below have *_ctx versions too.
+ */
+extern float noise2_ctx( const noiseContext *ctx, float x, float y );
+extern float noise3_ctx( const noiseContext *ctx, float x, float y, float z );
+extern float noise4_ctx( const noiseContext *ctx, float x, float y, float z, float w );
+
+/** 3D float Perlin noise, with the analytic gradient returned in
+ * (*dnoise_dx, *dnoise_dy, *dnoise_dz). The value is the same as noise3().
+ */
+extern float noise3_deriv( float x, float y, float z,
+                           float *dnoise_dx, float *dnoise_dy, float *dnoise_dz );
+extern float noise3_deriv_ctx( const noiseContext *ctx, float x, float y, float z,
+                               float *dnoise_dx, float *dnoise_dy, float *dnoise_dz );
+
 /** 1D, 2D, 3D and 4D float Perlin periodic noise, SL "pnoise()"
  */
 extern float pnoise1( float x, int px );
@@ -45,3 +66,56 @@ extern float pnoise2( float x, float y, int px, int py );
 extern float pnoise3( float x, float y, float z, int px, int py, int pz );
 extern float pnoise4( float x, float y, float z, float w,
                               int px, int py, int pz, int pw );
+
+/** 2D, 3D and 4D float Perlin noise, periodic with the periods of a tiling
+ * made by noiseTilingInit(), up to NOISE_TILE_MAXPERIOD. Unlike pnoise(),
+ * periods over 256 do not alias, and the lattice is wrapped without a
+ * remainder per corner. The batch and grid versions work like the ones
+ * below, and give the same results as noise2_tiled() and noise3_tiled().
+ */
+extern float noise2_tiled( const noiseTiling *nt, float x, float y );
+extern float noise3_tiled( const noiseTiling *nt, float x, float y, float z );
+extern float noise4_tiled( const noiseTiling *nt, float x, float y, float z, float w );
+extern void noise2_tiled_batch( const noiseTiling *nt, const float *x,
+                                const float *y, float *out, int n );
+extern void noise3_tiled_batch( const noiseTiling *nt, const float *x,
+                                const float *y, const float *z, float *out, int n );
+extern void noise2_tiled_grid( const noiseTiling *nt, float x0, float y0,
+                               float dx, float dy, int nx, int ny,
+                               float *out, int ystride );
+extern void noise3_tiled_grid( const noiseTiling *nt, float x0, float y0, float z0,
+                               float dx, float dy, float dz, int nx, int ny, int nz,
+                               float *out, int ystride, int zstride );
+
+/** Batch 2D, 3D and 4D float Perlin noise over structure-of-arrays input.
+ * Computes out[i] = noise3( x[i], y[i], z[i] ) for i = 0..n-1, and so on,
+ * using SIMD instructions where available. The results match the single
+ * point functions to within 1e-5. See noise1234.c for details. The last
+ * few points, if they don't fill a SIMD vector, are run through the same
+ * kernel from a zero padded copy, so a point gets the same value wherever
+ * it is in the batch.
+ */
+extern void noise2_batch( const float *x, const float *y, float *out, int n );
+extern void noise3_batch( const float *x, const float *y, const float *z,
+                          float *out, int n );
+extern void noise4_batch( const float *x, const float *y, const float *z,
+                          const float *w, float *out, int n );
+extern void noise2_batch_ctx( const noiseContext *ctx, const float *x,
+                              const float *y, float *out, int n );
+extern void noise3_batch_ctx( const noiseContext *ctx, const float *x,
+                              const float *y, const float *z, float *out, int n );
+extern void noise4_batch_ctx( const noiseContext *ctx, const float *x,
+                              const float *y, const float *z, const float *w,
+                              float *out, int n );
+
+/** 3D float Perlin noise over a regular grid of nx*ny*nz samples.
+ * Sample (i,j,k) is noise3( x0 + i*dx, y0 + j*dy, z0 + k*dz ), and it is
+ * written to out[ i + j*ystride + k*zstride ]. Corner hashes and
+ * gradients are computed once per lattice cell rather than per sample.
+ */
+extern void noise3_grid( float x0, float y0, float z0,
+                         float dx, float dy, float dz, int nx, int ny, int nz,
+                         float *out, int ystride, int zstride );
+extern void noise3_grid_ctx( const noiseContext *ctx, float x0, float y0, float z0,
+                             float dx, float dy, float dz, int nx, int ny, int nz,
+                             float *out, int ystride, int zstride );
@@ -0,0 +1,326 @@
+/*
+ * Header-only C++ templates for classic Perlin noise, the "templatized
+ * version of Noise1234" that noise1234.h wishes for.
+ *
+ * Noise1234<T, Dim, Fade>::noise() is noise1() to noise4() from
+ * noise1234.c, with the scalar type T (float or double), the dimension
+ * Dim (1 to 4) and the interpolant Fade picked at compile time:
+ *
+ *   float n = Noise1234<float, 3>::noise( x, y, z );
+ *   double d = Noise1234<double, 2, NoiseFadeCubic>::noise( x, y );
+ *
+ * Everything is inline and the permutation and gradient tables are
+ * constant, so each instantiation compiles into the caller's loop with no
+ * function call, and the compiler is free to vectorize that loop. The
+ * gradient functions are written as table lookups rather than branches
+ * for the same reason. With float and the quintic fade, the results are
+ * the same as those of the C functions, as long as both are compiled with
+ * the same floating point options. Contracting a*b+c into a fused
+ * multiply-add, as -march with FMA allows, changes the last bits.
+ *
+ * Each noise() also has an overload that takes a noiseContext, to use a
+ * seeded permutation table instead of the built-in one. Contexts from
+ * noiseContextInitMod289() are not supported.
+ */
+
+#ifndef NOISE1234_HPP
+#define NOISE1234_HPP
+
+#include "noisecontext.h"
+
+/*
+ * The interpolants. The quintic is the FADE() of "Improved Noise", with
+ * continuous second derivatives. The cubic is the one from Ken Perlin's
+ * original noise, which is cheaper but has creases in its second
+ * derivative at the lattice planes, which can show up in bump mapping.
+ */
+struct NoiseFadeQuintic {
+    template<typename T> static inline T fade(T t) {
+        return t * t * t * ( t * ( t * T(6) - T(15) ) + T(10) );
+    }
+};
+
+struct NoiseFadeCubic {
+    template<typename T> static inline T fade(T t) {
+        return t * t * ( T(3) - T(2) * t );
+    }
+};
+
+namespace noise1234_detail {
+
+template<typename T> inline int fastfloor(T x) {
+    return ( x < (int)x ) ? (int)x - 1 : (int)x;
+}
+
+template<typename T> inline T lerp(T t, T a, T b) {
+    return a + t * ( b - a );
+}
+
+/*
+ * Ken Perlin's permutation table, repeated twice, and the gradients that
+ * grad1() to grad4() in noise1234.c pick with the low bits of a hash.
+ * These are templates only so that they can be defined in this header.
+ */
+template<typename T> struct Tables {
+    static const int perm[512];
+    static const T g1[16];
+    static const T g2[8][2];
+    static const T g3[16][3];
+    static const T g4[32][4];
+};
+
+#define NOISE1234_PERM \
+    151,160,137, 91, 90, 15,131, 13,201, 95, 96, 53,194,233,  7,225, \
+    140, 36,103, 30, 69,142,  8, 99, 37,240, 21, 10, 23,190,  6,148, \
+    247,120,234, 75,  0, 26,197, 62, 94,252,219,203,117, 35, 11, 32, \
+     57,177, 33, 88,237,149, 56, 87,174, 20,125,136,171,168, 68,175, \
+     74,165, 71,134,139, 48, 27,166, 77,146,158,231, 83,111,229,122, \
+     60,211,133,230,220,105, 92, 41, 55, 46,245, 40,244,102,143, 54, \
+     65, 25, 63,161,  1,216, 80, 73,209, 76,132,187,208, 89, 18,169, \
+    200,196,135,130,116,188,159, 86,164,100,109,198,173,186,  3, 64, \
+     52,217,226,250,124,123,  5,202, 38,147,118,126,255, 82, 85,212, \
+    207,206, 59,227, 47, 16, 58, 17,182,189, 28, 42,223,183,170,213, \
+    119,248,152,  2, 44,154,163, 70,221,153,101,155,167, 43,172,  9, \
+    129, 22, 39,253, 19, 98,108,110, 79,113,224,232,178,185,112,104, \
+    218,246, 97,228,251, 34,242,193,238,210,144, 12,191,179,162,241, \
+     81, 51,145,235,249, 14,239,107, 49,192,214, 31,181,199,106,157, \
+    184, 84,204,176,115,121, 50, 45,127,  4,150,254,138,236,205, 93, \
+    222,114, 67, 29, 24, 72,243,141,128,195, 78, 66,215, 61,156,180
+
+template<typename T> const int Tables<T>::perm[512] = {
+    NOISE1234_PERM,
+    NOISE1234_PERM
+};
+
+#undef NOISE1234_PERM
+
+// 1.0, 2.0, ..., 8.0 with a random sign
+template<typename T> const T Tables<T>::g1[16] = {
+    1, 2, 3, 4, 5, 6, 7, 8, -1, -2, -3, -4, -5, -6, -7, -8
+};
+
+// 8 directions, (+/-1, +/-2) and (+/-2, +/-1)
+template<typename T> const T Tables<T>::g2[8][2] = {
+    { 1, 2}, {-1, 2}, { 1,-2}, {-1,-2}, { 2, 1}, { 2,-1}, {-2, 1}, {-2,-1}
+};
+
+// The 12 edge midpoints of a cube, with 4 repeats to make 16
+template<typename T> const T Tables<T>::g3[16][3] = {
+    { 1, 1, 0}, {-1, 1, 0}, { 1,-1, 0}, {-1,-1, 0},
+    { 1, 0, 1}, {-1, 0, 1}, { 1, 0,-1}, {-1, 0,-1},
+    { 0, 1, 1}, { 0,-1, 1}, { 0, 1,-1}, { 0,-1,-1},
+    { 1, 1, 0}, { 0,-1, 1}, {-1, 1, 0}, { 0,-1,-1}
+};
+
+// The 32 edge midpoints of a 4D hypercube
+template<typename T> const T Tables<T>::g4[32][4] = {
+    { 1, 1, 1, 0}, {-1, 1, 1, 0}, { 1,-1, 1, 0}, {-1,-1, 1, 0},
+    { 1, 1,-1, 0}, {-1, 1,-1, 0}, { 1,-1,-1, 0}, {-1,-1,-1, 0},
+    { 1, 1, 0, 1}, {-1, 1, 0, 1}, { 1,-1, 0, 1}, {-1,-1, 0, 1},
+    { 1, 1, 0,-1}, {-1, 1, 0,-1}, { 1,-1, 0,-1}, {-1,-1, 0,-1},
+    { 1, 0, 1, 1}, {-1, 0, 1, 1}, { 1, 0,-1, 1}, {-1, 0,-1, 1},
+    { 1, 0, 1,-1}, {-1, 0, 1,-1}, { 1, 0,-1,-1}, {-1, 0,-1,-1},
+    { 0, 1, 1, 1}, { 0,-1, 1, 1}, { 0, 1,-1, 1}, { 0,-1,-1, 1},
+    { 0, 1, 1,-1}, { 0,-1, 1,-1}, { 0, 1,-1,-1}, { 0,-1,-1,-1}
+};
+
+// Gradient-dot-residual, the same values as grad1() to grad4()
+template<typename T> inline T grad(int hash, T x) {
+    return Tables<T>::g1[hash & 15] * x;
+}
+
+template<typename T> inline T grad(int hash, T x, T y) {
+    const T *g = Tables<T>::g2[hash & 7];
+    return g[0] * x + g[1] * y;
+}
+
+template<typename T> inline T grad(int hash, T x, T y, T z) {
+    const T *g = Tables<T>::g3[hash & 15];
+    return g[0] * x + g[1] * y + g[2] * z;
+}
+
+template<typename T> inline T grad(int hash, T x, T y, T z, T w) {
+    const T *g = Tables<T>::g4[hash & 31];
+    return g[0] * x + g[1] * y + g[2] * z + g[3] * w;
+}
+
+} // namespace noise1234_detail
+
+/*
+ * Noise1234<T, Dim, Fade>::noise(), 1D to 4D classic Perlin noise.
+ * Only the specializations below are defined.
+ */
+template<typename T, int Dim, typename Fade = NoiseFadeQuintic>
+struct Noise1234;
+
+template<typename T, typename Fade> struct Noise1234<T, 1, Fade> {
+    static inline T noise(const int *pp, int mask, T x) {
+        using namespace noise1234_detail;
+        int ix0 = fastfloor( x ); // Integer part of x
+        T fx0 = x - ix0;          // Fractional part of x
+        T fx1 = fx0 - T(1);
+        int ix1 = ( ix0 + 1 ) & mask; // Wrap to 0..period-1
+        ix0 = ix0 & mask;
+
+        T s = Fade::fade( fx0 );
+        T n0 = grad( pp[ix0], fx0 );
+        T n1 = grad( pp[ix1], fx1 );
+        return T(0.188) * lerp( s, n0, n1 );
+    }
+    static inline T noise(T x) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x );
+    }
+    static inline T noise(const noiseContext &ctx, T x) {
+        return noise( ctx.perm, ctx.mask, x );
+    }
+};
+
+template<typename T, typename Fade> struct Noise1234<T, 2, Fade> {
+    static inline T noise(const int *pp, int mask, T x, T y) {
+        using namespace noise1234_detail;
+        int ix0 = fastfloor( x ); // Integer part of x
+        int iy0 = fastfloor( y ); // Integer part of y
+        T fx0 = x - ix0;          // Fractional part of x
+        T fy0 = y - iy0;          // Fractional part of y
+        T fx1 = fx0 - T(1);
+        T fy1 = fy0 - T(1);
+        int ix1 = ( ix0 + 1 ) & mask; // Wrap to 0..period-1
+        int iy1 = ( iy0 + 1 ) & mask;
+        ix0 = ix0 & mask;
+        iy0 = iy0 & mask;
+
+        T t = Fade::fade( fy0 );
+        T s = Fade::fade( fx0 );
+
+        T nx0 = grad( pp[ix0 + pp[iy0]], fx0, fy0 );
+        T nx1 = grad( pp[ix0 + pp[iy1]], fx0, fy1 );
+        T n0 = lerp( t, nx0, nx1 );
+
+        nx0 = grad( pp[ix1 + pp[iy0]], fx1, fy0 );
+        nx1 = grad( pp[ix1 + pp[iy1]], fx1, fy1 );
+        T n1 = lerp( t, nx0, nx1 );
+
+        return T(0.507) * lerp( s, n0, n1 );
+    }
+    static inline T noise(T x, T y) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x, y );
+    }
+    static inline T noise(const noiseContext &ctx, T x, T y) {
+        return noise( ctx.perm, ctx.mask, x, y );
+    }
+};
+
+template<typename T, typename Fade> struct Noise1234<T, 3, Fade> {
+    static inline T noise(const int *pp, int mask, T x, T y, T z) {
+        using namespace noise1234_detail;
+        int ix0 = fastfloor( x ); // Integer part of x
+        int iy0 = fastfloor( y ); // Integer part of y
+        int iz0 = fastfloor( z ); // Integer part of z
+        T fx0 = x - ix0;          // Fractional part of x
+        T fy0 = y - iy0;          // Fractional part of y
+        T fz0 = z - iz0;          // Fractional part of z
+        T fx1 = fx0 - T(1);
+        T fy1 = fy0 - T(1);
+        T fz1 = fz0 - T(1);
+        int ix1 = ( ix0 + 1 ) & mask; // Wrap to 0..period-1
+        int iy1 = ( iy0 + 1 ) & mask;
+        int iz1 = ( iz0 + 1 ) & mask;
+        ix0 = ix0 & mask;
+        iy0 = iy0 & mask;
+        iz0 = iz0 & mask;
+
+        T r = Fade::fade( fz0 );
+        T t = Fade::fade( fy0 );
+        T s = Fade::fade( fx0 );
+
+        T nxy0 = grad( pp[ix0 + pp[iy0 + pp[iz0]]], fx0, fy0, fz0 );
+        T nxy1 = grad( pp[ix0 + pp[iy0 + pp[iz1]]], fx0, fy0, fz1 );
+        T nx0 = lerp( r, nxy0, nxy1 );
+
+        nxy0 = grad( pp[ix0 + pp[iy1 + pp[iz0]]], fx0, fy1, fz0 );
+        nxy1 = grad( pp[ix0 + pp[iy1 + pp[iz1]]], fx0, fy1, fz1 );
+        T nx1 = lerp( r, nxy0, nxy1 );
+
+        T n0 = lerp( t, nx0, nx1 );
+
+        nxy0 = grad( pp[ix1 + pp[iy0 + pp[iz0]]], fx1, fy0, fz0 );
+        nxy1 = grad( pp[ix1 + pp[iy0 + pp[iz1]]], fx1, fy0, fz1 );
+        nx0 = lerp( r, nxy0, nxy1 );
+
+        nxy0 = grad( pp[ix1 + pp[iy1 + pp[iz0]]], fx1, fy1, fz0 );
+        nxy1 = grad( pp[ix1 + pp[iy1 + pp[iz1]]], fx1, fy1, fz1 );
+        nx1 = lerp( r, nxy0, nxy1 );
+
+        T n1 = lerp( t, nx0, nx1 );
+
+        return T(0.936) * lerp( s, n0, n1 );
+    }
+    static inline T noise(T x, T y, T z) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x, y, z );
+    }
+    static inline T noise(const noiseContext &ctx, T x, T y, T z) {
+        return noise( ctx.perm, ctx.mask, x, y, z );
+    }
+};
+
+template<typename T, typename Fade> struct Noise1234<T, 4, Fade> {
+    static inline T noise(const int *pp, int mask, T x, T y, T z, T w) {
+        using namespace noise1234_detail;
+        int ix[2], iy[2], iz[2], iw[2];
+        T fx[2], fy[2], fz[2], fw[2];
+        T nxy[2], nx[2], n[2];
+        int a, b, c;
+
+        ix[0] = fastfloor( x ); // Integer parts
+        iy[0] = fastfloor( y );
+        iz[0] = fastfloor( z );
+        iw[0] = fastfloor( w );
+        fx[0] = x - ix[0];      // Fractional parts
+        fy[0] = y - iy[0];
+        fz[0] = z - iz[0];
+        fw[0] = w - iw[0];
+        fx[1] = fx[0] - T(1);
+        fy[1] = fy[0] - T(1);
+        fz[1] = fz[0] - T(1);
+        fw[1] = fw[0] - T(1);
+        ix[1] = ( ix[0] + 1 ) & mask; // Wrap to 0..period-1
+        iy[1] = ( iy[0] + 1 ) & mask;
+        iz[1] = ( iz[0] + 1 ) & mask;
+        iw[1] = ( iw[0] + 1 ) & mask;
+        ix[0] &= mask;
+        iy[0] &= mask;
+        iz[0] &= mask;
+        iw[0] &= mask;
+
+        T q = Fade::fade( fw[0] );
+        T r = Fade::fade( fz[0] );
+        T t = Fade::fade( fy[0] );
+        T s = Fade::fade( fx[0] );
+
+        // The same order of LERP()s as noise4(), written as loops over
+        // the x, y and z corners. The loops have constant bounds, so the
+        // compiler unrolls them.
+        for( a = 0; a < 2; a++ ) {
+            for( b = 0; b < 2; b++ ) {
+                for( c = 0; c < 2; c++ ) {
+                    int h = iy[b] + pp[iz[c] + pp[iw[0]]];
+                    T nxyz0 = grad( pp[ix[a] + pp[h]], fx[a], fy[b], fz[c], fw[0] );
+                    h = iy[b] + pp[iz[c] + pp[iw[1]]];
+                    T nxyz1 = grad( pp[ix[a] + pp[h]], fx[a], fy[b], fz[c], fw[1] );
+                    nxy[c] = lerp( q, nxyz0, nxyz1 );
+                }
+                nx[b] = lerp( r, nxy[0], nxy[1] );
+            }
+            n[a] = lerp( t, nx[0], nx[1] );
+        }
+        return T(0.87) * lerp( s, n[0], n[1] );
+    }
+    static inline T noise(T x, T y, T z, T w) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x, y, z, w );
+    }
+    static inline T noise(const noiseContext &ctx, T x, T y, T z, T w) {
+        return noise( ctx.perm, ctx.mask, x, y, z, w );
+    }
+};
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ * SIMD kernels for the batch versions of noise2(), noise3() and noise4(),
+ * and of noise2_tiled() and noise3_tiled().
+ * This file is included several times from noise1234.c, once for each
+ * instruction set, after simdlanes.h has set up the lane macros. The
+ * fractal kernels in fractal.c include it too, for vnoise3().
+ *
+ * Each kernel computes SIMD_W noise values at once, using exactly the
+ * same sequence of float operations as the scalar code, so the results
+ * are the same as noise2(), noise3() and noise4() to within 1e-5.
+ * The lattice is hashed as in noisehashsimd.h, from the noise context.
+ */
+
+// This is the new and improved, C(2) continuous interpolant, as FADE()
+SIMD_FN vfloat SIMD_NAME(vfade)( vfloat t )
+{
+    return V_MUL( V_MUL( V_MUL( t, t ), t ),
+                  V_ADD( V_MUL( t, V_SUB( V_MUL( t, V_SET1( 6.0f ) ),
+                                         V_SET1( 15.0f ) ) ),
+                         V_SET1( 10.0f ) ) );
+}
+
+SIMD_FN vfloat SIMD_NAME(vlerp)( vfloat t, vfloat a, vfloat b )
+{
+    return V_ADD( a, V_MUL( t, V_SUB( b, a ) ) );
+}
+
+// Split x into its integer part, like FASTFLOOR(), and its fractional part
+SIMD_FN vint SIMD_NAME(vsplit)( vfloat x, vfloat *fx0 )
+{
+    vfloat fl = V_FLOOR( x );
+    *fx0 = V_SUB( x, fl );
+    return V_TOINT( fl );
+}
+
+/*
+ * Gradient functions, the SIMD versions of grad2(), grad3() and grad4().
+ * Like those, they look the gradients up in the tables from noisegrad.h.
+ */
+SIMD_FN vfloat SIMD_NAME(vgrad2)( vint hash, vfloat x, vfloat y )
+{
+    vint h = VI_AND( hash, VI_SET1( 15 ) );
+    vfloat gx = V_LOOKUP16( noiseGrad2[0], h );
+    vfloat gy = V_LOOKUP16( noiseGrad2[1], h );
+    return V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) );
+}
+
+SIMD_FN vfloat SIMD_NAME(vgrad3)( vint hash, vfloat x, vfloat y, vfloat z )
+{
+    vint h = VI_AND( hash, VI_SET1( 15 ) );
+    vfloat gx = V_LOOKUP16( noiseGrad3[0], h );
+    vfloat gy = V_LOOKUP16( noiseGrad3[1], h );
+    vfloat gz = V_LOOKUP16( noiseGrad3[2], h );
+    return V_ADD( V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) ), V_MUL( gz, z ) );
+}
+
+SIMD_FN vfloat SIMD_NAME(vgrad4)( vint hash, vfloat x, vfloat y, vfloat z, vfloat t )
+{
+    // One fetch of the packed gradient, then sign extend each byte
+    vint g = VI_LOOKUP32( noiseGrad4Packed, VI_AND( hash, VI_SET1( 31 ) ) );
+    vfloat gx = VI_TOFLOAT( VI_SRA( VI_SLL( g, 24 ), 24 ) );
+    vfloat gy = VI_TOFLOAT( VI_SRA( VI_SLL( g, 16 ), 24 ) );
+    vfloat gz = VI_TOFLOAT( VI_SRA( VI_SLL( g, 8 ), 24 ) );
+    vfloat gw = VI_TOFLOAT( VI_SRA( g, 24 ) );
+    return V_ADD( V_ADD( V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) ), V_MUL( gz, z ) ),
+                  V_MUL( gw, t ) );
+}
+
+#include "noisehashsimd.h"
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 2D float Perlin noise.
+ */
+SIMD_FN void SIMD_NAME(noise2_block)( const noiseContext *ctx,
+                                      const float *x, const float *y, float *out )
+{
+    vint ix0, iy0, ix1, iy1;
+    vfloat fx0, fy0, fx1, fy1;
+    vfloat s, t, nx0, nx1, n0, n1;
+    vint py0, py1;
+    HASH_SETUP( ctx );
+    vint one = VI_SET1( 1 );
+
+    ix0 = SIMD_NAME(vsplit)( V_LOADU( x ), &fx0 );
+    iy0 = SIMD_NAME(vsplit)( V_LOADU( y ), &fy0 );
+    fx1 = V_SUB( fx0, V_SET1( 1.0f ) );
+    fy1 = V_SUB( fy0, V_SET1( 1.0f ) );
+    ix1 = WRAP( VI_ADD( ix0, one ) ); // Wrap to 0..period-1
+    iy1 = WRAP( VI_ADD( iy0, one ) );
+    ix0 = WRAP( ix0 );
+    iy0 = WRAP( iy0 );
+
+    t = SIMD_NAME(vfade)( fy0 );
+    s = SIMD_NAME(vfade)( fx0 );
+
+    py0 = HASH( iy0 );
+    py1 = HASH( iy1 );
+
+    nx0 = SIMD_NAME(vgrad2)( PERM( ix0, py0 ), fx0, fy0 );
+    nx1 = SIMD_NAME(vgrad2)( PERM( ix0, py1 ), fx0, fy1 );
+    n0 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    nx0 = SIMD_NAME(vgrad2)( PERM( ix1, py0 ), fx1, fy0 );
+    nx1 = SIMD_NAME(vgrad2)( PERM( ix1, py1 ), fx1, fy1 );
+    n1 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    V_STOREU( out, V_MUL( V_SET1( 0.507f ), SIMD_NAME(vlerp)( s, n0, n1 ) ) );
+}
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 3D float Perlin noise. vnoise3() works on registers,
+ * for kernels that use the noise as a part, like the fractals in fractal.c.
+ */
+SIMD_FN vfloat SIMD_NAME(vnoise3)( const noiseContext *ctx, vfloat x, vfloat y, vfloat z )
+{
+    vint ix0, iy0, ix1, iy1, iz0, iz1;
+    vfloat fx0, fy0, fz0, fx1, fy1, fz1;
+    vfloat s, t, r;
+    vfloat nxy0, nxy1, nx0, nx1, n0, n1;
+    vint pz0, pz1, p00, p01, p10, p11;
+    HASH_SETUP( ctx );
+    vint one = VI_SET1( 1 );
+
+    ix0 = SIMD_NAME(vsplit)( x, &fx0 );
+    iy0 = SIMD_NAME(vsplit)( y, &fy0 );
+    iz0 = SIMD_NAME(vsplit)( z, &fz0 );
+    fx1 = V_SUB( fx0, V_SET1( 1.0f ) );
+    fy1 = V_SUB( fy0, V_SET1( 1.0f ) );
+    fz1 = V_SUB( fz0, V_SET1( 1.0f ) );
+    ix1 = WRAP( VI_ADD( ix0, one ) ); // Wrap to 0..period-1
+    iy1 = WRAP( VI_ADD( iy0, one ) );
+    iz1 = WRAP( VI_ADD( iz0, one ) );
+    ix0 = WRAP( ix0 );
+    iy0 = WRAP( iy0 );
+    iz0 = WRAP( iz0 );
+
+    r = SIMD_NAME(vfade)( fz0 );
+    t = SIMD_NAME(vfade)( fy0 );
+    s = SIMD_NAME(vfade)( fx0 );
+
+    // The inner two levels of the hash are shared between the x corners
+    pz0 = HASH( iz0 );
+    pz1 = HASH( iz1 );
+    p00 = PERM( iy0, pz0 );
+    p01 = PERM( iy0, pz1 );
+    p10 = PERM( iy1, pz0 );
+    p11 = PERM( iy1, pz1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( ix0, p00 ), fx0, fy0, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( ix0, p01 ), fx0, fy0, fz1 );
+    nx0 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( ix0, p10 ), fx0, fy1, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( ix0, p11 ), fx0, fy1, fz1 );
+    nx1 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    n0 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( ix1, p00 ), fx1, fy0, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( ix1, p01 ), fx1, fy0, fz1 );
+    nx0 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( ix1, p10 ), fx1, fy1, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( ix1, p11 ), fx1, fy1, fz1 );
+    nx1 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    n1 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    return V_MUL( V_SET1( 0.936f ), SIMD_NAME(vlerp)( s, n0, n1 ) );
+}
+
+SIMD_FN void SIMD_NAME(noise3_block)( const noiseContext *ctx, const float *x,
+                                      const float *y, const float *z, float *out )
+{
+    V_STOREU( out, SIMD_NAME(vnoise3)( ctx, V_LOADU( x ), V_LOADU( y ), V_LOADU( z ) ) );
+}
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 4D float Perlin noise.
+ * The 16 corners are visited in the same order as in noise4(), but
+ * written as a loop over the x, y and z corners to keep it short.
+ */
+SIMD_FN void SIMD_NAME(noise4_block)( const noiseContext *ctx,
+                                      const float *x, const float *y,
+                                      const float *z, const float *w, float *out )
+{
+    vint ix[2], iy[2], iz[2], iw[2], pw[2];
+    vfloat fx[2], fy[2], fz[2], fw[2];
+    vfloat s, t, r, q;
+    vfloat nxyz0, nxyz1, nxy[2], nx[2], n[2];
+    HASH_SETUP( ctx );
+    vint one = VI_SET1( 1 );
+    int a, b, c;
+
+    ix[0] = SIMD_NAME(vsplit)( V_LOADU( x ), &fx[0] );
+    iy[0] = SIMD_NAME(vsplit)( V_LOADU( y ), &fy[0] );
+    iz[0] = SIMD_NAME(vsplit)( V_LOADU( z ), &fz[0] );
+    iw[0] = SIMD_NAME(vsplit)( V_LOADU( w ), &fw[0] );
+    fx[1] = V_SUB( fx[0], V_SET1( 1.0f ) );
+    fy[1] = V_SUB( fy[0], V_SET1( 1.0f ) );
+    fz[1] = V_SUB( fz[0], V_SET1( 1.0f ) );
+    fw[1] = V_SUB( fw[0], V_SET1( 1.0f ) );
+    ix[1] = WRAP( VI_ADD( ix[0], one ) ); // Wrap to 0..period-1
+    iy[1] = WRAP( VI_ADD( iy[0], one ) );
+    iz[1] = WRAP( VI_ADD( iz[0], one ) );
+    iw[1] = WRAP( VI_ADD( iw[0], one ) );
+    ix[0] = WRAP( ix[0] );
+    iy[0] = WRAP( iy[0] );
+    iz[0] = WRAP( iz[0] );
+    iw[0] = WRAP( iw[0] );
+
+    q = SIMD_NAME(vfade)( fw[0] );
+    r = SIMD_NAME(vfade)( fz[0] );
+    t = SIMD_NAME(vfade)( fy[0] );
+    s = SIMD_NAME(vfade)( fx[0] );
+
+    pw[0] = HASH( iw[0] );
+    pw[1] = HASH( iw[1] );
+
+    for( a = 0; a < 2; a++ ) {
+        for( b = 0; b < 2; b++ ) {
+            for( c = 0; c < 2; c++ ) {
+                vint h0 = PERM( ix[a], PERM( iy[b], PERM( iz[c], pw[0] ) ) );
+                vint h1 = PERM( ix[a], PERM( iy[b], PERM( iz[c], pw[1] ) ) );
+                nxyz0 = SIMD_NAME(vgrad4)( h0, fx[a], fy[b], fz[c], fw[0] );
+                nxyz1 = SIMD_NAME(vgrad4)( h1, fx[a], fy[b], fz[c], fw[1] );
+                nxy[c] = SIMD_NAME(vlerp)( q, nxyz0, nxyz1 );
+            }
+            nx[b] = SIMD_NAME(vlerp)( r, nxy[0], nxy[1] );
+        }
+        n[a] = SIMD_NAME(vlerp)( t, nx[0], nx[1] );
+    }
+
+    V_STOREU( out, V_MUL( V_SET1( 0.87f ), SIMD_NAME(vlerp)( s, n[0], n[1] ) ) );
+}
+
+//---------------------------------------------------------------------
+/*
+ * Tilings only work with permutation tables, so here perm[a + b] is
+ * always a gather.
+ */
+#undef PERM
+#undef HASH
+#undef WRAP
+#undef HASH_SETUP
+#define PERM(a, b) VI_GATHER( pp, VI_ADD( a, b ) )
+
+/*
+ * Tiled periodic noise, the SIMD versions of noise2_tiled() and
+ * noise3_tiled(). vtile() splits x like vsplit(), wraps the integer part
+ * like tile_wrap() and looks up the hashes of the two lattice points
+ * around x in the wrap table of axis a.
+ */
+SIMD_FN void SIMD_NAME(vtile)( const noiseTiling *nt, int a, vfloat x,
+                               vfloat *fx0, vint *h0, vint *h1 )
+{
+    vfloat fl = V_FLOOR( x );
+    vint i;
+
+    *fx0 = V_SUB( x, fl );
+    i = SIMD_NAME(vwrap)( V_TOINT( fl ), (float)nt->period[a], nt->inv[a] );
+    *h0 = VI_GATHER( nt->wrap[a], i );
+    *h1 = VI_GATHER( nt->wrap[a], VI_ADD( i, VI_SET1( 1 ) ) );
+}
+
+SIMD_FN void SIMD_NAME(noise2_tiled_block)( const noiseTiling *nt, const float *x,
+                                            const float *y, float *out )
+{
+    const int *pp = nt->ctx->perm;
+    vint hx0, hy0, hx1, hy1;
+    vfloat fx0, fy0, fx1, fy1;
+    vfloat s, t, nx0, nx1, n0, n1;
+    vint py0, py1;
+
+    SIMD_NAME(vtile)( nt, 0, V_LOADU( x ), &fx0, &hx0, &hx1 );
+    SIMD_NAME(vtile)( nt, 1, V_LOADU( y ), &fy0, &hy0, &hy1 );
+    fx1 = V_SUB( fx0, V_SET1( 1.0f ) );
+    fy1 = V_SUB( fy0, V_SET1( 1.0f ) );
+
+    t = SIMD_NAME(vfade)( fy0 );
+    s = SIMD_NAME(vfade)( fx0 );
+
+    py0 = VI_GATHER( pp, hy0 );
+    py1 = VI_GATHER( pp, hy1 );
+
+    nx0 = SIMD_NAME(vgrad2)( PERM( hx0, py0 ), fx0, fy0 );
+    nx1 = SIMD_NAME(vgrad2)( PERM( hx0, py1 ), fx0, fy1 );
+    n0 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    nx0 = SIMD_NAME(vgrad2)( PERM( hx1, py0 ), fx1, fy0 );
+    nx1 = SIMD_NAME(vgrad2)( PERM( hx1, py1 ), fx1, fy1 );
+    n1 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    V_STOREU( out, V_MUL( V_SET1( 0.507f ), SIMD_NAME(vlerp)( s, n0, n1 ) ) );
+}
+
+SIMD_FN void SIMD_NAME(noise3_tiled_block)( const noiseTiling *nt, const float *x,
+                                            const float *y, const float *z, float *out )
+{
+    const int *pp = nt->ctx->perm;
+    vint hx0, hy0, hz0, hx1, hy1, hz1;
+    vfloat fx0, fy0, fz0, fx1, fy1, fz1;
+    vfloat s, t, r;
+    vfloat nxy0, nxy1, nx0, nx1, n0, n1;
+    vint pz0, pz1, p00, p01, p10, p11;
+
+    SIMD_NAME(vtile)( nt, 0, V_LOADU( x ), &fx0, &hx0, &hx1 );
+    SIMD_NAME(vtile)( nt, 1, V_LOADU( y ), &fy0, &hy0, &hy1 );
+    SIMD_NAME(vtile)( nt, 2, V_LOADU( z ), &fz0, &hz0, &hz1 );
+    fx1 = V_SUB( fx0, V_SET1( 1.0f ) );
+    fy1 = V_SUB( fy0, V_SET1( 1.0f ) );
+    fz1 = V_SUB( fz0, V_SET1( 1.0f ) );
+
+    r = SIMD_NAME(vfade)( fz0 );
+    t = SIMD_NAME(vfade)( fy0 );
+    s = SIMD_NAME(vfade)( fx0 );
+
+    pz0 = VI_GATHER( pp, hz0 );
+    pz1 = VI_GATHER( pp, hz1 );
+    p00 = PERM( hy0, pz0 );
+    p01 = PERM( hy0, pz1 );
+    p10 = PERM( hy1, pz0 );
+    p11 = PERM( hy1, pz1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( hx0, p00 ), fx0, fy0, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( hx0, p01 ), fx0, fy0, fz1 );
+    nx0 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( hx0, p10 ), fx0, fy1, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( hx0, p11 ), fx0, fy1, fz1 );
+    nx1 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    n0 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( hx1, p00 ), fx1, fy0, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( hx1, p01 ), fx1, fy0, fz1 );
+    nx0 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    nxy0 = SIMD_NAME(vgrad3)( PERM( hx1, p10 ), fx1, fy1, fz0 );
+    nxy1 = SIMD_NAME(vgrad3)( PERM( hx1, p11 ), fx1, fy1, fz1 );
+    nx1 = SIMD_NAME(vlerp)( r, nxy0, nxy1 );
+
+    n1 = SIMD_NAME(vlerp)( t, nx0, nx1 );
+
+    V_STOREU( out, V_MUL( V_SET1( 0.936f ), SIMD_NAME(vlerp)( s, n0, n1 ) ) );
+}
+
+#undef PERM
+#undef HASH
+#undef WRAP
+#undef HASH_SETUP
@@ -0,0 +1,165 @@
+/*
+ * Noise contexts: seeded permutation tables for noise1234 and
+ * simplexnoise1234. See noisecontext.h for details.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "noisecontext.h"
+#include "simdlanes.h"
+
+/*
+ * Ken Perlin's permutation table, the same as perm[] in noise1234.c
+ * and p[] in simplexnoise1234.c, repeated twice. It is stored as int
+ * rather than char, because the SIMD gather instructions fetch 32 bits.
+ */
+#define PERLIN_PERM \
+  151,160,137, 91, 90, 15,131, 13,201, 95, 96, 53,194,233,  7,225, \
+  140, 36,103, 30, 69,142,  8, 99, 37,240, 21, 10, 23,190,  6,148, \
+  247,120,234, 75,  0, 26,197, 62, 94,252,219,203,117, 35, 11, 32, \
+   57,177, 33, 88,237,149, 56, 87,174, 20,125,136,171,168, 68,175, \
+   74,165, 71,134,139, 48, 27,166, 77,146,158,231, 83,111,229,122, \
+   60,211,133,230,220,105, 92, 41, 55, 46,245, 40,244,102,143, 54, \
+   65, 25, 63,161,  1,216, 80, 73,209, 76,132,187,208, 89, 18,169, \
+  200,196,135,130,116,188,159, 86,164,100,109,198,173,186,  3, 64, \
+   52,217,226,250,124,123,  5,202, 38,147,118,126,255, 82, 85,212, \
+  207,206, 59,227, 47, 16, 58, 17,182,189, 28, 42,223,183,170,213, \
+  119,248,152,  2, 44,154,163, 70,221,153,101,155,167, 43,172,  9, \
+  129, 22, 39,253, 19, 98,108,110, 79,113,224,232,178,185,112,104, \
+  218,246, 97,228,251, 34,242,193,238,210,144, 12,191,179,162,241, \
+   81, 51,145,235,249, 14,239,107, 49,192,214, 31,181,199,106,157, \
+  184, 84,204,176,115,121, 50, 45,127,  4,150,254,138,236,205, 93, \
+  222,114, 67, 29, 24, 72,243,141,128,195, 78, 66,215, 61,156,180
+
+static SIMD_ALIGN(64) const int classic_perm[512] = {
+    PERLIN_PERM,
+    PERLIN_PERM
+};
+
+const noiseContext noiseClassic = { NOISE_PERIOD_SHORT, NOISE_PERIOD_SHORT-1,
+                                    classic_perm, NULL, NOISE_HASH_PERM, 0 };
+
+int noiseContextInit(noiseContext *ctx, unsigned long seed, int period) {
+    int *table;
+    int i, j, tmp;
+    unsigned long state;
+
+    ctx->perm = NULL;
+    ctx->mem = NULL;
+    if (period != NOISE_PERIOD_SHORT && period != NOISE_PERIOD_LONG) return -1;
+
+    // Over-allocate to be able to align the table to a cache line
+    ctx->mem = malloc(2 * period * sizeof(int) + 63);
+    if (!ctx->mem) return -1;
+    table = (int*) (((size_t) ctx->mem + 63) & ~(size_t) 63);
+    ctx->period = period;
+    ctx->mask = period - 1;
+    ctx->hash = NOISE_HASH_PERM;
+    ctx->offset = 0;
+
+    if (seed == 0 && period == NOISE_PERIOD_SHORT) {
+        for (i = 0; i < 256; i++) table[i] = classic_perm[i];
+    } else {
+        // Fisher-Yates shuffle of 0..period-1, driven by the same Knuth LCG
+        // that cellular.c uses, taking the high bits which are the good ones.
+        for (i = 0; i < period; i++) table[i] = i;
+        state = seed;
+        for (i = period - 1; i > 0; i--) {
+            state = (1402024253UL * state + 586950981UL) & 0xffffffffUL;
+            j = (int) ((state >> 8) % (unsigned long) (i + 1));
+            tmp = table[i];
+            table[i] = table[j];
+            table[j] = tmp;
+        }
+    }
+    // Repeat the table to avoid wrapping the index for each lookup
+    for (i = 0; i < period; i++) table[period + i] = table[i];
+
+    ctx->perm = table;
+    return 0;
+}
+
+/*
+ * The mod 289 hash, in float like the GLSL version. The SIMD kernels do
+ * the same float operations, which are all exact up to the quotient, so
+ * they get exactly the values of this table. When t is a multiple of 289,
+ * the quotient may round down and give 289 rather than 0, but it does so
+ * in both places.
+ */
+static int mod289_hash(int x, int offset) {
+    float t = (x * 34.0f + 1.0f) * x + offset;
+    return (int) (t - (float) floor(t * (1.0f / 289.0f)) * 289.0f);
+}
+
+/* The highest index that the noise functions look up in a mod 289
+   table: a wrapped coordinate plus one, plus a hash value. */
+#define MOD289_MAXINDEX (2 * NOISE_PERIOD_MOD289)
+
+int noiseContextInitMod289(noiseContext *ctx, unsigned long seed) {
+    int *table;
+    int i;
+
+    ctx->mem = malloc((MOD289_MAXINDEX + 1) * sizeof(int) + 63);
+    ctx->perm = NULL;
+    if (!ctx->mem) return -1;
+    table = (int*) (((size_t) ctx->mem + 63) & ~(size_t) 63);
+    ctx->period = NOISE_PERIOD_MOD289;
+    ctx->mask = -1;
+    ctx->hash = NOISE_HASH_MOD289;
+    ctx->offset = (int) (seed % NOISE_PERIOD_MOD289);
+    for (i = 0; i <= MOD289_MAXINDEX; i++) table[i] = mod289_hash(i, ctx->offset);
+    ctx->perm = table;
+    return 0;
+}
+
+void noiseContextDelete(noiseContext *ctx) {
+    free(ctx->mem);
+    ctx->mem = NULL;
+    ctx->perm = NULL;
+}
+
+int noiseTilingInit(noiseTiling *nt, const noiseContext *ctx,
+                    int px, int py, int pz, int pw) {
+    int period[4];
+    int *table;
+    int a, k, total, bits;
+
+    period[0] = px; period[1] = py; period[2] = pz; period[3] = pw;
+    nt->ctx = ctx;
+    nt->mem = NULL;
+    for (a = 0; a < 4; a++) nt->wrap[a] = NULL;
+    if (ctx->hash != NOISE_HASH_PERM) return -1;
+    total = 0;
+    for (a = 0; a < 4; a++) {
+        if (period[a] < 1 || period[a] > NOISE_TILE_MAXPERIOD) return -1;
+        total += period[a] + 1;
+    }
+    nt->mem = malloc(total * sizeof(int));
+    if (!nt->mem) return -1;
+
+    for (bits = 0; (1 << bits) < ctx->period; bits++)
+        ;
+    table = (int*) nt->mem;
+    for (a = 0; a < 4; a++) {
+        nt->period[a] = period[a];
+        nt->inv[a] = 1.0f / period[a];
+        for (k = 0; k < period[a]; k++) {
+            // Periods up to the context's can use the coordinate as it is.
+            // Longer ones fold the high bits in with one more permutation.
+            if (period[a] <= ctx->period) table[k] = k;
+            else table[k] = ctx->perm[(k & ctx->mask) + ctx->perm[k >> bits]];
+        }
+        table[period[a]] = table[0];
+        nt->wrap[a] = table;
+        table += period[a] + 1;
+    }
+    return 0;
+}
+
+void noiseTilingDelete(noiseTiling *nt) {
+    int a;
+
+    free(nt->mem);
+    nt->mem = NULL;
+    for (a = 0; a < 4; a++) nt->wrap[a] = NULL;
+}
@@ -0,0 +1,113 @@
+/*
+ * Noise contexts: seeded permutation tables for noise1234 and
+ * simplexnoise1234.
+ *
+ * The plain noise functions all share Ken Perlin's fixed permutation
+ * table. To get several independent looking noise fields, create one
+ * context per field with a different seed, and pass it to the *_ctx
+ * versions of the noise functions. A context is read-only once it has
+ * been initialized, so any number of threads may use it at the same time
+ * without locking.
+ */
+
+#ifndef NOISECONTEXT_H
+#define NOISECONTEXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Lattice periods. The long period repeats 16 times less often, at the
+   cost of a 32 KB table instead of a 2 KB one. */
+#define NOISE_PERIOD_SHORT 256
+#define NOISE_PERIOD_LONG  4096
+
+/* Lattice hashes */
+#define NOISE_HASH_PERM   0 /* A shuffled permutation table */
+#define NOISE_HASH_MOD289 1 /* The polynomial (34x^2 + x) mod 289 */
+
+/* The period of NOISE_HASH_MOD289 contexts */
+#define NOISE_PERIOD_MOD289 289
+
+typedef struct {
+    int period;     // Lattice period, NOISE_PERIOD_SHORT or NOISE_PERIOD_LONG,
+                    // or NOISE_PERIOD_MOD289
+    int mask;       // period-1, to wrap lattice coordinates to 0..period-1,
+                    // for NOISE_HASH_PERM
+    const int *perm; // 2*period entries, a permutation of 0..period-1 twice,
+                     // or 2*period+1 polynomial values for NOISE_HASH_MOD289,
+                     // aligned to a 64 byte cache line
+    void *mem;      // The allocation that perm points into
+    int hash;       // NOISE_HASH_PERM or NOISE_HASH_MOD289
+    int offset;     // Added to the polynomial before the remainder, from the
+                    // seed, for NOISE_HASH_MOD289
+} noiseContext;
+
+/* Ken Perlin's original table. This is what noise3() and snoise3() use. */
+extern const noiseContext noiseClassic;
+
+/*
+ * noiseContextInit() - Build a permutation table from a seed. Seed 0
+ * with NOISE_PERIOD_SHORT gives Ken Perlin's original table, so that
+ * the *_ctx functions return the same values as the plain ones.
+ * Returns 0 on success, -1 if the period is invalid or out of memory.
+ */
+int noiseContextInit(noiseContext *ctx, unsigned long seed, int period);
+
+/*
+ * noiseContextInitMod289() - Make a context that hashes lattice points
+ * with the permutation polynomial (34x^2 + x) mod 289, the same hash as
+ * the GLSL noise in lab3. The SIMD batch kernels evaluate the polynomial
+ * in registers instead of looking it up in a table, which takes the
+ * gathers off the critical path. The pattern is different from that of a
+ * permutation table, and the lattice repeats every 289 units. With seed 0
+ * the hash values are those of the shader; other seeds add an offset to
+ * the polynomial. The scalar functions still use perm, which holds the
+ * polynomial. The tiled functions and the C++ templates do not support
+ * these contexts. Returns 0 on success, -1 if out of memory.
+ */
+int noiseContextInitMod289(noiseContext *ctx, unsigned long seed);
+
+/* Free the table of a context made by noiseContextInit() or
+   noiseContextInitMod289() */
+void noiseContextDelete(noiseContext *ctx);
+
+/*
+ * Tilings for periodic noise. The *_tiled noise functions repeat with the
+ * periods of a tiling, which may be anything from 1 to NOISE_TILE_MAXPERIOD
+ * along each axis, independent of the period of the context. For each
+ * axis, the tiling holds a table with a hash of every lattice coordinate
+ * in one period, so the noise functions wrap a coordinate once instead of
+ * taking a remainder for every corner. Periods longer than the context's
+ * mix the high bits of the coordinate into its hash, so they do not
+ * repeat at the context period inside the tile.
+ */
+#define NOISE_TILE_MAXPERIOD 65536
+
+typedef struct {
+    const noiseContext *ctx; // Permutation table to hash with
+    int period[4];      // Periods along x, y, z and w
+    float inv[4];       // 1/period, to wrap coordinates without dividing
+    const int *wrap[4]; // wrap[a][k] is the hash of lattice coordinate k
+                        // along axis a, for k = 0..period[a]. The last
+                        // entry repeats the first, for the far corner.
+    void *mem;          // The allocation that the wrap tables point into
+} noiseTiling;
+
+/*
+ * noiseTilingInit() - Set up a tiling with the given periods, hashed with
+ * the table of ctx, which must outlive the tiling. For 2D and 3D noise,
+ * the unused periods should be 1. Returns 0 on success, -1 if a period is
+ * out of range, ctx is a NOISE_HASH_MOD289 context, or out of memory.
+ */
+int noiseTilingInit(noiseTiling *nt, const noiseContext *ctx,
+                    int px, int py, int pz, int pw);
+
+/* Free the tables of a tiling made by noiseTilingInit() */
+void noiseTilingDelete(noiseTiling *nt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
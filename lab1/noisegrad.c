@@ -0,0 +1,48 @@
+/*
+ * Gradient tables for noise1234 and simplexnoise1234.
+ * See noisegrad.h for details.
+ */
+
+#include "noisegrad.h"
+#include "simdlanes.h"
+
+SIMD_ALIGN(64) const float noiseGrad1[16] = {
+    1, 2, 3, 4, 5, 6, 7, 8, -1, -2, -3, -4, -5, -6, -7, -8
+};
+
+SIMD_ALIGN(64) const float noiseGrad2[2][16] = {
+    { 1,-1, 1,-1, 2, 2,-2,-2,  1,-1, 1,-1, 2, 2,-2,-2 }, // x
+    { 2, 2,-2,-2, 1,-1, 1,-1,  2, 2,-2,-2, 1,-1, 1,-1 }  // y
+};
+
+SIMD_ALIGN(64) const float noiseGrad3[3][16] = {
+    { 1,-1, 1,-1,  1,-1, 1,-1,  0, 0, 0, 0,  1, 0,-1, 0 }, // x
+    { 1, 1,-1,-1,  0, 0, 0, 0,  1,-1, 1,-1,  1,-1, 1,-1 }, // y
+    { 0, 0, 0, 0,  1, 1,-1,-1,  1, 1,-1,-1,  0, 1, 0,-1 }  // z
+};
+
+SIMD_ALIGN(64) const float noiseGrad4[4][32] = {
+    { 1,-1, 1,-1, 1,-1, 1,-1,  1,-1, 1,-1, 1,-1, 1,-1,
+      1,-1, 1,-1, 1,-1, 1,-1,  0, 0, 0, 0, 0, 0, 0, 0 }, // x
+    { 1, 1,-1,-1, 1, 1,-1,-1,  1, 1,-1,-1, 1, 1,-1,-1,
+      0, 0, 0, 0, 0, 0, 0, 0,  1,-1, 1,-1, 1,-1, 1,-1 }, // y
+    { 1, 1, 1, 1,-1,-1,-1,-1,  0, 0, 0, 0, 0, 0, 0, 0,
+      1, 1,-1,-1, 1, 1,-1,-1,  1, 1,-1,-1, 1, 1,-1,-1 }, // z
+    { 0, 0, 0, 0, 0, 0, 0, 0,  1, 1, 1, 1,-1,-1,-1,-1,
+      1, 1, 1, 1,-1,-1,-1,-1,  1, 1, 1, 1,-1,-1,-1,-1 }  // w
+};
+
+// Two's complement bytes, so that an arithmetic shift sign extends them
+#define PACK4(x, y, z, w) \
+    ( ((x) & 0xff) | (((y) & 0xff) << 8) | (((z) & 0xff) << 16) | ((w) * (1 << 24)) )
+
+SIMD_ALIGN(64) const int noiseGrad4Packed[32] = {
+    PACK4( 1, 1, 1, 0), PACK4(-1, 1, 1, 0), PACK4( 1,-1, 1, 0), PACK4(-1,-1, 1, 0),
+    PACK4( 1, 1,-1, 0), PACK4(-1, 1,-1, 0), PACK4( 1,-1,-1, 0), PACK4(-1,-1,-1, 0),
+    PACK4( 1, 1, 0, 1), PACK4(-1, 1, 0, 1), PACK4( 1,-1, 0, 1), PACK4(-1,-1, 0, 1),
+    PACK4( 1, 1, 0,-1), PACK4(-1, 1, 0,-1), PACK4( 1,-1, 0,-1), PACK4(-1,-1, 0,-1),
+    PACK4( 1, 0, 1, 1), PACK4(-1, 0, 1, 1), PACK4( 1, 0,-1, 1), PACK4(-1, 0,-1, 1),
+    PACK4( 1, 0, 1,-1), PACK4(-1, 0, 1,-1), PACK4( 1, 0,-1,-1), PACK4(-1, 0,-1,-1),
+    PACK4( 0, 1, 1, 1), PACK4( 0,-1, 1, 1), PACK4( 0, 1,-1, 1), PACK4( 0,-1,-1, 1),
+    PACK4( 0, 1, 1,-1), PACK4( 0,-1, 1,-1), PACK4( 0, 1,-1,-1), PACK4( 0,-1,-1,-1)
+};
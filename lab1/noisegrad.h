@@ -0,0 +1,46 @@
+/*
+ * Gradient tables for noise1234 and simplexnoise1234.
+ *
+ * The gradient functions grad1() to grad4() and sgrad1() to sgrad4() pick
+ * a gradient vector with the low bits of a hash and return its dot product
+ * with the offset vector. Instead of decoding the hash bits with a chain
+ * of ternaries, they look the gradient up in these tables. The tables are
+ * stored component by component, so that a SIMD kernel can fetch one
+ * component for all its lanes with a single lookup, and aligned to a
+ * 64 byte cache line.
+ *
+ * Every component is 0, +/-1 or +/-2 (and up to +/-8 in 1D), so all the
+ * products are exact and the dot products come out the same as with the
+ * ternaries.
+ */
+
+#ifndef NOISEGRAD_H
+#define NOISEGRAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 1D: 1.0, 2.0, ..., 8.0 with a random sign, indexed by hash & 15 */
+extern const float noiseGrad1[16];
+
+/* 2D: the 8 directions (+/-1, +/-2) and (+/-2, +/-1), repeated twice so
+   that they can be indexed by hash & 15 as well as hash & 7 */
+extern const float noiseGrad2[2][16];
+
+/* 3D: the 12 edge midpoints of a cube and 4 repeats, indexed by hash & 15 */
+extern const float noiseGrad3[3][16];
+
+/* 4D: the 32 edge midpoints of a hypercube, indexed by hash & 31 */
+extern const float noiseGrad4[4][32];
+
+/* The same 4D gradients with the components packed into the bytes of an
+   int, x in the lowest byte. The SIMD kernels fetch all four components
+   with one lookup in this table, rather than four in the one above. */
+extern const int noiseGrad4Packed[32];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
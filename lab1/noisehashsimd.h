@@ -0,0 +1,73 @@
+/*
+ * Lattice hashing for the SIMD kernels, from the hash of a noise context.
+ * This file is included from noise1234simd.h and simplexnoise1234simd.h,
+ * once for each instruction set, after simdlanes.h has set up the lane
+ * macros. The including file #undefs the macros when it is done.
+ *
+ * The macros expect the noise context in a local called ctx, and HASH and
+ * PERM also the locals that HASH_SETUP( ctx ) declares. With a
+ * permutation table, HASH and PERM are gathers from its 32-bit form. With
+ * NOISE_HASH_MOD289 they compute the permutation polynomial in registers
+ * instead, and never touch memory, which is where the gather-bound
+ * kernels spend most of their time.
+ *
+ * fractal.c includes both noise1234simd.h and simplexnoise1234simd.h for
+ * the same instruction set, so the functions here are only defined the
+ * first time for each one. The macros are defined every time.
+ */
+
+#undef NOISEHASH_FIRST
+#if SIMD_ISA == ISA_SSE2 && !defined(NOISEHASH_SSE2)
+#define NOISEHASH_SSE2
+#define NOISEHASH_FIRST
+#elif SIMD_ISA == ISA_SSE41 && !defined(NOISEHASH_SSE41)
+#define NOISEHASH_SSE41
+#define NOISEHASH_FIRST
+#elif SIMD_ISA == ISA_AVX2 && !defined(NOISEHASH_AVX2)
+#define NOISEHASH_AVX2
+#define NOISEHASH_FIRST
+#elif SIMD_ISA == ISA_AVX512 && !defined(NOISEHASH_AVX512)
+#define NOISEHASH_AVX512
+#define NOISEHASH_FIRST
+#endif
+
+#ifdef NOISEHASH_FIRST
+
+// Wrap integer lattice coordinates to 0..period-1, like tile_wrap()
+SIMD_FN vint SIMD_NAME(vwrap)( vint i, float period, float inv )
+{
+    vfloat fi = VI_TOFLOAT( i );
+    vfloat p = V_SET1( period );
+    vfloat w = V_SUB( fi, V_MUL( V_FLOOR( V_MUL( fi, V_SET1( inv ) ) ), p ) );
+    w = V_ADD( w, V_SEL( V_CMPLT( w, V_ZERO ), p, V_ZERO ) );
+    w = V_SUB( w, V_SEL( V_CMPGE( w, p ), p, V_ZERO ) );
+    return V_TOINT( w );
+}
+
+// (34x^2 + x + offset) mod 289, with the same float steps as the table
+// that noiseContextInitMod289() makes, so the values are the same
+SIMD_FN vint SIMD_NAME(vmod289)( vint x, vfloat offset )
+{
+    vfloat f = VI_TOFLOAT( x );
+    vfloat t = V_ADD( V_MUL( V_ADD( V_MUL( f, V_SET1( 34.0f ) ), V_SET1( 1.0f ) ), f ),
+                      offset );
+    vfloat q = V_FLOOR( V_MUL( t, V_SET1( 1.0f / 289.0f ) ) );
+    return V_TOINT( V_SUB( t, V_MUL( q, V_SET1( 289.0f ) ) ) );
+}
+
+#endif // NOISEHASH_FIRST
+
+// The locals that HASH and PERM use
+#define HASH_SETUP( ctx ) \
+    const int *pp = (ctx)->perm; \
+    int mod289 = (ctx)->hash == NOISE_HASH_MOD289; \
+    vfloat offset = V_SET1( (float)(ctx)->offset )
+
+// Wrap a lattice coordinate to the period, like lattice_wrap()
+#define WRAP(i) ( ctx->hash == NOISE_HASH_MOD289 \
+                 ? SIMD_NAME(vwrap)( i, 289.0f, 1.0f / 289.0f ) \
+                         : VI_AND( i, VI_SET1( ctx->mask ) ) )
+
+// perm[x] and perm[a + b]
+#define HASH(x) ( mod289 ? SIMD_NAME(vmod289)( x, offset ) : VI_GATHER( pp, x ) )
+#define PERM(a, b) HASH( VI_ADD( a, b ) )
@@ -0,0 +1,330 @@
+/*
+ * A thin layer of macros over the x86 SIMD intrinsics, to let us write
+ * each batch kernel once and compile it for several instruction sets.
+ *
+ * Define SIMD_ISA to one of the ISA_* levels from cpuisa.h and include
+ * this file, then include the kernel source. Repeat for the next level.
+ * Without SIMD_ISA, this only defines SIMD_ALIGN().
+ * Everything below the include guard is #undef'd and redefined on each
+ * inclusion, so this file is meant to be included several times.
+ *
+ * The kernels are compiled with a per-function target attribute, so the
+ * rest of the program can still be built for the baseline instruction set,
+ * and the kernels are only ever called after cpu_isa() says it's safe.
+ *
+ * Lane types:
+ *  vfloat - SIMD_W floats
+ *  vint   - SIMD_W 32-bit ints
+ *  vmask  - SIMD_W booleans, the result of a comparison. For SSE and AVX
+ *           this is an all-ones/all-zeros vfloat, for AVX-512 a bit mask.
+ *
+ * V_LOOKUP16(tab, idx) fetches tab[idx] from a float table of 16 entries,
+ * and VI_LOOKUP32(tab, idx) from an int table of 32 entries, both aligned
+ * to 64 bytes. Where the instruction set allows, this is done with
+ * permutes within registers, which is much faster than a gather. The
+ * index must be in range.
+ */
+
+#ifndef SIMDLANES_H
+#define SIMDLANES_H
+#include "cpuisa.h"
+#ifdef CPUISA_X86
+#include <immintrin.h>
+#endif
+#if defined(__GNUC__)
+#define SIMD_ALIGN(n) __attribute__((aligned(n)))
+#elif defined(_MSC_VER)
+#define SIMD_ALIGN(n) __declspec(align(n))
+#else
+#define SIMD_ALIGN(n)
+#endif
+#endif // SIMDLANES_H
+
+// Everything below is only for the kernel sources, which define SIMD_ISA
+#ifdef SIMD_ISA
+
+#undef SIMD_W
+#undef SIMD_FN
+#undef SIMD_NAME
+#undef vfloat
+#undef vint
+#undef vmask
+#undef V_SET1
+#undef V_ZERO
+#undef V_LOADU
+#undef V_STOREU
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_MIN
+#undef V_MAX
+#undef V_SQRT
+#undef V_FLOOR
+#undef V_TOINT
+#undef V_CMPLT
+#undef V_CMPLE
+#undef V_CMPGT
+#undef V_CMPGE
+#undef V_SEL
+#undef V_GATHER
+#undef V_LOOKUP16
+#undef VI_LOOKUP32
+#undef VI_SET1
+#undef VI_LOADU
+#undef VI_STOREU
+#undef VI_ADD
+#undef VI_SUB
+#undef VI_MUL
+#undef VI_AND
+#undef VI_OR
+#undef VI_XOR
+#undef VI_SRL
+#undef VI_SLL
+#undef VI_SRA
+#undef VI_TOFLOAT
+#undef VI_CMPEQ
+#undef VI_CMPLT
+#undef VI_SEL
+#undef VI_GATHER
+#undef VM_AND
+#undef VM_OR
+#undef VM_ANY
+#undef SIMD_TARGET
+
+#if defined(__GNUC__)
+#define SIMD_TARGET(t) __attribute__((target(t)))
+#else
+#define SIMD_TARGET(t)
+#endif
+
+#if SIMD_ISA == ISA_SSE2 || SIMD_ISA == ISA_SSE41
+//---------------------------------------------------------------------
+// 4 lanes, SSE2 or SSE4.1
+
+#define SIMD_W 4
+#define vfloat __m128
+#define vint   __m128i
+#define vmask  __m128
+
+#define V_SET1(a)     _mm_set1_ps(a)
+#define V_ZERO        _mm_setzero_ps()
+#define V_LOADU(p)    _mm_loadu_ps(p)
+#define V_STOREU(p,a) _mm_storeu_ps(p, a)
+#define V_ADD(a,b)    _mm_add_ps(a, b)
+#define V_SUB(a,b)    _mm_sub_ps(a, b)
+#define V_MUL(a,b)    _mm_mul_ps(a, b)
+#define V_DIV(a,b)    _mm_div_ps(a, b)
+#define V_MIN(a,b)    _mm_min_ps(a, b)
+#define V_MAX(a,b)    _mm_max_ps(a, b)
+#define V_SQRT(a)     _mm_sqrt_ps(a)
+#define V_TOINT(a)    _mm_cvttps_epi32(a)
+#define V_CMPLT(a,b)  _mm_cmplt_ps(a, b)
+#define V_CMPLE(a,b)  _mm_cmple_ps(a, b)
+#define V_CMPGT(a,b)  _mm_cmpgt_ps(a, b)
+#define V_CMPGE(a,b)  _mm_cmpge_ps(a, b)
+
+#define VI_SET1(a)     _mm_set1_epi32(a)
+#define VI_LOADU(p)    _mm_loadu_si128((const __m128i*)(p))
+#define VI_STOREU(p,a) _mm_storeu_si128((__m128i*)(p), a)
+#define VI_ADD(a,b)    _mm_add_epi32(a, b)
+#define VI_SUB(a,b)    _mm_sub_epi32(a, b)
+#define VI_AND(a,b)    _mm_and_si128(a, b)
+#define VI_OR(a,b)     _mm_or_si128(a, b)
+#define VI_XOR(a,b)    _mm_xor_si128(a, b)
+#define VI_SRL(a,n)    _mm_srli_epi32(a, n)
+#define VI_SLL(a,n)    _mm_slli_epi32(a, n)
+#define VI_SRA(a,n)    _mm_srai_epi32(a, n)
+#define VI_TOFLOAT(a)  _mm_cvtepi32_ps(a)
+#define VI_CMPEQ(a,b)  _mm_castsi128_ps(_mm_cmpeq_epi32(a, b))
+#define VI_CMPLT(a,b)  _mm_castsi128_ps(_mm_cmplt_epi32(a, b))
+
+#define VM_AND(a,b)    _mm_and_ps(a, b)
+#define VM_OR(a,b)     _mm_or_ps(a, b)
+#define VM_ANY(m)      (_mm_movemask_ps(m) != 0)
+
+// There are no gathers before AVX2, so we go through memory lane by lane
+#define VI_GATHER(tab,idx) simd_gather4_epi32(tab, idx)
+#define V_GATHER(tab,idx)  simd_gather4_ps(tab, idx)
+#define V_LOOKUP16(tab,idx) simd_gather4_ps(tab, idx)
+#define VI_LOOKUP32(tab,idx) simd_gather4_epi32(tab, idx)
+
+#if SIMD_ISA == ISA_SSE41
+#define SIMD_FN static inline SIMD_TARGET("sse4.1")
+#define SIMD_NAME(f) f##_sse41
+#define V_FLOOR(a)     _mm_floor_ps(a)
+#define V_SEL(m,a,b)   _mm_blendv_ps(b, a, m)
+#define VI_SEL(m,a,b)  _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b), \
+                                        _mm_castsi128_ps(a), m))
+#define VI_MUL(a,b)    _mm_mullo_epi32(a, b)
+#else
+#define SIMD_FN static inline SIMD_TARGET("sse2")
+#define SIMD_NAME(f) f##_sse2
+// Truncate, then step down by one where truncation rounded up
+#define V_FLOOR(a)     simd_floor_sse2(a)
+#define V_SEL(m,a,b)   _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#define VI_SEL(m,a,b)  _mm_castps_si128(V_SEL(m, _mm_castsi128_ps(a), \
+                                              _mm_castsi128_ps(b)))
+#define VI_MUL(a,b)    simd_mullo_sse2(a, b)
+#endif
+
+#elif SIMD_ISA == ISA_AVX2
+//---------------------------------------------------------------------
+// 8 lanes, AVX2
+
+#define SIMD_W 8
+#define SIMD_FN static inline SIMD_TARGET("avx2")
+#define SIMD_NAME(f) f##_avx2
+#define vfloat __m256
+#define vint   __m256i
+#define vmask  __m256
+
+#define V_SET1(a)     _mm256_set1_ps(a)
+#define V_ZERO        _mm256_setzero_ps()
+#define V_LOADU(p)    _mm256_loadu_ps(p)
+#define V_STOREU(p,a) _mm256_storeu_ps(p, a)
+#define V_ADD(a,b)    _mm256_add_ps(a, b)
+#define V_SUB(a,b)    _mm256_sub_ps(a, b)
+#define V_MUL(a,b)    _mm256_mul_ps(a, b)
+#define V_DIV(a,b)    _mm256_div_ps(a, b)
+#define V_MIN(a,b)    _mm256_min_ps(a, b)
+#define V_MAX(a,b)    _mm256_max_ps(a, b)
+#define V_SQRT(a)     _mm256_sqrt_ps(a)
+#define V_FLOOR(a)    _mm256_floor_ps(a)
+#define V_TOINT(a)    _mm256_cvttps_epi32(a)
+#define V_CMPLT(a,b)  _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define V_CMPLE(a,b)  _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define V_CMPGT(a,b)  _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define V_CMPGE(a,b)  _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define V_SEL(m,a,b)  _mm256_blendv_ps(b, a, m)
+#define V_GATHER(tab,idx) _mm256_i32gather_ps(tab, idx, 4)
+#define V_LOOKUP16(tab,idx) simd_lookup16_avx2(tab, idx)
+#define VI_LOOKUP32(tab,idx) _mm256_i32gather_epi32(tab, idx, 4)
+
+#define VI_SET1(a)     _mm256_set1_epi32(a)
+#define VI_LOADU(p)    _mm256_loadu_si256((const __m256i*)(p))
+#define VI_STOREU(p,a) _mm256_storeu_si256((__m256i*)(p), a)
+#define VI_ADD(a,b)    _mm256_add_epi32(a, b)
+#define VI_SUB(a,b)    _mm256_sub_epi32(a, b)
+#define VI_MUL(a,b)    _mm256_mullo_epi32(a, b)
+#define VI_AND(a,b)    _mm256_and_si256(a, b)
+#define VI_OR(a,b)     _mm256_or_si256(a, b)
+#define VI_XOR(a,b)    _mm256_xor_si256(a, b)
+#define VI_SRL(a,n)    _mm256_srli_epi32(a, n)
+#define VI_SLL(a,n)    _mm256_slli_epi32(a, n)
+#define VI_SRA(a,n)    _mm256_srai_epi32(a, n)
+#define VI_TOFLOAT(a)  _mm256_cvtepi32_ps(a)
+#define VI_CMPEQ(a,b)  _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))
+#define VI_CMPLT(a,b)  _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a))
+#define VI_SEL(m,a,b)  _mm256_castps_si256(_mm256_blendv_ps( \
+                         _mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m))
+#define VI_GATHER(tab,idx) _mm256_i32gather_epi32(tab, idx, 4)
+
+#define VM_AND(a,b)    _mm256_and_ps(a, b)
+#define VM_OR(a,b)     _mm256_or_ps(a, b)
+#define VM_ANY(m)      (_mm256_movemask_ps(m) != 0)
+
+#elif SIMD_ISA == ISA_AVX512
+//---------------------------------------------------------------------
+// 16 lanes, AVX-512F. Comparisons produce bit masks, and there are no
+// float bitwise operations in AVX-512F, so everything goes through selects.
+
+#define SIMD_W 16
+#define SIMD_FN static inline SIMD_TARGET("avx512f")
+#define SIMD_NAME(f) f##_avx512
+#define vfloat __m512
+#define vint   __m512i
+#define vmask  __mmask16
+
+#define V_SET1(a)     _mm512_set1_ps(a)
+#define V_ZERO        _mm512_setzero_ps()
+#define V_LOADU(p)    _mm512_loadu_ps(p)
+#define V_STOREU(p,a) _mm512_storeu_ps(p, a)
+#define V_ADD(a,b)    _mm512_add_ps(a, b)
+#define V_SUB(a,b)    _mm512_sub_ps(a, b)
+#define V_MUL(a,b)    _mm512_mul_ps(a, b)
+#define V_DIV(a,b)    _mm512_div_ps(a, b)
+#define V_MIN(a,b)    _mm512_min_ps(a, b)
+#define V_MAX(a,b)    _mm512_max_ps(a, b)
+#define V_SQRT(a)     _mm512_sqrt_ps(a)
+#define V_FLOOR(a)    _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+#define V_TOINT(a)    _mm512_cvttps_epi32(a)
+#define V_CMPLT(a,b)  _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)
+#define V_CMPLE(a,b)  _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ)
+#define V_CMPGT(a,b)  _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)
+#define V_CMPGE(a,b)  _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ)
+#define V_SEL(m,a,b)  _mm512_mask_blend_ps(m, b, a)
+#define V_GATHER(tab,idx) _mm512_i32gather_ps(idx, tab, 4)
+#define V_LOOKUP16(tab,idx) _mm512_permutexvar_ps(idx, _mm512_load_ps(tab))
+#define VI_LOOKUP32(tab,idx) _mm512_permutex2var_epi32(_mm512_load_si512(tab), idx, \
+                                                     _mm512_load_si512((tab) + 16))
+
+#define VI_SET1(a)     _mm512_set1_epi32(a)
+#define VI_LOADU(p)    _mm512_loadu_si512((const void*)(p))
+#define VI_STOREU(p,a) _mm512_storeu_si512((void*)(p), a)
+#define VI_ADD(a,b)    _mm512_add_epi32(a, b)
+#define VI_SUB(a,b)    _mm512_sub_epi32(a, b)
+#define VI_MUL(a,b)    _mm512_mullo_epi32(a, b)
+#define VI_AND(a,b)    _mm512_and_si512(a, b)
+#define VI_OR(a,b)     _mm512_or_si512(a, b)
+#define VI_XOR(a,b)    _mm512_xor_si512(a, b)
+#define VI_SRL(a,n)    _mm512_srli_epi32(a, n)
+#define VI_SLL(a,n)    _mm512_slli_epi32(a, n)
+#define VI_SRA(a,n)    _mm512_srai_epi32(a, n)
+#define VI_TOFLOAT(a)  _mm512_cvtepi32_ps(a)
+#define VI_CMPEQ(a,b)  _mm512_cmpeq_epi32_mask(a, b)
+#define VI_CMPLT(a,b)  _mm512_cmplt_epi32_mask(a, b)
+#define VI_SEL(m,a,b)  _mm512_mask_blend_epi32(m, b, a)
+#define VI_GATHER(tab,idx) _mm512_i32gather_epi32(idx, tab, 4)
+
+#define VM_AND(a,b)    ((vmask)((a) & (b)))
+#define VM_OR(a,b)     ((vmask)((a) | (b)))
+#define VM_ANY(m)      ((m) != 0)
+
+#else
+#error "simdlanes.h: SIMD_ISA must be ISA_SSE2, ISA_SSE41, ISA_AVX2 or ISA_AVX512"
+#endif
+
+// Helpers common to all lane widths
+#undef V_FMADD
+#undef V_NEGIF
+#define V_FMADD(a,b,c)  V_ADD(V_MUL(a, b), c)       // a*b+c, unfused on purpose
+#define V_NEGIF(m,a)    V_SEL(m, V_SUB(V_ZERO, a), a) // m ? -a : a
+
+// The SSE helper functions are defined once, on the first 4-lane inclusion
+#if SIMD_W == 4 && !defined(SIMDLANES_SSE_HELPERS)
+#define SIMDLANES_SSE_HELPERS
+static inline SIMD_TARGET("sse2") __m128i simd_gather4_epi32(const int *tab, __m128i idx) {
+    SIMD_ALIGN(16) int i[4];
+    _mm_store_si128((__m128i*)i, idx);
+    return _mm_setr_epi32(tab[i[0]], tab[i[1]], tab[i[2]], tab[i[3]]);
+}
+static inline SIMD_TARGET("sse2") __m128 simd_gather4_ps(const float *tab, __m128i idx) {
+    SIMD_ALIGN(16) int i[4];
+    _mm_store_si128((__m128i*)i, idx);
+    return _mm_setr_ps(tab[i[0]], tab[i[1]], tab[i[2]], tab[i[3]]);
+}
+static inline SIMD_TARGET("sse2") __m128 simd_floor_sse2(__m128 a) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+static inline SIMD_TARGET("sse2") __m128i simd_mullo_sse2(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+#endif
+
+// The AVX2 helper functions, likewise defined once
+#if SIMD_W == 8 && !defined(SIMDLANES_AVX2_HELPERS)
+#define SIMDLANES_AVX2_HELPERS
+// Two 8-entry permutes, and bit 3 of the index picks between them
+static inline SIMD_TARGET("avx2") __m256 simd_lookup16_avx2(const float *tab, __m256i idx) {
+    __m256 lo = _mm256_permutevar8x32_ps(_mm256_load_ps(tab), idx);
+    __m256 hi = _mm256_permutevar8x32_ps(_mm256_load_ps(tab + 8), idx);
+    return _mm256_blendv_ps(lo, hi, _mm256_castsi256_ps(_mm256_slli_epi32(idx, 28)));
+}
+#endif
+
+#endif // SIMD_ISA
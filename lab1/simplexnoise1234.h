@@ -33,9 +33,97 @@
  * on some platforms. Having both versions could be useful.
  */
 
+#include "noisecontext.h"
+
 /** 1D, 2D, 3D and 4D float Perlin simplex noise
  */
     float snoise1( float x );
     float snoise2( float x, float y );
     float snoise3( float x, float y, float z );
     float snoise4( float x, float y, float z, float w );
+
+/** 2D, 3D and 4D float Perlin simplex noise with the permutation table of
+ * a noise context instead of the built-in one. With noiseClassic, or a
+ * context made from seed 0, these are the same as snoise2() and so on.
+ * Contexts from noiseContextInitMod289() work as well, see noisecontext.h.
+ * Every function below has a *_ctx version in the same way.
+ */
+    float snoise2_ctx( const noiseContext *ctx, float x, float y );
+    float snoise3_ctx( const noiseContext *ctx, float x, float y, float z );
+    float snoise4_ctx( const noiseContext *ctx, float x, float y, float z, float w );
+
+/** 3D float Perlin simplex noise, with the analytic gradient returned in
+ * (*dnoise_dx, *dnoise_dy, *dnoise_dz). The value is the same as snoise3().
+ */
+    float snoise3_deriv( float x, float y, float z,
+                         float *dnoise_dx, float *dnoise_dy, float *dnoise_dz );
+    float snoise3_deriv_ctx( const noiseContext *ctx, float x, float y, float z,
+                             float *dnoise_dx, float *dnoise_dy, float *dnoise_dz );
+
+/** 4D float Perlin simplex noise with its analytic gradient, the 4D version
+ * of snoise3_deriv(). The value is the same as snoise4().
+ */
+    float snoise4_deriv( float x, float y, float z, float w,
+                         float *dnoise_dx, float *dnoise_dy, float *dnoise_dz,
+                         float *dnoise_dw );
+    float snoise4_deriv_ctx( const noiseContext *ctx, float x, float y, float z,
+                             float w, float *dnoise_dx, float *dnoise_dy,
+                             float *dnoise_dz, float *dnoise_dw );
+
+/** Batch 2D, 3D and 4D float Perlin simplex noise over structure-of-arrays
+ * input: out[i] = snoise3( x[i], y[i], z[i] ) for i = 0..n-1, and so on.
+ * Uses SSE2, AVX2 or AVX-512 where available, picked at run time.
+ * The results match the single point functions to within about 1e-4,
+ * except very close to simplex boundaries. See simplexnoise1234.c.
+ * As for noise2_batch() and the rest, a result does not depend on n or on
+ * the place of the point in the batch.
+ */
+    void snoise2_batch( const float *x, const float *y, float *out, int n );
+    void snoise3_batch( const float *x, const float *y, const float *z,
+                        float *out, int n );
+    void snoise4_batch( const float *x, const float *y, const float *z,
+                        const float *w, float *out, int n );
+    void snoise2_batch_ctx( const noiseContext *ctx, const float *x,
+                            const float *y, float *out, int n );
+    void snoise3_batch_ctx( const noiseContext *ctx, const float *x,
+                            const float *y, const float *z, float *out, int n );
+    void snoise4_batch_ctx( const noiseContext *ctx, const float *x,
+                            const float *y, const float *z, const float *w,
+                            float *out, int n );
+
+/** Batch version of snoise4_deriv(): out[i] is the noise value at
+ * ( x[i], y[i], z[i], w[i] ), and dx[i] to dw[i] its gradient. The value
+ * and gradient match snoise4_deriv() to about the same accuracy as above.
+ */
+    void snoise4_deriv_batch( const float *x, const float *y, const float *z,
+                              const float *w, float *out,
+                              float *dx, float *dy, float *dz, float *dw, int n );
+    void snoise4_deriv_batch_ctx( const noiseContext *ctx, const float *x,
+                                  const float *y, const float *z, const float *w,
+                                  float *out, float *dx, float *dy, float *dz,
+                                  float *dw, int n );
+
+/** 3D float Perlin simplex noise over a regular grid of nx*ny*nz samples.
+ * Sample (i,j,k) is snoise3( x0 + i*dx, y0 + j*dy, z0 + k*dz ), and it is
+ * written to out[ i + j*ystride + k*zstride ], a row at a time through
+ * snoise3_batch().
+ */
+    void snoise3_grid( float x0, float y0, float z0,
+                       float dx, float dy, float dz, int nx, int ny, int nz,
+                       float *out, int ystride, int zstride );
+    void snoise3_grid_ctx( const noiseContext *ctx, float x0, float y0, float z0,
+                           float dx, float dy, float dz, int nx, int ny, int nz,
+                           float *out, int ystride, int zstride );
+
+/** 2D float Perlin simplex noise, periodic with the periods of a tiling
+ * made by noiseTilingInit(). The tile is wrapped onto a torus in 4D and
+ * snoise4() is evaluated there, so this is as slow as snoise4(). The batch
+ * and grid versions go through snoise4_batch(), and the grid version
+ * writes sample (i,j), at ( x0 + i*dx, y0 + j*dy ), to out[ i + j*ystride ].
+ */
+    float snoise2_tiled( const noiseTiling *nt, float x, float y );
+    void snoise2_tiled_batch( const noiseTiling *nt, const float *x,
+                              const float *y, float *out, int n );
+    void snoise2_tiled_grid( const noiseTiling *nt, float x0, float y0,
+                             float dx, float dy, int nx, int ny,
+                             float *out, int ystride );
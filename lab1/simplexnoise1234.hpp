@@ -0,0 +1,279 @@
+/*
+ * Header-only C++ templates for Perlin simplex noise, with the scalar
+ * type picked at compile time, as the note in simplexnoise1234.h about
+ * float versus double suggests.
+ *
+ * SimplexNoise1234<T, Dim>::noise() is snoise1() to snoise4() from
+ * simplexnoise1234.c for T = float or double and Dim = 1 to 4:
+ *
+ *   float n = SimplexNoise1234<float, 3>::noise( x, y, z );
+ *
+ * Like the templates in noise1234.hpp, everything is inline with
+ * constant tables, so each instantiation compiles into the caller's loop.
+ * The skewing factors are kept in double precision and the intermediate
+ * results rounded to T in the same places as in the C code, so with
+ * float the results are the same as those of the C functions, given the
+ * same floating point options (see noise1234.hpp).
+ *
+ * The 4D version finds the order of the coordinates by counting, for
+ * each coordinate, how many of the others it is larger than, the same
+ * rank sorting as snoise4().
+ */
+
+#ifndef SIMPLEXNOISE1234_HPP
+#define SIMPLEXNOISE1234_HPP
+
+#include "noise1234.hpp"
+
+/*
+ * SimplexNoise1234<T, Dim>::noise(), 1D to 4D simplex noise.
+ * Only the specializations below are defined.
+ */
+template<typename T, int Dim> struct SimplexNoise1234;
+
+template<typename T> struct SimplexNoise1234<T, 1> {
+    static inline T noise(const int *pp, int mask, T x) {
+        using namespace noise1234_detail;
+        int i0 = fastfloor( x );
+        int i1 = i0 + 1;
+        T x0 = x - i0;
+        T x1 = x0 - T(1);
+
+        T t0 = T(1) - x0*x0;
+        t0 *= t0;
+        T n0 = t0 * t0 * grad( pp[i0 & mask], x0 );
+
+        T t1 = T(1) - x1*x1;
+        t1 *= t1;
+        T n1 = t1 * t1 * grad( pp[i1 & mask], x1 );
+        return T(0.25) * ( n0 + n1 );
+    }
+    static inline T noise(T x) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x );
+    }
+    static inline T noise(const noiseContext &ctx, T x) {
+        return noise( ctx.perm, ctx.mask, x );
+    }
+};
+
+template<typename T> struct SimplexNoise1234<T, 2> {
+    static inline T noise(const int *pp, int mask, T x, T y) {
+        using namespace noise1234_detail;
+        const double F2 = 0.366025403; // 0.5*(sqrt(3.0)-1.0)
+        const double G2 = 0.211324865; // (3.0-sqrt(3.0))/6.0
+
+        // Skew the input space to find the simplex cell we're in
+        T s = T( (x + y) * F2 );
+        int i = fastfloor( x + s );
+        int j = fastfloor( y + s );
+
+        T t = T( (T)(i + j) * G2 );
+        T x0 = x - ( i - t ); // The x,y distances from the cell origin
+        T y0 = y - ( j - t );
+
+        // Lower triangle (1,0) if x0>y0, upper triangle (0,1) otherwise
+        int i1 = x0 > y0 ? 1 : 0;
+        int j1 = 1 - i1;
+
+        T x1 = T( x0 - i1 + G2 ); // Offsets for the middle corner
+        T y1 = T( y0 - j1 + G2 );
+        T x2 = T( x0 - T(1) + 2.0 * G2 ); // Offsets for the last corner
+        T y2 = T( y0 - T(1) + 2.0 * G2 );
+
+        int ii = i & mask; // Wrap to 0..period-1
+        int jj = j & mask;
+
+        T n0 = 0, n1 = 0, n2 = 0; // Contributions from the three corners
+        T t0 = T(0.5) - x0*x0 - y0*y0;
+        if( t0 >= 0 ) {
+            t0 *= t0;
+            n0 = t0 * t0 * grad( pp[ii + pp[jj]], x0, y0 );
+        }
+        T t1 = T(0.5) - x1*x1 - y1*y1;
+        if( t1 >= 0 ) {
+            t1 *= t1;
+            n1 = t1 * t1 * grad( pp[ii + i1 + pp[jj + j1]], x1, y1 );
+        }
+        T t2 = T(0.5) - x2*x2 - y2*y2;
+        if( t2 >= 0 ) {
+            t2 *= t2;
+            n2 = t2 * t2 * grad( pp[ii + 1 + pp[jj + 1]], x2, y2 );
+        }
+        return T(40) * ( n0 + n1 + n2 );
+    }
+    static inline T noise(T x, T y) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x, y );
+    }
+    static inline T noise(const noiseContext &ctx, T x, T y) {
+        return noise( ctx.perm, ctx.mask, x, y );
+    }
+};
+
+template<typename T> struct SimplexNoise1234<T, 3> {
+    static inline T noise(const int *pp, int mask, T x, T y, T z) {
+        using namespace noise1234_detail;
+        const double F3 = 0.333333333;
+        const double G3 = 0.166666667;
+
+        // Skew the input space to find the simplex cell we're in
+        T s = T( (x + y + z) * F3 );
+        int i = fastfloor( x + s );
+        int j = fastfloor( y + s );
+        int k = fastfloor( z + s );
+
+        T t = T( (T)(i + j + k) * G3 );
+        T x0 = x - ( i - t ); // The x,y,z distances from the cell origin
+        T y0 = y - ( j - t );
+        T z0 = z - ( k - t );
+
+        // The rank of each coordinate, 2 for the largest and 0 for the
+        // smallest, with ties broken the same way as the branches in snoise3()
+        int rx = ( x0 >= y0 ) + ( x0 >= z0 );
+        int ry = ( y0 > x0 ) + ( y0 >= z0 );
+        int rz = ( z0 > x0 ) + ( z0 > y0 );
+
+        // The second corner steps along the largest coordinate, the third
+        // along the two largest
+        int i1 = rx >= 2, j1 = ry >= 2, k1 = rz >= 2;
+        int i2 = rx >= 1, j2 = ry >= 1, k2 = rz >= 1;
+
+        T x1 = T( x0 - i1 + G3 ); // Offsets for the second corner
+        T y1 = T( y0 - j1 + G3 );
+        T z1 = T( z0 - k1 + G3 );
+        T x2 = T( x0 - i2 + 2.0 * G3 ); // Offsets for the third corner
+        T y2 = T( y0 - j2 + 2.0 * G3 );
+        T z2 = T( z0 - k2 + 2.0 * G3 );
+        T x3 = T( x0 - T(1) + 3.0 * G3 ); // Offsets for the last corner
+        T y3 = T( y0 - T(1) + 3.0 * G3 );
+        T z3 = T( z0 - T(1) + 3.0 * G3 );
+
+        int ii = i & mask; // Wrap to 0..period-1
+        int jj = j & mask;
+        int kk = k & mask;
+
+        T n0 = 0, n1 = 0, n2 = 0, n3 = 0; // Contributions from the corners
+        T t0 = T(0.6) - x0*x0 - y0*y0 - z0*z0;
+        if( t0 >= 0 ) {
+            t0 *= t0;
+            n0 = t0 * t0 * grad( pp[ii + pp[jj + pp[kk]]], x0, y0, z0 );
+        }
+        T t1 = T(0.6) - x1*x1 - y1*y1 - z1*z1;
+        if( t1 >= 0 ) {
+            t1 *= t1;
+            n1 = t1 * t1 * grad( pp[ii + i1 + pp[jj + j1 + pp[kk + k1]]], x1, y1, z1 );
+        }
+        T t2 = T(0.6) - x2*x2 - y2*y2 - z2*z2;
+        if( t2 >= 0 ) {
+            t2 *= t2;
+            n2 = t2 * t2 * grad( pp[ii + i2 + pp[jj + j2 + pp[kk + k2]]], x2, y2, z2 );
+        }
+        T t3 = T(0.6) - x3*x3 - y3*y3 - z3*z3;
+        if( t3 >= 0 ) {
+            t3 *= t3;
+            n3 = t3 * t3 * grad( pp[ii + 1 + pp[jj + 1 + pp[kk + 1]]], x3, y3, z3 );
+        }
+        return T(32) * ( n0 + n1 + n2 + n3 );
+    }
+    static inline T noise(T x, T y, T z) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x, y, z );
+    }
+    static inline T noise(const noiseContext &ctx, T x, T y, T z) {
+        return noise( ctx.perm, ctx.mask, x, y, z );
+    }
+};
+
+template<typename T> struct SimplexNoise1234<T, 4> {
+    static inline T noise(const int *pp, int mask, T x, T y, T z, T w) {
+        using namespace noise1234_detail;
+        const double F4 = 0.309016994; // (sqrt(5.0)-1.0)/4.0
+        const double G4 = 0.138196601; // (5.0-sqrt(5.0))/20.0
+
+        // Skew the input space to find which cell of 24 simplices we're in
+        T s = T( (x + y + z + w) * F4 );
+        int i = fastfloor( x + s );
+        int j = fastfloor( y + s );
+        int k = fastfloor( z + s );
+        int l = fastfloor( w + s );
+
+        T t = T( (i + j + k + l) * G4 );
+        T x0 = x - ( i - t ); // The x,y,z,w distances from the cell origin
+        T y0 = y - ( j - t );
+        T z0 = z - ( k - t );
+        T w0 = w - ( l - t );
+
+        // The rank of each coordinate, 3 for the largest and 0 for the
+        // smallest, with ties broken the same way as in snoise4()
+        int rx = ( x0 > y0 ) + ( x0 > z0 ) + ( x0 > w0 );
+        int ry = ( y0 >= x0 ) + ( y0 > z0 ) + ( y0 > w0 );
+        int rz = ( z0 >= x0 ) + ( z0 >= y0 ) + ( z0 > w0 );
+        int rw = ( w0 >= x0 ) + ( w0 >= y0 ) + ( w0 >= z0 );
+
+        // The second corner steps along the largest coordinate, the third
+        // along the two largest and the fourth along the three largest
+        int i1 = rx >= 3, j1 = ry >= 3, k1 = rz >= 3, l1 = rw >= 3;
+        int i2 = rx >= 2, j2 = ry >= 2, k2 = rz >= 2, l2 = rw >= 2;
+        int i3 = rx >= 1, j3 = ry >= 1, k3 = rz >= 1, l3 = rw >= 1;
+
+        T x1 = T( x0 - i1 + G4 ); // Offsets for the second corner
+        T y1 = T( y0 - j1 + G4 );
+        T z1 = T( z0 - k1 + G4 );
+        T w1 = T( w0 - l1 + G4 );
+        T x2 = T( x0 - i2 + 2.0 * G4 ); // Offsets for the third corner
+        T y2 = T( y0 - j2 + 2.0 * G4 );
+        T z2 = T( z0 - k2 + 2.0 * G4 );
+        T w2 = T( w0 - l2 + 2.0 * G4 );
+        T x3 = T( x0 - i3 + 3.0 * G4 ); // Offsets for the fourth corner
+        T y3 = T( y0 - j3 + 3.0 * G4 );
+        T z3 = T( z0 - k3 + 3.0 * G4 );
+        T w3 = T( w0 - l3 + 3.0 * G4 );
+        T x4 = T( x0 - T(1) + 4.0 * G4 ); // Offsets for the last corner
+        T y4 = T( y0 - T(1) + 4.0 * G4 );
+        T z4 = T( z0 - T(1) + 4.0 * G4 );
+        T w4 = T( w0 - T(1) + 4.0 * G4 );
+
+        int ii = i & mask; // Wrap to 0..period-1
+        int jj = j & mask;
+        int kk = k & mask;
+        int ll = l & mask;
+
+        T n0 = 0, n1 = 0, n2 = 0, n3 = 0, n4 = 0; // Contributions
+        T t0 = T(0.6) - x0*x0 - y0*y0 - z0*z0 - w0*w0;
+        if( t0 >= 0 ) {
+            t0 *= t0;
+            n0 = t0 * t0 * grad( pp[ii + pp[jj + pp[kk + pp[ll]]]], x0, y0, z0, w0 );
+        }
+        T t1 = T(0.6) - x1*x1 - y1*y1 - z1*z1 - w1*w1;
+        if( t1 >= 0 ) {
+            t1 *= t1;
+            n1 = t1 * t1 * grad( pp[ii + i1 + pp[jj + j1 + pp[kk + k1 + pp[ll + l1]]]],
+                                 x1, y1, z1, w1 );
+        }
+        T t2 = T(0.6) - x2*x2 - y2*y2 - z2*z2 - w2*w2;
+        if( t2 >= 0 ) {
+            t2 *= t2;
+            n2 = t2 * t2 * grad( pp[ii + i2 + pp[jj + j2 + pp[kk + k2 + pp[ll + l2]]]],
+                                 x2, y2, z2, w2 );
+        }
+        T t3 = T(0.6) - x3*x3 - y3*y3 - z3*z3 - w3*w3;
+        if( t3 >= 0 ) {
+            t3 *= t3;
+            n3 = t3 * t3 * grad( pp[ii + i3 + pp[jj + j3 + pp[kk + k3 + pp[ll + l3]]]],
+                                 x3, y3, z3, w3 );
+        }
+        T t4 = T(0.6) - x4*x4 - y4*y4 - z4*z4 - w4*w4;
+        if( t4 >= 0 ) {
+            t4 *= t4;
+            n4 = t4 * t4 * grad( pp[ii + 1 + pp[jj + 1 + pp[kk + 1 + pp[ll + 1]]]],
+                                 x4, y4, z4, w4 );
+        }
+        return T(27) * ( n0 + n1 + n2 + n3 + n4 );
+    }
+    static inline T noise(T x, T y, T z, T w) {
+        return noise( noise1234_detail::Tables<T>::perm, 255, x, y, z, w );
+    }
+    static inline T noise(const noiseContext &ctx, T x, T y, T z, T w) {
+        return noise( ctx.perm, ctx.mask, x, y, z, w );
+    }
+};
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * SIMD kernels for the batch versions of snoise2(), snoise3(), snoise4()
+ * and snoise4_deriv().
+ * This file is included several times from simplexnoise1234.c, once for
+ * each instruction set, after simdlanes.h has set up the lane macros. The
+ * fractal kernels in fractal.c include it too, for vsnoise3().
+ *
+ * The scalar code decides which simplex a point is in with a tree of
+ * if-else tests. That can't be done across SIMD lanes, so the kernels
+ * compute the corner offsets directly from the comparison results instead.
+ * The offsets are the same as in the scalar code, ties included, but the
+ * scalar code does some of its arithmetic in double precision because
+ * the skewing constants are double literals. The kernels work in float
+ * throughout, so the results differ slightly from the scalar ones.
+ * See the comment above the batch functions in simplexnoise1234.c.
+ */
+
+// int 1 where m is set, 0 elsewhere
+#define MASK01(m) VI_SEL( m, VI_SET1( 1 ), VI_SET1( 0 ) )
+
+// Float versions of the skewing factors from simplexnoise1234.c
+#define F2f 0.366025403f
+#define G2f 0.211324865f
+#define F3f 0.333333333f
+#define G3f 0.166666667f
+#define F4f 0.309016994f
+#define G4f 0.138196601f
+
+// The SIMD versions of sgrad2(), sgrad3() and sgrad4(), with the same tables
+SIMD_FN vfloat SIMD_NAME(vsgrad2)( vint hash, vfloat x, vfloat y )
+{
+    vint h = VI_AND( hash, VI_SET1( 15 ) );
+    vfloat gx = V_LOOKUP16( noiseGrad2[0], h );
+    vfloat gy = V_LOOKUP16( noiseGrad2[1], h );
+    return V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) );
+}
+
+SIMD_FN vfloat SIMD_NAME(vsgrad3)( vint hash, vfloat x, vfloat y, vfloat z )
+{
+    vint h = VI_AND( hash, VI_SET1( 15 ) );
+    vfloat gx = V_LOOKUP16( noiseGrad3[0], h );
+    vfloat gy = V_LOOKUP16( noiseGrad3[1], h );
+    vfloat gz = V_LOOKUP16( noiseGrad3[2], h );
+    return V_ADD( V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) ), V_MUL( gz, z ) );
+}
+
+// The components of the 4D gradient, for the derivatives
+SIMD_FN void SIMD_NAME(vsgrad4comp)( vint hash, vfloat *gx, vfloat *gy,
+                                     vfloat *gz, vfloat *gw )
+{
+    // One fetch of the packed gradient, then sign extend each byte
+    vint g = VI_LOOKUP32( noiseGrad4Packed, VI_AND( hash, VI_SET1( 31 ) ) );
+    *gx = VI_TOFLOAT( VI_SRA( VI_SLL( g, 24 ), 24 ) );
+    *gy = VI_TOFLOAT( VI_SRA( VI_SLL( g, 16 ), 24 ) );
+    *gz = VI_TOFLOAT( VI_SRA( VI_SLL( g, 8 ), 24 ) );
+    *gw = VI_TOFLOAT( VI_SRA( g, 24 ) );
+}
+
+SIMD_FN vfloat SIMD_NAME(vsgrad4)( vint hash, vfloat x, vfloat y, vfloat z, vfloat t )
+{
+    vfloat gx, gy, gz, gw;
+    SIMD_NAME(vsgrad4comp)( hash, &gx, &gy, &gz, &gw );
+    return V_ADD( V_ADD( V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) ), V_MUL( gz, z ) ),
+                  V_MUL( gw, t ) );
+}
+
+// The falloff t^4 of one corner, with t = max( r2 - |d|^2, 0 )
+SIMD_FN vfloat SIMD_NAME(vfalloff)( vfloat t )
+{
+    t = V_MAX( t, V_ZERO );
+    t = V_MUL( t, t );
+    return V_MUL( t, t );
+}
+
+#include "noisehashsimd.h"
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 2D simplex noise.
+ */
+SIMD_FN void SIMD_NAME(snoise2_block)( const noiseContext *ctx,
+                                       const float *x, const float *y, float *out )
+{
+    HASH_SETUP( ctx );
+    vfloat vx = V_LOADU( x );
+    vfloat vy = V_LOADU( y );
+    vfloat s = V_MUL( V_ADD( vx, vy ), V_SET1( F2f ) );
+    vfloat fi = V_FLOOR( V_ADD( vx, s ) );
+    vfloat fj = V_FLOOR( V_ADD( vy, s ) );
+    vfloat t = V_MUL( V_ADD( fi, fj ), V_SET1( G2f ) );
+    vfloat x0 = V_SUB( vx, V_SUB( fi, t ) ); // The x,y distances from the cell origin
+    vfloat y0 = V_SUB( vy, V_SUB( fj, t ) );
+    vint ii = WRAP( V_TOINT( fi ) );
+    vint jj = WRAP( V_TOINT( fj ) );
+
+    // Lower triangle (1,0) if x0>y0, upper triangle (0,1) otherwise
+    vint i1 = MASK01( V_CMPGT( x0, y0 ) );
+    vint j1 = VI_SUB( VI_SET1( 1 ), i1 );
+
+    vfloat x1 = V_ADD( V_SUB( x0, VI_TOFLOAT( i1 ) ), V_SET1( G2f ) );
+    vfloat y1 = V_ADD( V_SUB( y0, VI_TOFLOAT( j1 ) ), V_SET1( G2f ) );
+    vfloat x2 = V_ADD( x0, V_SET1( -1.0f + 2.0f * G2f ) );
+    vfloat y2 = V_ADD( y0, V_SET1( -1.0f + 2.0f * G2f ) );
+    vint one = VI_SET1( 1 );
+    vfloat r2 = V_SET1( 0.5f );
+    vfloat n0, n1, n2;
+
+    n0 = V_MUL( SIMD_NAME(vfalloff)( V_SUB( V_SUB( r2, V_MUL( x0, x0 ) ), V_MUL( y0, y0 ) ) ),
+                SIMD_NAME(vsgrad2)( PERM( ii, HASH( jj ) ), x0, y0 ) );
+    n1 = V_MUL( SIMD_NAME(vfalloff)( V_SUB( V_SUB( r2, V_MUL( x1, x1 ) ), V_MUL( y1, y1 ) ) ),
+                SIMD_NAME(vsgrad2)( PERM( VI_ADD( ii, i1 ),
+                                          HASH( VI_ADD( jj, j1 ) ) ), x1, y1 ) );
+    n2 = V_MUL( SIMD_NAME(vfalloff)( V_SUB( V_SUB( r2, V_MUL( x2, x2 ) ), V_MUL( y2, y2 ) ) ),
+                SIMD_NAME(vsgrad2)( PERM( VI_ADD( ii, one ),
+                                          HASH( VI_ADD( jj, one ) ) ), x2, y2 ) );
+
+    V_STOREU( out, V_MUL( V_SET1( 40.0f ), V_ADD( V_ADD( n0, n1 ), n2 ) ) );
+}
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 3D simplex noise. vsnoise3() works on registers, for
+ * kernels that use the noise as a part, like the fractals in fractal.c.
+ */
+SIMD_FN vfloat SIMD_NAME(scorner3)( const noiseContext *ctx,
+                                    vint ii, vint jj, vint kk,
+                                    vfloat x, vfloat y, vfloat z )
+{
+    HASH_SETUP( ctx );
+    vfloat t = V_SUB( V_SUB( V_SUB( V_SET1( 0.6f ), V_MUL( x, x ) ),
+                             V_MUL( y, y ) ), V_MUL( z, z ) );
+    vint h = PERM( ii, PERM( jj, HASH( kk ) ) );
+    return V_MUL( SIMD_NAME(vfalloff)( t ), SIMD_NAME(vsgrad3)( h, x, y, z ) );
+}
+
+SIMD_FN vfloat SIMD_NAME(vsnoise3)( const noiseContext *ctx, vfloat vx, vfloat vy, vfloat vz )
+{
+    vfloat s = V_MUL( V_ADD( V_ADD( vx, vy ), vz ), V_SET1( F3f ) );
+    vfloat fi = V_FLOOR( V_ADD( vx, s ) );
+    vfloat fj = V_FLOOR( V_ADD( vy, s ) );
+    vfloat fk = V_FLOOR( V_ADD( vz, s ) );
+    vfloat t = V_MUL( V_ADD( V_ADD( fi, fj ), fk ), V_SET1( G3f ) );
+    vfloat x0 = V_SUB( vx, V_SUB( fi, t ) ); // The x,y,z distances from the cell origin
+    vfloat y0 = V_SUB( vy, V_SUB( fj, t ) );
+    vfloat z0 = V_SUB( vz, V_SUB( fk, t ) );
+    vint ii = WRAP( V_TOINT( fi ) );
+    vint jj = WRAP( V_TOINT( fj ) );
+    vint kk = WRAP( V_TOINT( fk ) );
+    vint one = VI_SET1( 1 );
+
+    // The six cases of the if-else tree in snoise3(), written as logic on
+    // the three comparisons it makes. Exactly one of i1,j1,k1 is 1, and
+    // exactly two of i2,j2,k2.
+    vint xy = MASK01( V_CMPGE( x0, y0 ) );
+    vint yx = VI_SUB( one, xy );
+    vint yz = MASK01( V_CMPGE( y0, z0 ) );
+    vint xz = MASK01( V_CMPGE( x0, z0 ) );
+    vint i1 = VI_AND( xy, xz );
+    vint j1 = VI_AND( yx, yz );
+    vint k1 = VI_SUB( VI_SUB( one, i1 ), j1 );
+    vint i2 = VI_OR( xy, xz );
+    vint j2 = VI_OR( yx, yz );
+    vint k2 = VI_SUB( VI_SUB( VI_SET1( 2 ), i2 ), j2 );
+
+    vfloat g1 = V_SET1( G3f ), g2 = V_SET1( 2.0f*G3f ), g3 = V_SET1( -1.0f + 3.0f*G3f );
+    vfloat n;
+
+    n = SIMD_NAME(scorner3)( ctx, ii, jj, kk, x0, y0, z0 );
+    n = V_ADD( n, SIMD_NAME(scorner3)( ctx, VI_ADD( ii, i1 ), VI_ADD( jj, j1 ), VI_ADD( kk, k1 ),
+                                       V_ADD( V_SUB( x0, VI_TOFLOAT( i1 ) ), g1 ),
+                                       V_ADD( V_SUB( y0, VI_TOFLOAT( j1 ) ), g1 ),
+                                       V_ADD( V_SUB( z0, VI_TOFLOAT( k1 ) ), g1 ) ) );
+    n = V_ADD( n, SIMD_NAME(scorner3)( ctx, VI_ADD( ii, i2 ), VI_ADD( jj, j2 ), VI_ADD( kk, k2 ),
+                                       V_ADD( V_SUB( x0, VI_TOFLOAT( i2 ) ), g2 ),
+                                       V_ADD( V_SUB( y0, VI_TOFLOAT( j2 ) ), g2 ),
+                                       V_ADD( V_SUB( z0, VI_TOFLOAT( k2 ) ), g2 ) ) );
+    n = V_ADD( n, SIMD_NAME(scorner3)( ctx, VI_ADD( ii, one ), VI_ADD( jj, one ), VI_ADD( kk, one ),
+                                       V_ADD( x0, g3 ), V_ADD( y0, g3 ), V_ADD( z0, g3 ) ) );
+
+    return V_MUL( V_SET1( 32.0f ), n );
+}
+
+SIMD_FN void SIMD_NAME(snoise3_block)( const noiseContext *ctx, const float *x,
+                                       const float *y, const float *z, float *out )
+{
+    V_STOREU( out, SIMD_NAME(vsnoise3)( ctx, V_LOADU( x ), V_LOADU( y ), V_LOADU( z ) ) );
+}
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 4D simplex noise.
+ * The corners come from the same rank sorting as in snoise4(): for each
+ * coordinate, count how many of the others it is larger than.
+ */
+SIMD_FN vfloat SIMD_NAME(scorner4)( const noiseContext *ctx,
+                                    vint ii, vint jj, vint kk, vint ll,
+                                    vfloat x, vfloat y, vfloat z, vfloat w )
+{
+    HASH_SETUP( ctx );
+    vfloat t = V_SUB( V_SUB( V_SUB( V_SUB( V_SET1( 0.6f ), V_MUL( x, x ) ),
+                                    V_MUL( y, y ) ), V_MUL( z, z ) ), V_MUL( w, w ) );
+    vint h = PERM( ii, PERM( jj, PERM( kk, HASH( ll ) ) ) );
+    return V_MUL( SIMD_NAME(vfalloff)( t ), SIMD_NAME(vsgrad4)( h, x, y, z, w ) );
+}
+
+SIMD_FN void SIMD_NAME(snoise4_block)( const noiseContext *ctx,
+                                       const float *x, const float *y,
+                                       const float *z, const float *w, float *out )
+{
+    vfloat vx = V_LOADU( x );
+    vfloat vy = V_LOADU( y );
+    vfloat vz = V_LOADU( z );
+    vfloat vw = V_LOADU( w );
+    vfloat s = V_MUL( V_ADD( V_ADD( V_ADD( vx, vy ), vz ), vw ), V_SET1( F4f ) );
+    vfloat fi = V_FLOOR( V_ADD( vx, s ) );
+    vfloat fj = V_FLOOR( V_ADD( vy, s ) );
+    vfloat fk = V_FLOOR( V_ADD( vz, s ) );
+    vfloat fl = V_FLOOR( V_ADD( vw, s ) );
+    vfloat t = V_MUL( V_ADD( V_ADD( V_ADD( fi, fj ), fk ), fl ), V_SET1( G4f ) );
+    vfloat x0 = V_SUB( vx, V_SUB( fi, t ) ); // The x,y,z,w distances from the cell origin
+    vfloat y0 = V_SUB( vy, V_SUB( fj, t ) );
+    vfloat z0 = V_SUB( vz, V_SUB( fk, t ) );
+    vfloat w0 = V_SUB( vw, V_SUB( fl, t ) );
+    vint ii = WRAP( V_TOINT( fi ) );
+    vint jj = WRAP( V_TOINT( fj ) );
+    vint kk = WRAP( V_TOINT( fk ) );
+    vint ll = WRAP( V_TOINT( fl ) );
+    vint one = VI_SET1( 1 );
+    vint two = VI_SET1( 2 );
+    vint three = VI_SET1( 3 );
+
+    // The six pair-wise comparisons from snoise4(), summed into ranks 0..3
+    vint cxy = MASK01( V_CMPGT( x0, y0 ) );
+    vint cxz = MASK01( V_CMPGT( x0, z0 ) );
+    vint cyz = MASK01( V_CMPGT( y0, z0 ) );
+    vint cxw = MASK01( V_CMPGT( x0, w0 ) );
+    vint cyw = MASK01( V_CMPGT( y0, w0 ) );
+    vint czw = MASK01( V_CMPGT( z0, w0 ) );
+    vint rx = VI_ADD( VI_ADD( cxy, cxz ), cxw );
+    vint ry = VI_ADD( VI_ADD( VI_SUB( one, cxy ), cyz ), cyw );
+    vint rz = VI_ADD( VI_SUB( two, VI_ADD( cxz, cyz ) ), czw );
+    vint rw = VI_SUB( three, VI_ADD( VI_ADD( cxw, cyw ), czw ) );
+
+    // Corner k+1 has offset 1 in the coordinates of rank >= 3-k
+    vint i1 = MASK01( VI_CMPEQ( rx, three ) );
+    vint j1 = MASK01( VI_CMPEQ( ry, three ) );
+    vint k1 = MASK01( VI_CMPEQ( rz, three ) );
+    vint l1 = MASK01( VI_CMPEQ( rw, three ) );
+    vint i2 = MASK01( VI_CMPLT( one, rx ) );
+    vint j2 = MASK01( VI_CMPLT( one, ry ) );
+    vint k2 = MASK01( VI_CMPLT( one, rz ) );
+    vint l2 = MASK01( VI_CMPLT( one, rw ) );
+    vint i3 = MASK01( VI_CMPLT( VI_SET1( 0 ), rx ) );
+    vint j3 = MASK01( VI_CMPLT( VI_SET1( 0 ), ry ) );
+    vint k3 = MASK01( VI_CMPLT( VI_SET1( 0 ), rz ) );
+    vint l3 = MASK01( VI_CMPLT( VI_SET1( 0 ), rw ) );
+
+    vfloat g1 = V_SET1( G4f ), g2 = V_SET1( 2.0f*G4f ), g3 = V_SET1( 3.0f*G4f );
+    vfloat g4 = V_SET1( -1.0f + 4.0f*G4f );
+    vfloat n;
+
+    n = SIMD_NAME(scorner4)( ctx, ii, jj, kk, ll, x0, y0, z0, w0 );
+    n = V_ADD( n, SIMD_NAME(scorner4)( ctx, VI_ADD( ii, i1 ), VI_ADD( jj, j1 ),
+                                       VI_ADD( kk, k1 ), VI_ADD( ll, l1 ),
+                                       V_ADD( V_SUB( x0, VI_TOFLOAT( i1 ) ), g1 ),
+                                       V_ADD( V_SUB( y0, VI_TOFLOAT( j1 ) ), g1 ),
+                                       V_ADD( V_SUB( z0, VI_TOFLOAT( k1 ) ), g1 ),
+                                       V_ADD( V_SUB( w0, VI_TOFLOAT( l1 ) ), g1 ) ) );
+    n = V_ADD( n, SIMD_NAME(scorner4)( ctx, VI_ADD( ii, i2 ), VI_ADD( jj, j2 ),
+                                       VI_ADD( kk, k2 ), VI_ADD( ll, l2 ),
+                                       V_ADD( V_SUB( x0, VI_TOFLOAT( i2 ) ), g2 ),
+                                       V_ADD( V_SUB( y0, VI_TOFLOAT( j2 ) ), g2 ),
+                                       V_ADD( V_SUB( z0, VI_TOFLOAT( k2 ) ), g2 ),
+                                       V_ADD( V_SUB( w0, VI_TOFLOAT( l2 ) ), g2 ) ) );
+    n = V_ADD( n, SIMD_NAME(scorner4)( ctx, VI_ADD( ii, i3 ), VI_ADD( jj, j3 ),
+                                       VI_ADD( kk, k3 ), VI_ADD( ll, l3 ),
+                                       V_ADD( V_SUB( x0, VI_TOFLOAT( i3 ) ), g3 ),
+                                       V_ADD( V_SUB( y0, VI_TOFLOAT( j3 ) ), g3 ),
+                                       V_ADD( V_SUB( z0, VI_TOFLOAT( k3 ) ), g3 ),
+                                       V_ADD( V_SUB( w0, VI_TOFLOAT( l3 ) ), g3 ) ) );
+    n = V_ADD( n, SIMD_NAME(scorner4)( ctx, VI_ADD( ii, one ), VI_ADD( jj, one ),
+                                       VI_ADD( kk, one ), VI_ADD( ll, one ),
+                                       V_ADD( x0, g4 ), V_ADD( y0, g4 ),
+                                       V_ADD( z0, g4 ), V_ADD( w0, g4 ) ) );
+
+    V_STOREU( out, V_MUL( V_SET1( 27.0f ), n ) );
+}
+
+//---------------------------------------------------------------------
+/** SIMD_W lanes of 4D simplex noise with analytic derivatives, as in
+ * snoise4_deriv(). The simplex is found the same way as in snoise4_block().
+ */
+
+// Add one corner's value and derivatives to the sums, see snoise3_deriv()
+SIMD_FN void SIMD_NAME(scorner4_deriv)( const noiseContext *ctx,
+                                        vint ii, vint jj, vint kk, vint ll,
+                                        vfloat x, vfloat y, vfloat z, vfloat w,
+                                        vfloat *n, vfloat *dx, vfloat *dy,
+                                        vfloat *dz, vfloat *dw )
+{
+    HASH_SETUP( ctx );
+    vfloat t1 = V_SUB( V_SUB( V_SUB( V_SUB( V_SET1( 0.6f ), V_MUL( x, x ) ),
+                                     V_MUL( y, y ) ), V_MUL( z, z ) ), V_MUL( w, w ) );
+    vint h = PERM( ii, PERM( jj, PERM( kk, HASH( ll ) ) ) );
+    vfloat gx, gy, gz, gw, gd, t2, t4, tmp;
+
+    SIMD_NAME(vsgrad4comp)( h, &gx, &gy, &gz, &gw );
+    gd = V_ADD( V_ADD( V_ADD( V_MUL( gx, x ), V_MUL( gy, y ) ), V_MUL( gz, z ) ),
+                V_MUL( gw, w ) );
+    t1 = V_MAX( t1, V_ZERO );
+    t2 = V_MUL( t1, t1 );
+    t4 = V_MUL( t2, t2 );
+    tmp = V_MUL( V_MUL( V_SET1( -8.0f ), V_MUL( t2, t1 ) ), gd );
+    *n = V_ADD( *n, V_MUL( t4, gd ) );
+    *dx = V_ADD( *dx, V_ADD( V_MUL( t4, gx ), V_MUL( tmp, x ) ) );
+    *dy = V_ADD( *dy, V_ADD( V_MUL( t4, gy ), V_MUL( tmp, y ) ) );
+    *dz = V_ADD( *dz, V_ADD( V_MUL( t4, gz ), V_MUL( tmp, z ) ) );
+    *dw = V_ADD( *dw, V_ADD( V_MUL( t4, gw ), V_MUL( tmp, w ) ) );
+}
+
+SIMD_FN void SIMD_NAME(snoise4_deriv_block)( const noiseContext *ctx,
+                                             const float *x, const float *y,
+                                             const float *z, const float *w,
+                                             float *out, float *dnx, float *dny,
+                                             float *dnz, float *dnw )
+{
+    vfloat vx = V_LOADU( x );
+    vfloat vy = V_LOADU( y );
+    vfloat vz = V_LOADU( z );
+    vfloat vw = V_LOADU( w );
+    vfloat s = V_MUL( V_ADD( V_ADD( V_ADD( vx, vy ), vz ), vw ), V_SET1( F4f ) );
+    vfloat fi = V_FLOOR( V_ADD( vx, s ) );
+    vfloat fj = V_FLOOR( V_ADD( vy, s ) );
+    vfloat fk = V_FLOOR( V_ADD( vz, s ) );
+    vfloat fl = V_FLOOR( V_ADD( vw, s ) );
+    vfloat t = V_MUL( V_ADD( V_ADD( V_ADD( fi, fj ), fk ), fl ), V_SET1( G4f ) );
+    vfloat x0 = V_SUB( vx, V_SUB( fi, t ) ); // The x,y,z,w distances from the cell origin
+    vfloat y0 = V_SUB( vy, V_SUB( fj, t ) );
+    vfloat z0 = V_SUB( vz, V_SUB( fk, t ) );
+    vfloat w0 = V_SUB( vw, V_SUB( fl, t ) );
+    vint ii = WRAP( V_TOINT( fi ) );
+    vint jj = WRAP( V_TOINT( fj ) );
+    vint kk = WRAP( V_TOINT( fk ) );
+    vint ll = WRAP( V_TOINT( fl ) );
+    vint one = VI_SET1( 1 );
+    vint two = VI_SET1( 2 );
+    vint three = VI_SET1( 3 );
+    vint c, ic, jc, kc, lc;
+    vfloat n = V_ZERO, dx = V_ZERO, dy = V_ZERO, dz = V_ZERO, dw = V_ZERO;
+    vfloat g;
+    int k;
+
+    vint cxy = MASK01( V_CMPGT( x0, y0 ) );
+    vint cxz = MASK01( V_CMPGT( x0, z0 ) );
+    vint cyz = MASK01( V_CMPGT( y0, z0 ) );
+    vint cxw = MASK01( V_CMPGT( x0, w0 ) );
+    vint cyw = MASK01( V_CMPGT( y0, w0 ) );
+    vint czw = MASK01( V_CMPGT( z0, w0 ) );
+    vint rx = VI_ADD( VI_ADD( cxy, cxz ), cxw );
+    vint ry = VI_ADD( VI_ADD( VI_SUB( one, cxy ), cyz ), cyw );
+    vint rz = VI_ADD( VI_SUB( two, VI_ADD( cxz, cyz ) ), czw );
+    vint rw = VI_SUB( three, VI_ADD( VI_ADD( cxw, cyw ), czw ) );
+
+    // Corner k has offset 1 in the coordinates of rank > 3-k
+    for( k = 0; k < 5; k++ ) {
+        c = VI_SET1( 3 - k );
+        g = V_SET1( k * G4f );
+        ic = MASK01( VI_CMPLT( c, rx ) );
+        jc = MASK01( VI_CMPLT( c, ry ) );
+        kc = MASK01( VI_CMPLT( c, rz ) );
+        lc = MASK01( VI_CMPLT( c, rw ) );
+        SIMD_NAME(scorner4_deriv)( ctx, VI_ADD( ii, ic ), VI_ADD( jj, jc ),
+                                   VI_ADD( kk, kc ), VI_ADD( ll, lc ),
+                                   V_ADD( V_SUB( x0, VI_TOFLOAT( ic ) ), g ),
+                                   V_ADD( V_SUB( y0, VI_TOFLOAT( jc ) ), g ),
+                                   V_ADD( V_SUB( z0, VI_TOFLOAT( kc ) ), g ),
+                                   V_ADD( V_SUB( w0, VI_TOFLOAT( lc ) ), g ),
+                                   &n, &dx, &dy, &dz, &dw );
+    }
+
+    V_STOREU( out, V_MUL( V_SET1( 27.0f ), n ) );
+    V_STOREU( dnx, V_MUL( V_SET1( 27.0f ), dx ) );
+    V_STOREU( dny, V_MUL( V_SET1( 27.0f ), dy ) );
+    V_STOREU( dnz, V_MUL( V_SET1( 27.0f ), dz ) );
+    V_STOREU( dnw, V_MUL( V_SET1( 27.0f ), dw ) );
+}
+
+#undef PERM
+#undef HASH
+#undef WRAP
+#undef HASH_SETUP
+#undef MASK01
+#undef F2f
+#undef G2f
+#undef F3f
+#undef G3f
+#undef F4f
+#undef G4f
@@ -0,0 +1,199 @@
+/*
+ * Streaming of a CPU-generated texture to GL. See texstream.h.
+ *
+ * The functions beyond OpenGL 3.3 are loaded here with
+ * glfwGetProcAddress() on every platform, since they may be missing,
+ * and then we fall back to what we have.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GLFW/glfw3.h>
+#include "GL/glext.h"
+
+#include "texstream.h"
+
+static PFNGLTEXSTORAGE2DPROC    pglTexStorage2D;
+static PFNGLBUFFERSTORAGEPROC   pglBufferStorage;
+static PFNGLMAPBUFFERRANGEPROC  pglMapBufferRange;
+static PFNGLUNMAPBUFFERPROC     pglUnmapBuffer;
+static PFNGLGENBUFFERSPROC      pglGenBuffers;
+static PFNGLBINDBUFFERPROC      pglBindBuffer;
+static PFNGLDELETEBUFFERSPROC   pglDeleteBuffers;
+static PFNGLFENCESYNCPROC       pglFenceSync;
+static PFNGLCLIENTWAITSYNCPROC  pglClientWaitSync;
+static PFNGLDELETESYNCPROC      pglDeleteSync;
+
+/*
+ * hasGL() - Check for GL version major.minor or later, or the extension
+ */
+static int hasGL(int major, int minor, const char *extension) {
+    int glmajor = 0, glminor = 0;
+    const char *version = (const char*) glGetString(GL_VERSION);
+
+    if (version) sscanf(version, "%d.%d", &glmajor, &glminor);
+    if (glmajor > major || (glmajor == major && glminor >= minor)) return 1;
+    return glfwExtensionSupported(extension);
+}
+
+unsigned char *streamAllocImage(size_t bytes) {
+    unsigned char *image;
+#ifdef _WIN32
+    image = (unsigned char*) _aligned_malloc(bytes, 64);
+#else
+    void *p;
+    image = posix_memalign(&p, 64, bytes) == 0 ? (unsigned char*) p : NULL;
+#endif
+    if (image) memset(image, 0, bytes);
+    return image;
+}
+
+void streamFreeImage(unsigned char *p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+int streamInit(texStream *ts, int size, int count, int flags) {
+    size_t bytes = (size_t)size*size*4;
+    GLbitfield access;
+    int i;
+
+    memset(ts, 0, sizeof(texStream));
+    ts->size = size;
+    ts->count = count < 2 ? 2 : count > STREAM_MAXRING ? STREAM_MAXRING : count;
+    if (flags & STREAM_BGRA) {
+        ts->format = GL_BGRA;
+        ts->type = GL_UNSIGNED_INT_8_8_8_8_REV;
+        ts->blue = 0;
+    } else {
+        ts->format = GL_RGBA;
+        ts->type = GL_UNSIGNED_BYTE;
+        ts->blue = 2;
+    }
+
+    pglTexStorage2D   = (PFNGLTEXSTORAGE2DPROC)glfwGetProcAddress("glTexStorage2D");
+    pglBufferStorage  = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    pglMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)glfwGetProcAddress("glMapBufferRange");
+    pglUnmapBuffer    = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
+    pglGenBuffers     = (PFNGLGENBUFFERSPROC)glfwGetProcAddress("glGenBuffers");
+    pglBindBuffer     = (PFNGLBINDBUFFERPROC)glfwGetProcAddress("glBindBuffer");
+    pglDeleteBuffers  = (PFNGLDELETEBUFFERSPROC)glfwGetProcAddress("glDeleteBuffers");
+    pglFenceSync      = (PFNGLFENCESYNCPROC)glfwGetProcAddress("glFenceSync");
+    pglClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)glfwGetProcAddress("glClientWaitSync");
+    pglDeleteSync     = (PFNGLDELETESYNCPROC)glfwGetProcAddress("glDeleteSync");
+
+    // Immutable storage for the texture if we can, or else the old way,
+    // but only once. The data is always replaced with glTexSubImage2D().
+    glGenTextures(1, &ts->texture);
+    glBindTexture(GL_TEXTURE_2D, ts->texture);
+    if (pglTexStorage2D && hasGL(4, 2, "GL_ARB_texture_storage"))
+        pglTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size, size);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, ts->format, ts->type, NULL);
+
+    ts->persistent = !(flags & STREAM_NOPBO)
+        && pglBufferStorage && pglMapBufferRange && pglUnmapBuffer && pglGenBuffers
+        && pglBindBuffer && pglDeleteBuffers && pglFenceSync && pglClientWaitSync
+        && pglDeleteSync && hasGL(4, 4, "GL_ARB_buffer_storage");
+
+    if (ts->persistent) {
+        // Readable as well as writable, since the front is read by the
+        // feedback, and in client storage, to keep the reads from the CPU
+        // out of write-combined video memory.
+        access = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        pglGenBuffers(ts->count, ts->pbo);
+        for (i = 0; i < ts->count; i++) {
+            pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo[i]);
+            pglBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, access | GL_CLIENT_STORAGE_BIT);
+            ts->image[i] = (unsigned char*) pglMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, access);
+            if (ts->image[i]) memset(ts->image[i], 0, bytes);
+        }
+        pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (i = 0; i < ts->count; i++)
+            if (!ts->image[i]) {
+                // Mapping failed, so give up on buffer objects
+                streamDelete(ts);
+                return streamInit(ts, size, count, flags | STREAM_NOPBO);
+            }
+    } else {
+        for (i = 0; i < ts->count; i++) {
+            ts->image[i] = streamAllocImage(bytes);
+            if (!ts->image[i]) {
+                streamDelete(ts);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+void streamWaitImage(texStream *ts, int i) {
+    if (ts->fence[i]) {
+        while (pglClientWaitSync(ts->fence[i], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        pglDeleteSync(ts->fence[i]);
+        ts->fence[i] = 0;
+    }
+}
+
+unsigned char *streamBack(texStream *ts) {
+    int back = (ts->front + 1) % ts->count;
+
+    streamWaitImage(ts, back);
+    return ts->image[back];
+}
+
+const unsigned char *streamFront(const texStream *ts) {
+    return ts->image[ts->front];
+}
+
+void streamUploadImage(texStream *ts, int i) {
+    if (ts->persistent) {
+        // From the buffer object, at offset 0. This only queues the copy.
+        pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo[i]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ts->size, ts->size, ts->format, ts->type, 0);
+        pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (ts->fence[i]) pglDeleteSync(ts->fence[i]);
+        ts->fence[i] = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ts->size, ts->size, ts->format, ts->type,
+                        ts->image[i]);
+    }
+}
+
+void streamUpload(texStream *ts) {
+    int back = (ts->front + 1) % ts->count;
+
+    streamUploadImage(ts, back);
+    ts->front = back;
+}
+
+void streamDelete(texStream *ts) {
+    int i;
+
+    for (i = 0; i < ts->count; i++) {
+        if (ts->fence[i]) pglDeleteSync(ts->fence[i]);
+        ts->fence[i] = 0;
+        if (ts->pbo[i]) {
+            if (ts->image[i]) {
+                pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo[i]);
+                pglUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+        } else {
+            streamFreeImage(ts->image[i]);
+        }
+        ts->image[i] = NULL;
+    }
+    if (ts->persistent) {
+        pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pglDeleteBuffers(ts->count, ts->pbo);
+    }
+    memset(ts->pbo, 0, sizeof(ts->pbo));
+    if (ts->texture) glDeleteTextures(1, &ts->texture);
+    ts->texture = 0;
+}
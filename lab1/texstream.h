@@ -0,0 +1,90 @@
+/*
+ * Streaming of a CPU-generated texture to GL, one frame at a time.
+ *
+ * The texture has immutable storage from glTexStorage2D(), allocated
+ * once, and each frame is copied in with glTexSubImage2D(). Where the GL
+ * has buffer storage (4.4 or GL_ARB_buffer_storage), the frames are
+ * shaded straight into a ring of pixel buffer objects that stay mapped,
+ * so the copy into the texture is done by the GL from the buffer while
+ * the CPU goes on with the next frame. A fence per buffer keeps the CPU
+ * from writing a buffer before the GL is done reading it. Without buffer
+ * storage, the ring is in client memory and the copy is synchronous.
+ *
+ * The buffers of the ring are also the front and back images of the
+ * shading: the front is the last uploaded frame and can be read, and the
+ * back is the next one in the ring, which the next frame is shaded into.
+ * A caller that hands the buffers around in some other order, like the
+ * pipelined mode of SWshading.c, can instead upload and wait for them by
+ * their index with streamUploadImage() and streamWaitImage().
+ */
+
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+
+#include <stddef.h>
+#include <GLFW/glfw3.h>
+#include "GL/glext.h"
+
+/* Options for streamInit() */
+#define STREAM_BGRA  1 // Pixels are B,G,R,A in memory, the native order of most GPUs
+#define STREAM_NOPBO 2 // Use client memory even if buffer storage is there
+
+/* The usual number of buffers in the ring: one being shaded, one being
+   read by the GL, and one to spare so the CPU doesn't wait for the GL */
+#define STREAM_RING 3
+
+/* The most buffers a ring can have */
+#define STREAM_MAXRING 8
+
+/* A struct to hold a streamed texture and its ring of buffers */
+typedef struct {
+    GLuint texture;      // The texture, size x size GL_RGBA8
+    int size;            // Width and height of the texture
+    GLenum format;       // GL_RGBA or GL_BGRA, the order of bytes in memory
+    GLenum type;         // GL_UNSIGNED_BYTE, or GL_UNSIGNED_INT_8_8_8_8_REV for BGRA
+    int blue;            // Byte offset of blue within a pixel, 2 for RGBA or 0 for BGRA
+    int persistent;      // 1 if the ring is in persistently mapped buffer objects
+    int count;           // Number of buffers in the ring
+    GLuint pbo[STREAM_MAXRING];
+    GLsync fence[STREAM_MAXRING];
+    unsigned char *image[STREAM_MAXRING]; // Mapped buffers, or client memory
+    int front;           // The buffer of the last uploaded frame
+} texStream;
+
+/* Create the texture and a ring of count buffers, 2 to STREAM_MAXRING,
+   and leave the texture bound. A GL context must be current. Returns 0 if
+   out of memory. */
+int streamInit(texStream *ts, int size, int count, int flags);
+
+/* The buffer for the next frame, size*size*4 bytes. This waits for the
+   GL, if it is still reading the buffer from an earlier frame. */
+unsigned char *streamBack(texStream *ts);
+
+/* The last uploaded frame */
+const unsigned char *streamFront(const texStream *ts);
+
+/* Upload the buffer from streamBack() to the texture, and make it the
+   front. The texture must be bound. */
+void streamUpload(texStream *ts);
+
+/* Upload buffer i of the ring to the texture. The texture must be bound.
+   Unlike streamUpload(), this leaves the front alone. */
+void streamUploadImage(texStream *ts, int i);
+
+/* Wait until the GL is done reading buffer i, so that it can be written.
+   This is only the GL side: the pixels may be written from any thread
+   once it returns, but the call itself must be made with the context. */
+void streamWaitImage(texStream *ts, int i);
+
+/* Delete the texture and the ring */
+void streamDelete(texStream *ts);
+
+/* Zeroed client memory for an image, aligned to 64 bytes, as the ring has
+   without buffer objects. This needs no GL, so it also serves for frames
+   that are shaded but never uploaded. */
+unsigned char *streamAllocImage(size_t bytes);
+
+/* Free an image from streamAllocImage() */
+void streamFreeImage(unsigned char *p);
+
+#endif
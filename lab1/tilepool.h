@@ -0,0 +1,50 @@
+/*
+ * A persistent pool of worker threads for rendering an image in tiles.
+ * The threads are started once and wait between jobs, so a job per frame
+ * costs a wakeup rather than a thread creation.
+ *
+ * A job is a number of tiles and a function to call for each of them.
+ * The tiles are split into one contiguous range per thread, and a thread
+ * that runs out of work steals tiles from the end of the others' ranges,
+ * so the load evens out when some tiles are more expensive than others.
+ * Which thread runs which tile varies from run to run, so the tile
+ * function must write only its own tile to get the same image every time.
+ */
+
+#ifndef TILEPOOL_H
+#define TILEPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tilePool tilePool;
+
+/* Called once for each tile of a job. worker is 0..threads-1, the thread
+   that runs the call, for indexing per-thread scratch memory. */
+typedef void (*tileFunc)(void *arg, int tile, int worker);
+
+/* Start a pool of nthreads threads, counting the one that calls
+   tilePoolRun(). With nthreads <= 0, use one per CPU. Returns NULL if the
+   threads can't be created. */
+tilePool *tilePoolCreate(int nthreads);
+
+/* The number of threads in the pool, including the calling thread */
+int tilePoolThreads(const tilePool *pool);
+
+/* Call fn(arg, tile, worker) for tile = 0..ntiles-1, spread over the
+   pool, and return when all calls have returned. The calling thread
+   works on tiles too, as worker 0. */
+void tilePoolRun(tilePool *pool, int ntiles, tileFunc fn, void *arg);
+
+/* Stop the threads and free the pool */
+void tilePoolDestroy(tilePool *pool);
+
+/* The number of CPUs, or 1 if it can't be found */
+int tilePoolCPUs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
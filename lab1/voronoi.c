@@ -0,0 +1,434 @@
+/*
+ * Cellular noise, ported from lab2/vonoroi.sl. See voronoi.h for the
+ * interface.
+ *
+ * The functions are line by line translations of the shader code, with
+ * the same order of operations, so that the results are what the shader
+ * gives with this cellnoise(). The 2D functions use the 3D cellnoise of
+ * the cell ( i, j, 0 ) like the shader does, so the feature points are
+ * jittered in z as well, and that adds to the distance.
+ *
+ * cellnoise() in PRMan is not documented beyond being a constant random
+ * value per integer cell, so ours is a hash of the cell coordinates:
+ * a multiply-add of the integer coordinates and the component number,
+ * and then the "lowbias32" integer finalizer, a couple of shifts and
+ * multiplies that mix every input bit into every output bit. It is the
+ * same in the scalar and SIMD code and on every platform, and it needs
+ * no table, so it vectorizes without gathers.
+ *
+ * The batch functions have SIMD kernels for SSE2, AVX2 and AVX-512,
+ * compiled from voronoisimd.h and picked at run time as in cellular.c.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "voronoi.h"
+#include "cpuisa.h"
+
+// Multipliers for the cell coordinates and the component in the hash
+#define HASH_X 0x8da6b343u
+#define HASH_Y 0xd8163841u
+#define HASH_Z 0xcb1ab31fu
+#define HASH_C 0x165667b1u
+
+#define CELL_HASH(ix, iy, iz) \
+    ((unsigned int)(ix) * HASH_X + (unsigned int)(iy) * HASH_Y + (unsigned int)(iz) * HASH_Z)
+
+/*
+ * cellunit() - Mix a cell hash and map it to [0,1), with 24 bits so that
+ * the conversion to float is exact.
+ */
+static float cellunit(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+float cellnoise1(float x) {
+    return cellunit(CELL_HASH((int)floorf(x), 0, 0));
+}
+
+void cellnoise3(float x, float y, float z, float v[3]) {
+    unsigned int h = CELL_HASH((int)floorf(x), (int)floorf(y), (int)floorf(z));
+    v[0] = cellunit(h);
+    v[1] = cellunit(h + HASH_C);
+    v[2] = cellunit(h + 2u * HASH_C);
+}
+
+void voronoi_f1_1d(float s, float freq, float jitter, float *f1, float *posf) {
+    float p = s * freq;
+    float fp = floorf(p);
+    float thiscell = fp + 0.5f;
+    int ip = (int)fp;
+    float testcell, pos, offset;
+    int i;
+
+    *f1 = freq + 1.0f;
+    *posf = 0.0f;
+    for (i = -1; i <= 1; i++) {
+        testcell = thiscell + (float)i;
+        pos = testcell + jitter * (cellunit(CELL_HASH(ip + i, 0, 0)) - 0.5f);
+        offset = fabsf(pos - p);
+        if (offset < *f1) {
+            *f1 = offset;
+            *posf = pos;
+        }
+    }
+    *posf /= freq;
+}
+
+/*
+ * voronoi2() - The loop of voronoi_f2_2d(), which voronoi_f1_2d() shares,
+ * since the closest point is found the same way in both. The shader
+ * starts f2 at 0 rather than at freq+1, so f2 only ever gets a value
+ * when a point is pushed down from f1.
+ */
+static void voronoi2(float s, float t, float freq, float jitter,
+                     float *f1, float *f2, float pos1[2], float pos2[2]) {
+    float ps = s * freq, pt = t * freq;
+    float fs = floorf(ps), ft = floorf(pt);
+    float cs = fs + 0.5f, ct = ft + 0.5f;
+    int is = (int)fs, it = (int)ft;
+    float d1 = freq + 1.0f, d2 = 0.0f;
+    float p1s = 0.0f, p1t = 0.0f, p2s = 0.0f, p2t = 0.0f;
+    float px, py, dx, dy, dz, dist;
+    unsigned int h;
+    int i, j;
+
+    for (i = -1; i <= 1; i++) {
+        for (j = -1; j <= 1; j++) {
+            h = CELL_HASH(is + i, it + j, 0);
+            px = (cs + (float)i) + jitter * (cellunit(h) - 0.5f);
+            py = (ct + (float)j) + jitter * (cellunit(h + HASH_C) - 0.5f);
+            dz = jitter * (cellunit(h + 2u * HASH_C) - 0.5f);
+            dx = px - ps;
+            dy = py - pt;
+            dist = dx * dx + dy * dy + dz * dz;
+            if (dist < d1) {
+                d2 = d1;
+                p2s = p1s;
+                p2t = p1t;
+                d1 = dist;
+                p1s = px;
+                p1t = py;
+            } else if (dist < d2) {
+                d2 = dist;
+                p2s = px;
+                p2t = py;
+            }
+        }
+    }
+
+    pos1[0] = p1s / freq;
+    pos1[1] = p1t / freq;
+    pos2[0] = p2s / freq;
+    pos2[1] = p2t / freq;
+    *f1 = sqrtf(d1);
+    *f2 = sqrtf(d2);
+}
+
+void voronoi_f1_2d(float s, float t, float freq, float jitter,
+                   float *f1, float *pos_s, float *pos_t) {
+    float f2, pos1[2], pos2[2];
+
+    voronoi2(s, t, freq, jitter, f1, &f2, pos1, pos2);
+    *pos_s = pos1[0];
+    *pos_t = pos1[1];
+}
+
+void voronoi_f2_2d(float s, float t, float freq, float jitter,
+                   float *f1, float *f2, float *pos_s, float *pos_t,
+                   float *pos2_s, float *pos2_t) {
+    float pos1[2], pos2[2];
+
+    voronoi2(s, t, freq, jitter, f1, f2, pos1, pos2);
+    *pos_s = pos1[0];
+    *pos_t = pos1[1];
+    *pos2_s = pos2[0];
+    *pos2_t = pos2[1];
+}
+
+/*
+ * voronoi3() - The loop of voronoi_f2_3d(), shared with voronoi_f1_3d().
+ * Here both f1 and f2 start at freq+1.
+ */
+static void voronoi3(const float P[3], float freq, float jitter,
+                     float *f1, float *f2, float pos1[3], float pos2[3]) {
+    float px = P[0] * freq, py = P[1] * freq, pz = P[2] * freq;
+    float fx = floorf(px), fy = floorf(py), fz = floorf(pz);
+    float cx = fx + 0.5f, cy = fy + 0.5f, cz = fz + 0.5f;
+    int ix = (int)fx, iy = (int)fy, iz = (int)fz;
+    float d1 = freq + 1.0f, d2 = freq + 1.0f;
+    float p1[3] = {0.0f, 0.0f, 0.0f}, p2[3] = {0.0f, 0.0f, 0.0f};
+    float tx, ty, tz, dx, dy, dz, dist;
+    unsigned int h;
+    int i, j, k;
+
+    for (i = -1; i <= 1; i++) {
+        for (j = -1; j <= 1; j++) {
+            for (k = -1; k <= 1; k++) {
+                h = CELL_HASH(ix + i, iy + j, iz + k);
+                tx = (cx + (float)i) + jitter * (cellunit(h) - 0.5f);
+                ty = (cy + (float)j) + jitter * (cellunit(h + HASH_C) - 0.5f);
+                tz = (cz + (float)k) + jitter * (cellunit(h + 2u * HASH_C) - 0.5f);
+                dx = tx - px;
+                dy = ty - py;
+                dz = tz - pz;
+                dist = dx * dx + dy * dy + dz * dz;
+                if (dist < d1) {
+                    d2 = d1;
+                    d1 = dist;
+                    p2[0] = p1[0]; p2[1] = p1[1]; p2[2] = p1[2];
+                    p1[0] = tx; p1[1] = ty; p1[2] = tz;
+                } else if (dist < d2) {
+                    d2 = dist;
+                    p2[0] = tx; p2[1] = ty; p2[2] = tz;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        pos1[i] = p1[i] / freq;
+        pos2[i] = p2[i] / freq;
+    }
+    *f1 = sqrtf(d1);
+    *f2 = sqrtf(d2);
+}
+
+void voronoi_f1_3d(const float P[3], float freq, float jitter,
+                   float *f1, float pos[3]) {
+    float f2, pos2[3];
+
+    voronoi3(P, freq, jitter, f1, &f2, pos, pos2);
+}
+
+void voronoi_f2_3d(const float P[3], float freq, float jitter,
+                   float *f1, float *f2, float pos1[3], float pos2[3]) {
+    voronoi3(P, freq, jitter, f1, f2, pos1, pos2);
+}
+
+/*
+ * The SIMD kernels. Each lane is one point, and the lanes run the same
+ * loop as voronoi2() and voronoi3(), with the branches turned into
+ * selects, so the results are the same as from the scalar functions.
+ */
+#ifdef CPUISA_X86
+
+#define SIMD_ISA ISA_SSE2
+#include "simdlanes.h"
+#include "voronoisimd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX2
+#include "simdlanes.h"
+#include "voronoisimd.h"
+#undef SIMD_ISA
+
+#define SIMD_ISA ISA_AVX512
+#include "simdlanes.h"
+#include "voronoisimd.h"
+#undef SIMD_ISA
+
+#endif /* CPUISA_X86 */
+
+// The widest SIMD vector we have a kernel for
+#define VORONOI_MAXW 16
+
+typedef void (*voronoi2_fn)(const float *s, const float *t, float freq,
+                            float jitter, float *f1, float *f2,
+                            float *pos1, float *pos2, int stride);
+typedef void (*voronoi3_fn)(const float *x, const float *y, const float *z,
+                            float freq, float jitter, float *f1, float *f2,
+                            float *pos1, float *pos2, int stride);
+
+/*
+ * voronoiKernels() - Select the kernels for the best instruction set the
+ * CPU supports, and return their width in lanes, or 0 if there are none.
+ */
+static int voronoiKernels(voronoi2_fn *k2, voronoi3_fn *k3) {
+#ifdef CPUISA_X86
+    switch (cpu_isa()) {
+    case ISA_AVX512:
+        *k2 = voronoi2_block_avx512;
+        *k3 = voronoi3_block_avx512;
+        return 16;
+    case ISA_AVX2:
+        *k2 = voronoi2_block_avx2;
+        *k3 = voronoi3_block_avx2;
+        return 8;
+    case ISA_SSE41:
+    case ISA_SSE2:
+        *k2 = voronoi2_block_sse2;
+        *k3 = voronoi3_block_sse2;
+        return 4;
+    }
+#endif
+    *k2 = 0;
+    *k3 = 0;
+    return 0;
+}
+
+/*
+ * storeTail() - Copy the results for the last m points of a batch from
+ * the padded buffers of width VORONOI_MAXW to the outputs of length n.
+ */
+static void storeTail(int i, int m, int n, int dim, const float *tf1,
+                      const float *tf2, const float *tp1, const float *tp2,
+                      float *f1, float *f2, float *pos1, float *pos2) {
+    int j, c;
+
+    for (j = 0; j < m; j++) {
+        f1[i + j] = tf1[j];
+        if (f2) f2[i + j] = tf2[j];
+        for (c = 0; c < dim; c++) {
+            if (pos1) pos1[c * n + i + j] = tp1[c * VORONOI_MAXW + j];
+            if (pos2) pos2[c * n + i + j] = tp2[c * VORONOI_MAXW + j];
+        }
+    }
+}
+
+void voronoi_2d_batch(const float *s, const float *t, int n,
+                      float freq, float jitter,
+                      float *f1, float *f2, float *pos1, float *pos2) {
+    voronoi2_fn kernel;
+    voronoi3_fn kernel3;
+    int w = voronoiKernels(&kernel, &kernel3);
+    float pf2, p1[2], p2[2];
+    int i = 0, j;
+
+    if (w) {
+        float ts[VORONOI_MAXW] = {0.0f}, tt[VORONOI_MAXW] = {0.0f};
+        float tf1[VORONOI_MAXW], tf2[VORONOI_MAXW];
+        float tp1[2 * VORONOI_MAXW], tp2[2 * VORONOI_MAXW];
+
+        for (; i + w <= n; i += w)
+            kernel(s + i, t + i, freq, jitter, f1 + i, f2 ? f2 + i : 0,
+                   pos1 ? pos1 + i : 0, pos2 ? pos2 + i : 0, n);
+        if (i < n) {
+            for (j = 0; i + j < n; j++) {
+                ts[j] = s[i + j];
+                tt[j] = t[i + j];
+            }
+            kernel(ts, tt, freq, jitter, tf1, tf2, tp1, tp2, VORONOI_MAXW);
+            storeTail(i, n - i, n, 2, tf1, tf2, tp1, tp2, f1, f2, pos1, pos2);
+        }
+        return;
+    }
+
+    for (; i < n; i++) {
+        voronoi2(s[i], t[i], freq, jitter, f1 + i, &pf2, p1, p2);
+        if (f2) f2[i] = pf2;
+        for (j = 0; j < 2; j++) {
+            if (pos1) pos1[j * n + i] = p1[j];
+            if (pos2) pos2[j * n + i] = p2[j];
+        }
+    }
+}
+
+void voronoi_3d_batch(const float *x, const float *y, const float *z, int n,
+                      float freq, float jitter,
+                      float *f1, float *f2, float *pos1, float *pos2) {
+    voronoi2_fn kernel2;
+    voronoi3_fn kernel;
+    int w = voronoiKernels(&kernel2, &kernel);
+    float P[3], pf2, p1[3], p2[3];
+    int i = 0, j;
+
+    if (w) {
+        float tx[VORONOI_MAXW] = {0.0f}, ty[VORONOI_MAXW] = {0.0f};
+        float tz[VORONOI_MAXW] = {0.0f};
+        float tf1[VORONOI_MAXW], tf2[VORONOI_MAXW];
+        float tp1[3 * VORONOI_MAXW], tp2[3 * VORONOI_MAXW];
+
+        for (; i + w <= n; i += w)
+            kernel(x + i, y + i, z + i, freq, jitter, f1 + i, f2 ? f2 + i : 0,
+                   pos1 ? pos1 + i : 0, pos2 ? pos2 + i : 0, n);
+        if (i < n) {
+            for (j = 0; i + j < n; j++) {
+                tx[j] = x[i + j];
+                ty[j] = y[i + j];
+                tz[j] = z[i + j];
+            }
+            kernel(tx, ty, tz, freq, jitter, tf1, tf2, tp1, tp2, VORONOI_MAXW);
+            storeTail(i, n - i, n, 3, tf1, tf2, tp1, tp2, f1, f2, pos1, pos2);
+        }
+        return;
+    }
+
+    for (; i < n; i++) {
+        P[0] = x[i];
+        P[1] = y[i];
+        P[2] = z[i];
+        voronoi3(P, freq, jitter, f1 + i, &pf2, p1, p2);
+        if (f2) f2[i] = pf2;
+        for (j = 0; j < 3; j++) {
+            if (pos1) pos1[j * n + i] = p1[j];
+            if (pos2) pos2[j * n + i] = p2[j];
+        }
+    }
+}
+
+/*
+ * voronoiGrid() - The row loop of both grids, in 2D if flat is set, in
+ * which case nz must be 1 and z0, dz and zstride are not used.
+ */
+static void voronoiGrid(int flat, float x0, float y0, float z0, float dx,
+                        float dy, float dz, int nx, int ny, int nz, float freq,
+                        float jitter, float *f1, float *f2, int ystride,
+                        int zstride) {
+    float *xs, *ys, *zs, P[3], pos[3], pos2[3], pf2;
+    float *r1, *r2;
+    int i, j, k;
+
+    xs = (float*) malloc(3 * nx * sizeof(float));
+    if (!xs) {
+        // Out of memory, so do it the slow way
+        for (k = 0; k < nz; k++) for (j = 0; j < ny; j++) for (i = 0; i < nx; i++) {
+            r1 = f1 + i + j * ystride + k * zstride;
+            if (flat) {
+                voronoi2(x0 + i * dx, y0 + j * dy, freq, jitter, r1, &pf2, pos, pos2);
+            } else {
+                P[0] = x0 + i * dx;
+                P[1] = y0 + j * dy;
+                P[2] = z0 + k * dz;
+                voronoi3(P, freq, jitter, r1, &pf2, pos, pos2);
+            }
+            if (f2) f2[i + j * ystride + k * zstride] = pf2;
+        }
+        return;
+    }
+    ys = xs + nx;
+    zs = ys + nx;
+    for (i = 0; i < nx; i++) xs[i] = x0 + i * dx;
+    for (k = 0; k < nz; k++) {
+        for (i = 0; i < nx; i++) zs[i] = z0 + k * dz;
+        for (j = 0; j < ny; j++) {
+            for (i = 0; i < nx; i++) ys[i] = y0 + j * dy;
+            r1 = f1 + j * ystride + k * zstride;
+            r2 = f2 ? f2 + j * ystride + k * zstride : 0;
+            if (flat) voronoi_2d_batch(xs, ys, nx, freq, jitter, r1, r2, 0, 0);
+            else voronoi_3d_batch(xs, ys, zs, nx, freq, jitter, r1, r2, 0, 0);
+        }
+    }
+    free(xs);
+}
+
+void voronoi_2d_grid(float s0, float t0, float ds, float dt, int nx, int ny,
+                     float freq, float jitter, float *f1, float *f2,
+                     int ystride) {
+    if (nx <= 0 || ny <= 0) return;
+    voronoiGrid(1, s0, t0, 0.0f, ds, dt, 0.0f, nx, ny, 1, freq, jitter,
+                f1, f2, ystride, 0);
+}
+
+void voronoi_3d_grid(float x0, float y0, float z0, float dx, float dy, float dz,
+                     int nx, int ny, int nz, float freq, float jitter,
+                     float *f1, float *f2, int ystride, int zstride) {
+    if (nx <= 0 || ny <= 0 || nz <= 0) return;
+    voronoiGrid(0, x0, y0, z0, dx, dy, dz, nx, ny, nz, freq, jitter,
+                f1, f2, ystride, zstride);
+}
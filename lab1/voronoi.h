@@ -0,0 +1,73 @@
+/*
+ * The cellular noise functions of lab2/vonoroi.sl, in C, so that they
+ * can be evaluated without a RenderMan renderer. The results are the
+ * same as those of the shader functions, with cellnoise() replaced by
+ * the cellnoise1() and cellnoise3() below, which are deterministic on
+ * every platform. C++ code can use voronoi.hpp, which has overloads
+ * with the output arguments of the shader language.
+ *
+ * As in the shader, f1 and f2 are in the units of the scaled domain,
+ * p*freq, while the feature point positions are in the units of p. All
+ * the quirks of the shader are kept, so that baked textures match: the
+ * 2D functions are a slice at z = 0 through points jittered in 3D, and
+ * the search covers only the 3, 9 or 27 nearest cells, so jitter above 1
+ * can miss points.
+ */
+
+#ifndef VORONOI_H
+#define VORONOI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* float cellnoise(float) and vector cellnoise(point): values in 0..1 that
+   are constant over each cell between integers, one per component */
+float cellnoise1(float x);
+void cellnoise3(float x, float y, float z, float v[3]);
+
+/* The shader functions, with pointers for the output arguments */
+void voronoi_f1_1d(float s, float freq, float jitter, float *f1, float *posf);
+void voronoi_f1_2d(float s, float t, float freq, float jitter,
+                   float *f1, float *pos_s, float *pos_t);
+void voronoi_f2_2d(float s, float t, float freq, float jitter,
+                   float *f1, float *f2, float *pos_s, float *pos_t,
+                   float *pos2_s, float *pos2_t);
+void voronoi_f1_3d(const float P[3], float freq, float jitter,
+                   float *f1, float pos[3]);
+void voronoi_f2_3d(const float P[3], float freq, float jitter,
+                   float *f1, float *f2, float pos1[3], float pos2[3]);
+
+/* voronoi_f2_2d() for n points ( s[i], t[i] ), with SIMD where the CPU
+   allows. f1 is the same as from voronoi_f1_2d(), so f2 may be NULL if
+   only that is needed. The positions of the closest and the second
+   closest point go in pos1 and pos2, component c of point i at
+   [c*n + i], and either may be NULL. The points that don't fill a last
+   SIMD vector are run through the kernel as well, so the results don't
+   depend on n. */
+void voronoi_2d_batch(const float *s, const float *t, int n,
+                      float freq, float jitter,
+                      float *f1, float *f2, float *pos1, float *pos2);
+
+/* The same for voronoi_f2_3d() and voronoi_f1_3d() */
+void voronoi_3d_batch(const float *x, const float *y, const float *z, int n,
+                      float freq, float jitter,
+                      float *f1, float *f2, float *pos1, float *pos2);
+
+/* f1 and f2 over a regular grid, to bake a texture: sample (i,j) is at
+   ( s0 + i*ds, t0 + j*dt ) and goes to f1[ i + j*ystride ], and in 3D,
+   sample (i,j,k) at ( x0 + i*dx, y0 + j*dy, z0 + k*dz ) goes to
+   f1[ i + j*ystride + k*zstride ]. f2 may be NULL. Nothing is written
+   unless nx, ny and nz are all above 0. */
+void voronoi_2d_grid(float s0, float t0, float ds, float dt, int nx, int ny,
+                     float freq, float jitter, float *f1, float *f2,
+                     int ystride);
+void voronoi_3d_grid(float x0, float y0, float z0, float dx, float dy, float dz,
+                     int nx, int ny, int nz, float freq, float jitter,
+                     float *f1, float *f2, int ystride, int zstride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
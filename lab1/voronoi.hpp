@@ -0,0 +1,84 @@
+/*
+ * C++ overloads for the cellular noise of voronoi.h, with the signatures
+ * of lab2/vonoroi.sl, so that shader code can be pasted in with few
+ * changes: output arguments are references, points are float[3], and
+ * the functions that return a point in the shader return a voronoi_point.
+ *
+ *   float f1, f2;
+ *   float pos1[3], pos2[3];
+ *   voronoi_f2_3d( P, 4.0f, 1.0f, f1, f2, pos1, pos2 );
+ *   voronoi_point f = voronoi_f2_3d( P, 4.0f, 1.0f ); // f1, f2, f2-f1
+ *
+ * Everything here forwards to the C functions, so the results are the
+ * same as from those.
+ */
+
+#ifndef VORONOI_HPP
+#define VORONOI_HPP
+
+#include "voronoi.h"
+
+/* The SL point type, for the functions that return one */
+struct voronoi_point {
+    float x, y, z;
+};
+
+inline float cellnoise(float x) {
+    return cellnoise1(x);
+}
+
+inline voronoi_point cellnoise(float x, float y, float z) {
+    float v[3];
+    cellnoise3(x, y, z, v);
+    voronoi_point p = { v[0], v[1], v[2] };
+    return p;
+}
+
+inline void voronoi_f1_1d(float s, float freq, float jitter,
+                          float &f1, float &posf) {
+    voronoi_f1_1d(s, freq, jitter, &f1, &posf);
+}
+
+inline void voronoi_f1_2d(float s, float t, float freq, float jitter,
+                          float &f1, float &pos_s, float &pos_t) {
+    voronoi_f1_2d(s, t, freq, jitter, &f1, &pos_s, &pos_t);
+}
+
+inline void voronoi_f2_2d(float s, float t, float freq, float jitter,
+                          float &f1, float &f2, float &pos_s, float &pos_t,
+                          float &pos2_s, float &pos2_t) {
+    voronoi_f2_2d(s, t, freq, jitter, &f1, &f2, &pos_s, &pos_t, &pos2_s, &pos2_t);
+}
+
+inline void voronoi_f1_3d(const float (&P)[3], float freq, float jitter,
+                          float &f1, float (&pos)[3]) {
+    voronoi_f1_3d(P, freq, jitter, &f1, pos);
+}
+
+inline float voronoi_f1_3d(const float (&P)[3], float freq, float jitter) {
+    float f1, pos[3];
+    voronoi_f1_3d(P, freq, jitter, &f1, pos);
+    return f1;
+}
+
+inline void voronoi_f2_3d(const float (&P)[3], float freq, float jitter,
+                          float &f1, float &f2, float (&pos1)[3], float (&pos2)[3]) {
+    voronoi_f2_3d(P, freq, jitter, &f1, &f2, pos1, pos2);
+}
+
+/* point( f1, f2, f2-f1 ), as returned by the shader versions */
+inline voronoi_point voronoi_f2_2d(float x, float y, float freq, float jitter) {
+    float f1, f2, x1, y1, x2, y2;
+    voronoi_f2_2d(x, y, freq, jitter, &f1, &f2, &x1, &y1, &x2, &y2);
+    voronoi_point p = { f1, f2, f2 - f1 };
+    return p;
+}
+
+inline voronoi_point voronoi_f2_3d(const float (&P)[3], float freq, float jitter) {
+    float f1, f2, pos1[3], pos2[3];
+    voronoi_f2_3d(P, freq, jitter, &f1, &f2, pos1, pos2);
+    voronoi_point p = { f1, f2, f2 - f1 };
+    return p;
+}
+
+#endif
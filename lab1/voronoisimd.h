@@ -0,0 +1,168 @@
+/*
+ * SIMD kernels for voronoi_2d_batch() and voronoi_3d_batch().
+ * This file is included several times from voronoi.c, once for each
+ * instruction set, after simdlanes.h has set up the lane macros.
+ * It is not meant to be included from anywhere else.
+ *
+ * Each lane handles one sample point and visits all 9 or 27 cells in the
+ * same order as voronoi2() and voronoi3(). The cell hash is built from
+ * per-axis products that are computed once, and the if/else if that
+ * keeps f1 and f2 is done with selects. The arithmetic is the same as in
+ * the scalar code, so the results are too, except that the AVX-512 kernel
+ * may fuse multiplies and adds and differ in the last bits.
+ */
+
+// cellunit() on 32-bit lanes
+SIMD_FN vfloat SIMD_NAME(vcellunit)( vint h )
+{
+    h = VI_XOR( h, VI_SRL( h, 16 ) );
+    h = VI_MUL( h, VI_SET1( (int)0x7feb352du ) );
+    h = VI_XOR( h, VI_SRL( h, 15 ) );
+    h = VI_MUL( h, VI_SET1( (int)0x846ca68bu ) );
+    h = VI_XOR( h, VI_SRL( h, 16 ) );
+    return V_MUL( VI_TOFLOAT( VI_SRL( h, 8 ) ), V_SET1( 1.0f / 16777216.0f ) );
+}
+
+// Feature point coordinate: testcell + jitter*(cellnoise - 0.5)
+SIMD_FN vfloat SIMD_NAME(vfeature)( vfloat testcell, vfloat jitter, vint h )
+{
+    return V_ADD( testcell, V_MUL( jitter, V_SUB( SIMD_NAME(vcellunit)( h ),
+                                                   V_SET1( 0.5f ) ) ) );
+}
+
+/** SIMD_W lanes of voronoi2(). f1 and f2 go to f1[i] and f2[i], and
+ * component c of the positions to pos1[c*stride + i] and pos2[...].
+ * f2, pos1 and pos2 may be NULL.
+ */
+SIMD_FN void SIMD_NAME(voronoi2_block)( const float *s, const float *t,
+                                        float freq, float jitter,
+                                        float *f1, float *f2,
+                                        float *pos1, float *pos2, int stride )
+{
+    vfloat vfreq = V_SET1( freq );
+    vfloat ps = V_MUL( V_LOADU( s ), vfreq );
+    vfloat pt = V_MUL( V_LOADU( t ), vfreq );
+    vfloat fs = V_FLOOR( ps );
+    vfloat ft = V_FLOOR( pt );
+    vfloat cs = V_ADD( fs, V_SET1( 0.5f ) );
+    vfloat ct = V_ADD( ft, V_SET1( 0.5f ) );
+    vint is = V_TOINT( fs );
+    vint it = V_TOINT( ft );
+    vfloat vj = V_SET1( jitter );
+    vfloat d1 = V_SET1( freq + 1.0f ), d2 = V_ZERO;
+    vfloat p1s = V_ZERO, p1t = V_ZERO, p2s = V_ZERO, p2t = V_ZERO;
+    vint hs[3], ht[3];
+    int i, j;
+
+    for( i = 0; i < 3; i++ ) {
+        hs[i] = VI_MUL( VI_ADD( is, VI_SET1( i - 1 ) ), VI_SET1( (int)HASH_X ) );
+        ht[i] = VI_MUL( VI_ADD( it, VI_SET1( i - 1 ) ), VI_SET1( (int)HASH_Y ) );
+    }
+
+    for( i = -1; i <= 1; i++ ) {
+        vfloat ts = V_ADD( cs, V_SET1( (float)i ) );
+        for( j = -1; j <= 1; j++ ) {
+            vint h = VI_ADD( hs[i+1], ht[j+1] );
+            vfloat px = SIMD_NAME(vfeature)( ts, vj, h );
+            vfloat py = SIMD_NAME(vfeature)( V_ADD( ct, V_SET1( (float)j ) ), vj,
+                                             VI_ADD( h, VI_SET1( (int)HASH_C ) ) );
+            vfloat dz = V_MUL( vj, V_SUB( SIMD_NAME(vcellunit)( VI_ADD( h, VI_SET1( (int)(2u * HASH_C) ) ) ),
+                                          V_SET1( 0.5f ) ) );
+            vfloat dx = V_SUB( px, ps );
+            vfloat dy = V_SUB( py, pt );
+            vfloat dist = V_ADD( V_ADD( V_MUL( dx, dx ), V_MUL( dy, dy ) ), V_MUL( dz, dz ) );
+            vmask m1 = V_CMPLT( dist, d1 );
+            vmask m2 = V_CMPLT( dist, d2 );
+
+            d2 = V_SEL( m1, d1, V_SEL( m2, dist, d2 ) );
+            p2s = V_SEL( m1, p1s, V_SEL( m2, px, p2s ) );
+            p2t = V_SEL( m1, p1t, V_SEL( m2, py, p2t ) );
+            d1 = V_SEL( m1, dist, d1 );
+            p1s = V_SEL( m1, px, p1s );
+            p1t = V_SEL( m1, py, p1t );
+        }
+    }
+
+    V_STOREU( f1, V_SQRT( d1 ) );
+    if( f2 ) V_STOREU( f2, V_SQRT( d2 ) );
+    if( pos1 ) {
+        V_STOREU( pos1, V_DIV( p1s, vfreq ) );
+        V_STOREU( pos1 + stride, V_DIV( p1t, vfreq ) );
+    }
+    if( pos2 ) {
+        V_STOREU( pos2, V_DIV( p2s, vfreq ) );
+        V_STOREU( pos2 + stride, V_DIV( p2t, vfreq ) );
+    }
+}
+
+/** The 3D version of voronoi2_block(), for voronoi3() */
+SIMD_FN void SIMD_NAME(voronoi3_block)( const float *x, const float *y,
+                                        const float *z, float freq, float jitter,
+                                        float *f1, float *f2,
+                                        float *pos1, float *pos2, int stride )
+{
+    vfloat vfreq = V_SET1( freq );
+    vfloat px = V_MUL( V_LOADU( x ), vfreq );
+    vfloat py = V_MUL( V_LOADU( y ), vfreq );
+    vfloat pz = V_MUL( V_LOADU( z ), vfreq );
+    vfloat fx = V_FLOOR( px );
+    vfloat fy = V_FLOOR( py );
+    vfloat fz = V_FLOOR( pz );
+    vfloat cx = V_ADD( fx, V_SET1( 0.5f ) );
+    vfloat cy = V_ADD( fy, V_SET1( 0.5f ) );
+    vfloat cz = V_ADD( fz, V_SET1( 0.5f ) );
+    vint ix = V_TOINT( fx );
+    vint iy = V_TOINT( fy );
+    vint iz = V_TOINT( fz );
+    vfloat vj = V_SET1( jitter );
+    vfloat d1 = V_SET1( freq + 1.0f ), d2 = d1;
+    vfloat p1[3], p2[3];
+    vint hx[3], hy[3], hz[3];
+    int i, j, k, c;
+
+    for( i = 0; i < 3; i++ ) {
+        hx[i] = VI_MUL( VI_ADD( ix, VI_SET1( i - 1 ) ), VI_SET1( (int)HASH_X ) );
+        hy[i] = VI_MUL( VI_ADD( iy, VI_SET1( i - 1 ) ), VI_SET1( (int)HASH_Y ) );
+        hz[i] = VI_MUL( VI_ADD( iz, VI_SET1( i - 1 ) ), VI_SET1( (int)HASH_Z ) );
+        p1[i] = V_ZERO;
+        p2[i] = V_ZERO;
+    }
+
+    for( i = -1; i <= 1; i++ ) {
+        vfloat tx = V_ADD( cx, V_SET1( (float)i ) );
+        for( j = -1; j <= 1; j++ ) {
+            vfloat ty = V_ADD( cy, V_SET1( (float)j ) );
+            vint hxy = VI_ADD( hx[i+1], hy[j+1] );
+            for( k = -1; k <= 1; k++ ) {
+                vint h = VI_ADD( hxy, hz[k+1] );
+                vfloat q[3], dx, dy, dz, dist;
+                vmask m1, m2;
+
+                q[0] = SIMD_NAME(vfeature)( tx, vj, h );
+                q[1] = SIMD_NAME(vfeature)( ty, vj, VI_ADD( h, VI_SET1( (int)HASH_C ) ) );
+                q[2] = SIMD_NAME(vfeature)( V_ADD( cz, V_SET1( (float)k ) ), vj,
+                                            VI_ADD( h, VI_SET1( (int)(2u * HASH_C) ) ) );
+                dx = V_SUB( q[0], px );
+                dy = V_SUB( q[1], py );
+                dz = V_SUB( q[2], pz );
+                dist = V_ADD( V_ADD( V_MUL( dx, dx ), V_MUL( dy, dy ) ), V_MUL( dz, dz ) );
+                m1 = V_CMPLT( dist, d1 );
+                m2 = V_CMPLT( dist, d2 );
+
+                d2 = V_SEL( m1, d1, V_SEL( m2, dist, d2 ) );
+                d1 = V_SEL( m1, dist, d1 );
+                for( c = 0; c < 3; c++ ) {
+                    p2[c] = V_SEL( m1, p1[c], V_SEL( m2, q[c], p2[c] ) );
+                    p1[c] = V_SEL( m1, q[c], p1[c] );
+                }
+            }
+        }
+    }
+
+    V_STOREU( f1, V_SQRT( d1 ) );
+    if( f2 ) V_STOREU( f2, V_SQRT( d2 ) );
+    for( c = 0; c < 3; c++ ) {
+        if( pos1 ) V_STOREU( pos1 + c*stride, V_DIV( p1[c], vfreq ) );
+        if( pos2 ) V_STOREU( pos2 + c*stride, V_DIV( p2[c], vfreq ) );
+    }
+}